@@ -26,27 +26,31 @@
  *
  * -------------------------------------------------------------------------
  */
-#include <boost/algorithm/string/replace.hpp>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include "calibrator.hpp"
+#include "config_template.hpp"
 #include "error.hpp"
-#include "fork.hpp"
+#include "spawn.hpp"
+#include <cerrno>
 #include <fstream>
 #include "log.hpp"
+#include <signal.h>
 #include <sstream>
 #include "station.hpp"
 #include "station_config.hpp"
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <boost/optional.hpp>
 
 namespace fs = boost::filesystem;
 
 extern fs::path FRONT_END_CAL_EXECUTABLE;
-extern fs::path FRONT_END_CAL_CONFIG_FILE;
+extern genesis::config_template FRONT_END_CAL_CONFIG;
 
 static const fs::path STATION_CONFIG_FILE = "station_config";
 
@@ -54,8 +58,11 @@ namespace genesis {
 
 namespace detail {
 
-// Load the bias from a saved file
-static bool load_bias (const fs::path &subdir, double &bias) {
+// Load the bias and when it was found from a saved file
+static bool load_bias (const fs::path &subdir,
+                       double &bias,
+                       std::time_t &calibrated)
+{
     fs::path file = subdir;
     file /= STATION_CONFIG_FILE;
 
@@ -63,39 +70,52 @@ static bool load_bias (const fs::path &subdir, double &bias) {
     bool result = load_station_config (file, cfg);
     if (result) {
         bias = cfg.if_bias ();
+        calibrated = cfg.calibrated ();
     }
     return result;
 }
 
 // Save the bias to a file
-static bool save_bias (const fs::path &subdir, double bias) {
+static bool save_bias (const fs::path &subdir,
+                       double bias,
+                       std::time_t calibrated)
+{
     fs::path file = subdir;
     file /= STATION_CONFIG_FILE;
 
-    station_config cfg (bias);
+    station_config cfg (bias, calibrated);
     return save_station_config (file, cfg);
 }
 
-// Write the INI file to the local directory
-static calibrator::error_type write_config (
-    const station &st,
-    const fs::path &path)
-{
-    std::ifstream ifs (FRONT_END_CAL_CONFIG_FILE.c_str (), std::ios::binary);
-    if (!ifs) {
-        return make_error_condition (file_not_found);
+enum {
+    EXIT_GRACE_MS = 5000, // for front-end-cal to exit before it's killed
+    EXIT_POLL_MS = 100
+};
+
+// Make sure front-end-cal has exited, so the station's dongle is free
+// for gnss-sdr again. It's told to stop at once if it gave no bias, and
+// killed if it's still running after a grace period.
+static void end_front_end_cal (pid_t pid, bool stop) {
+    if (stop) {
+        ::kill (pid, SIGTERM);
     }
-    std::ofstream ofs (path.c_str (), std::ios::binary);
-    if (!ofs) {
-        return make_error_condition (file_not_found);
+    for (int waited = 0; waited < EXIT_GRACE_MS; waited += EXIT_POLL_MS) {
+        pid_t rv = ::waitpid (pid, 0, WNOHANG);
+        if (rv == pid || (rv < 0 && errno == ECHILD)) {
+            return; // reaped here, or already by the service
+        }
+        ::usleep (EXIT_POLL_MS * 1000);
     }
+    ::kill (pid, SIGKILL);
+    while ((::waitpid (pid, 0, 0) == -1) && (errno == EINTR)) {}
+}
 
-    ofs << ifs.rdbuf ();
-
-    // Writing these at the end will override previous definitions
-    ofs << std::endl << "SignalSource.address=" << st.get_address () << std::endl;
-    ofs << "SignalSource.port=" << st.get_port () << std::endl;
-    return calibrator::error_type ();
+// front-end-cal's settings for a station
+static config_overrides overrides (const station &st) {
+    config_overrides o;
+    o.set ("SignalSource.address", st.get_address ());
+    o.set ("SignalSource.port", st.get_port ());
+    return o;
 }
 
 struct reader {
@@ -242,11 +262,13 @@ enum {
 
 struct calibrator::impl {
    impl ()
-       : IF_ (0)
+       : IF_ (0),
+         calibrated_ (0)
       {
       }
 
    double IF_;
+   std::time_t calibrated_;
    logger lg_;
 };
 
@@ -261,38 +283,43 @@ calibrator::error_type calibrator::read_if (int fd) {
     return r.get_read_error ();
 }
 
-calibrator::error_type calibrator::calibrate (const station &st,
-                                              fork_handler *handler)
-{
-    boost::system::error_code ec;
-    fs::path path (boost::algorithm::replace_all_copy (
-                       st.get_address (), ":", "."));
-    if (!fs::exists (path)) {
-        if (!fs::create_directory (st.get_address (), ec)) {
-            return to_error_condition (ec);
-        }
-    }
+bool calibrator::load (const station &st) {
+    fs::path path = station_directory (st.get_address ());
 
     // Look for existing calibration
     BOOST_LOG_SEV (impl_->lg_, trace)
        << "Looking for previously saved calibrations.";
-    if (detail::load_bias (path, impl_->IF_)) {
+    if (detail::load_bias (path, impl_->IF_, impl_->calibrated_)) {
         BOOST_LOG_SEV (impl_->lg_, debug)
            << "IF bias for "
            << st.get_address ()
            << " loaded from "
            << path.native ();
-        return error_type ();
+        return true;
     }
     BOOST_LOG_SEV (impl_->lg_, trace)
        << "No previously saved calibrations.";
+    return false;
+}
+
+calibrator::error_type calibrator::calibrate (const station &st,
+                                              spawn_handler *handler)
+{
+    boost::system::error_code ec;
+    fs::path path = station_directory (st.get_address ());
+    if (!make_directory (path, ec)) {
+        return to_error_condition (ec);
+    }
 
-    // Write configuration
+    // Configuration, in memory if possible
     BOOST_LOG_SEV (impl_->lg_, trace)
        << "Writing config file.";
-    fs::path config_file = path;
-    config_file /= "front-end-cal.conf";
-    error_type et = detail::write_config (st, config_file);
+    int config_fd;
+    std::string config_path;
+    error_type et = FRONT_END_CAL_CONFIG.write (detail::overrides (st),
+                                                path / "front-end-cal.conf",
+                                                config_fd,
+                                                config_path);
     if (et) {
         BOOST_LOG_SEV (impl_->lg_, error) << "Failed to write config file "
                                           << "for station "
@@ -305,20 +332,36 @@ calibrator::error_type calibrator::calibrate (const station &st,
     std::vector<std::string> args;
     args.push_back ("front-end-cal");
     args.push_back ("--config_file");
-    args.push_back ("front-end-cal.conf");
+    args.push_back (config_path);
     args.push_back ("-log_dir=./");
-    int fd = genesis::fork (handler,
-                            path,
-                            FRONT_END_CAL_EXECUTABLE,
-                            args);
+    int pid = -1;
+    int fd = genesis::spawn (handler,
+                             path,
+                             FRONT_END_CAL_EXECUTABLE,
+                             args,
+                             &pid,
+                             config_fd);
+    int e = errno;
+    if (config_fd >= 0) {
+        ::close (config_fd);
+    }
+    if (fd < 0) {
+        return to_error_condition (boost::system::error_code (
+           e, boost::system::system_category ()));
+    }
 
 
     // In the parent - read the output from front-end-cal
     BOOST_LOG_SEV (impl_->lg_, trace) << "front-end-cal started";
     et = read_if (fd);
+    if (et) {
+        BOOST_LOG_SEV (impl_->lg_, debug) << "Stopping front-end-cal";
+    }
+    detail::end_front_end_cal (pid, static_cast<bool> (et));
     if (!et) {
         BOOST_LOG_SEV (impl_->lg_, debug) << "Saving IF bias";
-        if (!detail::save_bias (path, impl_->IF_)) {
+        impl_->calibrated_ = std::time (0);
+        if (!detail::save_bias (path, impl_->IF_, impl_->calibrated_)) {
             BOOST_LOG_SEV (impl_->lg_, warning) << "Saving IF bias failed.";
         }
     }
@@ -328,4 +371,8 @@ calibrator::error_type calibrator::calibrate (const station &st,
 double calibrator::get_IF () const {
     return impl_->IF_;
 }
+
+std::time_t calibrator::get_calibrated () const {
+    return impl_->calibrated_;
+}
 }
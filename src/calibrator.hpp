@@ -33,10 +33,11 @@
 #include "error.hpp"
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <ctime>
 
 namespace genesis {
 
-class fork_handler;
+class spawn_handler;
 class station;
 
 /*!
@@ -49,9 +50,23 @@ public:
 
    calibrator ();
 
-   error_type calibrate (const station &st, fork_handler *handler);
+   /*!
+    * \brief Load the IF saved by the station's last calibration.
+    * \returns false if it has never been calibrated.
+    */
+   bool load (const station &st);
+
+   /*!
+    * \brief Run front-end-cal for the station and save the IF it finds.
+    * front-end-cal needs the station to itself; it has exited, or been
+    * killed, by the time this returns.
+    */
+   error_type calibrate (const station &st, spawn_handler *handler);
 
    double get_IF () const;
+
+   // When the IF was found, or 0 if that isn't known
+   std::time_t get_calibrated () const;
 private:
    error_type read_if (int fd);
 private:
@@ -0,0 +1,300 @@
+/*!
+ * \file child_log.cpp
+ * \brief Drains a child process's output into a log file.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "child_log.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include <boost/array.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/regex.hpp>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <unistd.h>
+
+DECLARE_int32 (child_log_size_kb);
+DECLARE_int32 (child_log_rate);
+
+namespace fs = boost::filesystem;
+
+namespace genesis {
+
+namespace detail {
+
+enum {
+    LOG_BUFFER_SIZE = 4096,
+    MAX_LINE_LENGTH = 1024 // longer lines are split
+};
+
+// GNSS-SDR status lines
+static const boost::regex TRACKING_STARTED ("started on channel (\\d+)");
+static const boost::regex TRACKING_CN0 (
+   "CH\\s*(\\d+).*CN0\\s*=\\s*([0-9.]+)");
+static const boost::regex LOSS_OF_LOCK (
+   "[Ll]oss of lock in channel (\\d+)");
+
+// Turn a status line into metrics, keeping track of which channels
+// are tracking a satellite. Gauges are per gnss-sdr, given by name.
+static void parse_status (const std::string &line,
+                          const std::string &name,
+                          std::set <int> &channels)
+{
+    size_t tracking = channels.size ();
+    boost::smatch m;
+    try {
+        if (boost::regex_search (line, m, TRACKING_CN0)) {
+            channels.insert (boost::lexical_cast<int> (m[1]));
+            record_metric ("gnss_sdr_cn0_db_hz." + name,
+                           boost::lexical_cast<double> (m[2]));
+        }
+        else if (boost::regex_search (line, m, TRACKING_STARTED)) {
+            channels.insert (boost::lexical_cast<int> (m[1]));
+            count_metric ("gnss_sdr_tracking_started");
+        }
+        else if (boost::regex_search (line, m, LOSS_OF_LOCK)) {
+            channels.erase (boost::lexical_cast<int> (m[1]));
+            count_metric ("gnss_sdr_lock_losses");
+        }
+    }
+    catch (const boost::bad_lexical_cast &) {
+        // Not a number after all
+    }
+
+    if (channels.size () != tracking) {
+        record_metric ("gnss_sdr_channels_tracking." + name,
+                       channels.size ());
+    }
+}
+
+} // namespace detail
+
+struct child_log::impl {
+   impl (boost::asio::io_service &service,
+         int fd,
+         const fs::path &file,
+         const std::string &name)
+      : stream_ (service),
+        file_ (file),
+        name_ (name),
+        fp_ (0),
+        size_ (0),
+        tokens_ (FLAGS_child_log_rate),
+        refilled_ (monotonic_ms ()),
+        dropped_ (0)
+      {
+         boost::system::error_code ec;
+         stream_.assign (fd, ec);
+         if (ec) {
+            BOOST_LOG_SEV (lg_, error)
+               << "Failed to read output for " << file_ << ": "
+               << ec.message ();
+            ::close (fd);
+         }
+      }
+
+   ~impl () {
+      close_file ();
+   }
+
+   void close_file () {
+      if (fp_) {
+         ::fclose (fp_);
+         fp_ = 0;
+      }
+   }
+
+   // Whether the rate limit allows another line
+   bool allow () {
+      if (FLAGS_child_log_rate <= 0) {
+         return true;
+      }
+      double now = monotonic_ms ();
+      tokens_ = std::min<double> (
+         FLAGS_child_log_rate,
+         tokens_ + (now - refilled_) / 1e3 * FLAGS_child_log_rate);
+      refilled_ = now;
+      if (tokens_ < 1) {
+         return false;
+      }
+      tokens_ -= 1;
+      return true;
+   }
+
+   // Open the file, moving it aside first if it's full
+   bool open (size_t length) {
+      long limit = FLAGS_child_log_size_kb * 1024L;
+      if (fp_ && (limit <= 0 || size_ + static_cast<long> (length) <= limit)) {
+         return true;
+      }
+
+      const char *mode = "a";
+      if (fp_) {
+         close_file ();
+         fs::path old = file_;
+         old += ".1";
+         boost::system::error_code ec;
+         fs::rename (file_, old, ec);
+         mode = "w";
+      }
+
+      fp_ = ::fopen (file_.c_str (), mode);
+      if (!fp_) {
+         return false;
+      }
+      ::fseek (fp_, 0, SEEK_END);
+      size_ = ::ftell (fp_);
+      return true;
+   }
+
+   // Note how many lines the rate limit dropped
+   void write_dropped () {
+      if (!dropped_) {
+         return;
+      }
+      std::string note = "[genesis] " +
+         boost::lexical_cast<std::string> (dropped_) + " lines dropped\n";
+      count_metric ("gnss_sdr_log_dropped", dropped_);
+      dropped_ = 0;
+      if (open (note.length ())) {
+         size_ += ::fwrite (note.data (), 1, note.length (), fp_);
+      }
+   }
+
+   void write (const std::string &line) {
+      if (!allow ()) {
+         dropped_++;
+         return;
+      }
+
+      write_dropped ();
+
+      if (open (line.length () + 1)) {
+         size_ += ::fwrite (line.data (), 1, line.length (), fp_);
+         size_ += ::fwrite ("\n", 1, 1, fp_);
+      }
+   }
+
+   void handle_line (const std::string &line) {
+      detail::parse_status (line, name_, channels_);
+      write (line);
+   }
+
+   boost::asio::posix::stream_descriptor stream_;
+   boost::array <char, detail::LOG_BUFFER_SIZE> buffer_;
+   std::string line_; // partial line
+   fs::path file_;
+   std::string name_;
+   FILE *fp_;
+   long size_;
+
+   // Rate limit
+   double tokens_;
+   double refilled_; // monotonic ms
+   unsigned long dropped_;
+
+   std::set <int> channels_;
+   logger lg_;
+};
+
+child_log::child_log (boost::asio::io_service &service,
+                      int fd,
+                      const fs::path &file,
+                      const std::string &name)
+   : impl_ (new impl (service, fd, file, name))
+{
+}
+
+child_log::~child_log () {
+}
+
+void child_log::start () {
+   start_read ();
+}
+
+void child_log::close () {
+   boost::system::error_code ec;
+   impl_->stream_.close (ec);
+}
+
+void child_log::reopen (const fs::path &file, const std::string &name) {
+   impl_->close_file ();
+   impl_->file_ = file;
+   impl_->name_ = name;
+   impl_->channels_.clear ();
+}
+
+void child_log::start_read () {
+   if (!impl_->stream_.is_open ()) {
+      return;
+   }
+   impl_->stream_.async_read_some (
+      boost::asio::buffer (impl_->buffer_),
+      boost::bind (&child_log::handle_read,
+                   shared_from_this (),
+                   boost::asio::placeholders::error,
+                   boost::asio::placeholders::bytes_transferred));
+}
+
+void child_log::handle_read (const boost::system::error_code &err,
+                             size_t bytes_transferred)
+{
+   if (err) {
+      // The child has exited, or we're closing
+      if (!impl_->line_.empty ()) {
+         impl_->handle_line (impl_->line_);
+         impl_->line_.clear ();
+      }
+      impl_->write_dropped ();
+      impl_->close_file ();
+      return;
+   }
+
+   for (size_t i = 0; i < bytes_transferred; i++) {
+      char c = impl_->buffer_[i];
+      if (c == '\n' || impl_->line_.length () >= detail::MAX_LINE_LENGTH) {
+         impl_->handle_line (impl_->line_);
+         impl_->line_.clear ();
+      }
+      if (c != '\n') {
+         impl_->line_ += c;
+      }
+   }
+   if (impl_->fp_) {
+      ::fflush (impl_->fp_);
+   }
+
+   start_read ();
+}
+
+}
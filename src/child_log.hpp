@@ -0,0 +1,84 @@
+/*!
+ * \file child_log.hpp
+ * \brief Drains a child process's output into a log file.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_CHILD_LOG_HPP
+#define GENESIS_CHILD_LOG_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+namespace genesis {
+
+/*!
+ * \brief Reads everything gnss-sdr writes to its output pipe, so it never
+ * blocks on a full pipe, and keeps it in a log file. The file is rotated
+ * when it reaches --child_log_size_kb and lines beyond --child_log_rate
+ * a second are dropped. Tracking status lines are turned into metrics;
+ * those that describe one gnss-sdr are suffixed with "." and its name.
+ */
+class child_log : public boost::enable_shared_from_this <child_log>,
+                  boost::noncopyable {
+public:
+   /*!
+    * \brief Take ownership of the pipe fd, logging to file under name.
+    */
+   child_log (boost::asio::io_service &service,
+              int fd,
+              const boost::filesystem::path &file,
+              const std::string &name);
+
+   ~child_log ();
+
+   // Start reading on the io_service.
+   void start ();
+
+   // Stop reading and close the pipe and the file.
+   void close ();
+
+   // Log to file under name from now on, as when a pooled gnss-sdr is
+   // given to a station. Call on the io_service.
+   void reopen (const boost::filesystem::path &file, const std::string &name);
+
+private:
+   void start_read ();
+   void handle_read (const boost::system::error_code &err,
+                     size_t bytes_transferred);
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_CHILD_LOG_HPP
@@ -33,7 +33,12 @@
 #include <boost/range.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
+#include <boost/array.hpp>
+#include <boost/foreach.hpp>
+#include <cmath>
+#include <map>
 #include <set>
+#include "metrics.hpp"
 #include "station.hpp"
 #include "concurrent_shared_map.h"
 
@@ -44,6 +49,15 @@ namespace detail {
 typedef client_controller::error_type error_type;
 using namespace boost::system::errc;
 
+enum {
+   BASE_TIMEOUT = 5,           // seconds without observables before a
+                               // base is no longer used
+   BASE_SWITCH_DISTANCE = 2000 // metres closer another base must be
+};
+
+// ...and it must also be this much closer, relative to the current one
+static const double BASE_SWITCH_RATIO = 0.8;
+
 bool validate_station (const station &st) {
    if (st.get_type () == station::STATION_TYPE_UNKNOWN) {
       return false;
@@ -74,13 +88,74 @@ private:
    const std::string &address_;
 };
 
+// A base station. Those that disconnect are kept, marked lost, so
+// rovers can still carry their ambiguities over to another base.
+struct base_info {
+   base_info () : updated_ (0), lost_ (false) {}
+
+   station station_;
+   client_controller::observables_ptr observables_;
+   double updated_; // monotonic ms
+   bool lost_;
+   client_controller::ref_time_ptr ref_time_;
+};
+
 } //namespace detail
 
 struct client_controller::impl {
-   station base_;
+   typedef boost::array <double, 3> position_type;
+   typedef std::map <std::string, detail::base_info> base_map;
+
+   // Distance from rr to a base, or infinity if either isn't known
+   double distance (const double *rr, const std::string &address) const {
+      std::map <std::string, position_type>::const_iterator it =
+         positions_.find (address);
+      if (it == positions_.end () || (!rr[0] && !rr[1] && !rr[2])) {
+         return HUGE_VAL;
+      }
+      double d = 0;
+      for (int i = 0; i < 3; i++) {
+         d += (rr[i] - it->second[i]) * (rr[i] - it->second[i]);
+      }
+      return std::sqrt (d);
+   }
+
+   bool healthy (const detail::base_info &base, double now) const {
+      return !base.lost_ && base.observables_ &&
+         !base.observables_->empty () &&
+         now - base.updated_ <= detail::BASE_TIMEOUT * 1e3;
+   }
+
+   bool connected (const std::string &address) const {
+      base_map::const_iterator it = bases_.find (address);
+      return it != bases_.end () && !it->second.lost_;
+   }
+
+   // Nearest healthy base, either a standby or not
+   std::string nearest (const double *rr, double now, bool standby,
+                        double &distance) const
+   {
+      std::string best;
+      distance = HUGE_VAL;
+      BOOST_FOREACH (const base_map::value_type &b, bases_) {
+         if ((standby_.count (b.first) != 0) != standby ||
+             !healthy (b.second, now))
+         {
+            continue;
+         }
+         double d = this->distance (rr, b.first);
+         if (best.empty () || d < distance) {
+            best = b.first;
+            distance = d;
+         }
+      }
+      return best;
+   }
+
+   base_map bases_;
+   std::map <std::string, position_type> positions_;
+   std::set <std::string> standby_;
    std::set<station> rovers_;
-   client_controller::observable_vector base_observables_;
-   client_controller::ref_time_ptr base_ref_time_;
 
    mutable boost::recursive_mutex mutex_;
 
@@ -108,8 +183,8 @@ client_controller::error_type client_controller::add_station (
 
    impl::lock lock (impl_->mutex_);
    if (st.get_type () == station::STATION_TYPE_ROVER) {
-      if (st.get_address () == impl_->base_.get_address ()) {
-         // already the base station
+      if (impl_->connected (st.get_address ())) {
+         // already a base station
          return make_error_condition (station_is_base);
       }
       if (!impl_->rovers_.insert (st).second) {
@@ -118,20 +193,18 @@ client_controller::error_type client_controller::add_station (
       }
    }
    else {
-      if (has_base ()) {
-          if (impl_->base_ == st) {
-              return make_error_condition (station_is_base);
-          }
-         return make_error_condition (base_already_set);
+      if (impl_->connected (st.get_address ())) {
+         return make_error_condition (station_is_base);
       }
       if (impl_->rovers_.find (st) != boost::end (impl_->rovers_)) {
          // already a rover
          return make_error_condition (station_is_rover);
       }
 
-      impl_->base_ = st;
-      impl_->base_observables_.clear ();
-      impl_->base_ref_time_.reset ();
+      // Replaces any lost base at this address
+      detail::base_info base;
+      base.station_ = st;
+      impl_->bases_[st.get_address ()] = base;
    }
 
    return error_type ();
@@ -140,8 +213,10 @@ client_controller::error_type client_controller::add_station (
 client_controller::error_type
 client_controller::remove_station (const station &st) {
    impl::lock lock (impl_->mutex_);
-   if (impl_->base_.get_address () == st.get_address ()) {
-      return reset_base ();
+   if (impl_->connected (st.get_address ())) {
+      // Rovers move to another base on their next epoch
+      impl_->bases_[st.get_address ()].lost_ = true;
+      return error_type ();
    }
 
    if (!impl_->rovers_.erase (st)) {
@@ -151,39 +226,145 @@ client_controller::remove_station (const station &st) {
    return error_type ();
 }
 
+bool client_controller::has_station (const station &st) const {
+   impl::lock lock (impl_->mutex_);
+   return impl_->connected (st.get_address ()) ||
+      impl_->rovers_.count (st) != 0;
+}
+
 bool client_controller::has_base () const {
    impl::lock lock (impl_->mutex_);
-   return detail::validate_station (impl_->base_);
+   BOOST_FOREACH (const impl::base_map::value_type &b, impl_->bases_) {
+      if (!b.second.lost_) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void client_controller::set_standby_base (const std::string &address) {
+   impl::lock lock (impl_->mutex_);
+   impl_->standby_.insert (address);
 }
 
-client_controller::error_type client_controller::reset_base () {
+void client_controller::set_base_position (const std::string &address,
+                                           const double *rr)
+{
    impl::lock lock (impl_->mutex_);
-   impl_->base_ = station ();
-   impl_->base_observables_.clear ();
-   impl_->base_ref_time_.reset ();
-   return error_type ();
+   impl::position_type &pos = impl_->positions_[address];
+   for (int i = 0; i < 3; i++) {
+      pos[i] = rr[i];
+   }
+}
+
+bool client_controller::base_position (const std::string &address,
+                                       double *rr) const
+{
+   impl::lock lock (impl_->mutex_);
+   std::map <std::string, impl::position_type>::const_iterator it =
+      impl_->positions_.find (address);
+   if (it == impl_->positions_.end ()) {
+      return false;
+   }
+   for (int i = 0; i < 3; i++) {
+      rr[i] = it->second[i];
+   }
+   return true;
+}
+
+std::string client_controller::select_base (const double *rr,
+                                            const std::string &current) const
+{
+   impl::lock lock (impl_->mutex_);
+   double now = monotonic_ms ();
+
+   // Nearest usable base; those without a known position come last.
+   // Standbys are only used while no other base is.
+   double best_distance;
+   bool standby = false;
+   std::string best = impl_->nearest (rr, now, false, best_distance);
+   if (best.empty ()) {
+      best = impl_->nearest (rr, now, true, best_distance);
+      standby = true;
+   }
+
+   // Only switch when it's worth disturbing the ambiguities for
+   impl::base_map::const_iterator it = impl_->bases_.find (current);
+   if (!best.empty () && best != current && it != impl_->bases_.end () &&
+       impl_->healthy (it->second, now) &&
+       (impl_->standby_.count (current) != 0) == standby)
+   {
+      double d = impl_->distance (rr, current);
+      if (!(best_distance < d * detail::BASE_SWITCH_RATIO &&
+            d - best_distance > detail::BASE_SWITCH_DISTANCE))
+      {
+         return current;
+      }
+   }
+   return best;
 }
 
 client_controller::ref_time_ptr
-client_controller::base_ref_time () const {
+client_controller::base_ref_time (const std::string &address) const {
    impl::lock lock (impl_->mutex_);
-   if (!impl_->base_ref_time_) {
-       impl_->base_ref_time_.reset (
+   impl::base_map::iterator it = impl_->bases_.find (address);
+   if (it == impl_->bases_.end ()) {
+      return ref_time_ptr ();
+   }
+   if (!it->second.ref_time_) {
+       it->second.ref_time_.reset (
            new concurrent_shared_map<Gps_Ref_Time> (
-               "GNSS-SDR.base.gps_ref_time"));
+               shared_memory_prefix (it->second.station_) +
+               ".gps_ref_time"));
+   }
+   return it->second.ref_time_;
+}
+
+bool client_controller::base_usable (const std::string &address) const {
+   impl::lock lock (impl_->mutex_);
+   impl::base_map::const_iterator it = impl_->bases_.find (address);
+   return it != impl_->bases_.end () &&
+      impl_->healthy (it->second, monotonic_ms ());
+}
+
+void client_controller::set_base_ref_time (const std::string &address,
+                                           ref_time_ptr t)
+{
+   impl::lock lock (impl_->mutex_);
+   impl::base_map::iterator it = impl_->bases_.find (address);
+   if (it != impl_->bases_.end () && !it->second.lost_) {
+      it->second.ref_time_ = t;
    }
-   return impl_->base_ref_time_;
 }
 
-client_controller::observable_vector
-client_controller::base_observables () const {
+double client_controller::base_updated (const std::string &address) const {
+   impl::lock lock (impl_->mutex_);
+   impl::base_map::const_iterator it = impl_->bases_.find (address);
+   return it == impl_->bases_.end () ? 0 : it->second.updated_;
+}
+
+client_controller::observables_ptr
+client_controller::base_observables (const std::string &address) const {
    impl::lock lock (impl_->mutex_);
-   return impl_->base_observables_;
+   impl::base_map::const_iterator it = impl_->bases_.find (address);
+   if (it == impl_->bases_.end ()) {
+      return observables_ptr ();
+   }
+   return it->second.observables_;
 }
 
-void client_controller::set_base_observables (observable_vector v) {
+void client_controller::set_base_observables (const std::string &address,
+                                              observable_vector v)
+{
+   boost::shared_ptr <observable_vector> observables (new observable_vector);
+   observables->swap (v);
+
    impl::lock lock (impl_->mutex_);
-   impl_->base_observables_ = v;
+   impl::base_map::iterator it = impl_->bases_.find (address);
+   if (it != impl_->bases_.end () && !it->second.lost_) {
+      it->second.observables_ = observables;
+      it->second.updated_ = monotonic_ms ();
+   }
 }
 
 }
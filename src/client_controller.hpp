@@ -37,6 +37,7 @@
 #include "concurrent_dictionary.h"
 #include "gnss_sdr_data.h"
 #include "gps_ref_time.h"
+#include <string>
 #include <vector>
 
 namespace genesis {
@@ -45,7 +46,8 @@ class station;
 
 /*!
  * \brief This class keeps track of which clients are connected
- *  and what kind of client they are.
+ *  and what kind of client they are. There may be several base
+ *  stations; each rover differences against the nearest one.
  */
 class client_controller {
 public:
@@ -53,6 +55,7 @@ public:
    typedef concurrent_dictionary <Gps_Ref_Time> ref_time_map;
    typedef boost::shared_ptr<ref_time_map> ref_time_ptr;
    typedef std::vector<gnss_sdr_data> observable_vector;
+   typedef boost::shared_ptr<const observable_vector> observables_ptr;
 private:
    BOOST_MOVABLE_BUT_NOT_COPYABLE (client_controller)
 
@@ -64,15 +67,62 @@ public:
 
    error_type remove_station (const station &st);
 
+   bool has_station (const station &st) const;
+
    bool has_base () const;
 
-   error_type reset_base ();
+   /*!
+    * \brief Set the surveyed position of a base station (ECEF, m).
+    * The base needn't be connected yet.
+    */
+   void set_base_position (const std::string &address, const double *rr);
+
+   /*!
+    * \brief Get the surveyed position of a base station.
+    * \returns false if it isn't known.
+    */
+   bool base_position (const std::string &address, double *rr) const;
+
+   /*!
+    * \brief Keep a base station as a hot standby. Its observables are
+    * kept up to date, but rovers only use it while no other base is
+    * usable, and move back as soon as one is.
+    */
+   void set_standby_base (const std::string &address);
+
+   /*!
+    * \brief Choose the base station for a rover at rr (ECEF, m, or
+    * zero if not known yet) which is using the base current. The
+    * rover stays with its current base unless that base stops sending
+    * observables or another is much closer.
+    * \returns the address of the base, or empty if none is usable.
+    */
+   std::string select_base (const double *rr,
+                            const std::string &current) const;
+
+   ref_time_ptr base_ref_time (const std::string &address) const;
+
+   /*!
+    * \brief Give the reference time a base's GNSS-SDR publishes.
+    * Otherwise it's opened under the base's own shared memory prefix.
+    */
+   void set_base_ref_time (const std::string &address, ref_time_ptr t);
+
+   /*!
+    * \brief Whether rovers can use a base: it's connected and has
+    * recently sent observables.
+    */
+   bool base_usable (const std::string &address) const;
 
-   ref_time_ptr base_ref_time () const;
+   /*!
+    * \brief When a base last sent observables (monotonic_ms), or 0.
+    */
+   double base_updated (const std::string &address) const;
 
-   observable_vector base_observables () const;
+   observables_ptr base_observables (const std::string &address) const;
 
-   void set_base_observables (observable_vector v);
+   void set_base_observables (const std::string &address,
+                              observable_vector v);
 
 private:
    struct impl;
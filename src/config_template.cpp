@@ -0,0 +1,169 @@
+/*!
+ * \file config_template.cpp
+ * \brief Configuration templates for gnss-sdr and front-end-cal.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "config_template.hpp"
+#include "spawn.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/foreach.hpp>
+#include <cerrno>
+#include <fstream>
+#include <set>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// memfd_create is declared from glibc 2.27
+#if defined (__GLIBC__) && __GLIBC_PREREQ (2, 27)
+#define GENESIS_MEMFD 1
+#endif
+
+namespace genesis {
+
+namespace fs = boost::filesystem;
+
+namespace detail {
+
+// The setting a line makes, in lower case as INI keys are matched
+static std::string setting_key (const std::string &text) {
+    std::string s = boost::algorithm::trim_copy (text);
+    if (s.empty () || s[0] == ';' || s[0] == '#' || s[0] == '[') {
+        return std::string ();
+    }
+    std::string::size_type eq = s.find ('=');
+    if (eq == std::string::npos) {
+        return std::string ();
+    }
+    return boost::algorithm::to_lower_copy (
+       boost::algorithm::trim_copy (s.substr (0, eq)));
+}
+
+#ifdef GENESIS_MEMFD
+// Put the config in an anonymous file, or return -1
+static int write_memory (const std::string &config) {
+    int fd = ::memfd_create ("config", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    const char *p = config.data ();
+    size_t left = config.size ();
+    while (left) {
+        ssize_t n = ::write (fd, p, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ::close (fd);
+            return -1;
+        }
+        p += n;
+        left -= n;
+    }
+    return fd;
+}
+#endif
+
+} // namespace detail
+
+bool config_template::load (const fs::path &file) {
+    std::ifstream ifs (file.c_str ());
+    if (!ifs) {
+        return false;
+    }
+
+    lines_.clear ();
+    line l;
+    while (std::getline (ifs, l.text)) {
+        l.key = detail::setting_key (l.text);
+        lines_.push_back (l);
+    }
+    return !ifs.bad ();
+}
+
+std::string config_template::render (const config_overrides &overrides) const {
+    typedef config_overrides::value_map::value_type value_type;
+
+    std::map <std::string, const value_type *> by_key;
+    BOOST_FOREACH (const value_type &v, overrides.values ()) {
+        by_key[boost::algorithm::to_lower_copy (v.first)] = &v;
+    }
+
+    std::string out;
+    std::set <std::string> done;
+    BOOST_FOREACH (const line &l, lines_) {
+        std::map <std::string, const value_type *>::const_iterator it =
+           by_key.find (l.key);
+        if (l.key.empty () || it == by_key.end ()) {
+            out += l.text;
+        }
+        else if (done.insert (l.key).second) {
+            out += it->second->first + "=" + it->second->second;
+        }
+        else {
+            // Set once; a later line would add to it
+            continue;
+        }
+        out += '\n';
+    }
+
+    BOOST_FOREACH (const value_type &v, overrides.values ()) {
+        if (!done.count (boost::algorithm::to_lower_copy (v.first))) {
+            out += v.first + "=" + v.second + '\n';
+        }
+    }
+    return out;
+}
+
+config_template::error_type config_template::write (
+   const config_overrides &overrides,
+   const fs::path &file,
+   int &fd,
+   std::string &path) const
+{
+    std::string config = render (overrides);
+
+#ifdef GENESIS_MEMFD
+    fd = detail::write_memory (config);
+    if (fd >= 0) {
+        path = spawn_passed_path ();
+        return error_type ();
+    }
+#endif
+
+    // Older kernels; use the file
+    fd = -1;
+    std::ofstream ofs (file.c_str (), std::ios::binary);
+    if (!ofs) {
+        return make_error_condition (file_not_found);
+    }
+    ofs << config;
+    path = file.filename ().string ();
+    return error_type ();
+}
+
+}
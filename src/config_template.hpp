@@ -0,0 +1,119 @@
+/*!
+ * \file config_template.hpp
+ * \brief Configuration templates for gnss-sdr and front-end-cal.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_CONFIG_TEMPLATE_HPP
+#define GENESIS_CONFIG_TEMPLATE_HPP
+
+#include "error.hpp"
+#include <boost/filesystem/path.hpp>
+#include <boost/lexical_cast.hpp>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace genesis {
+
+/*!
+ * \brief Settings that replace or add to a template's, for one child.
+ */
+class config_overrides {
+public:
+   typedef std::map <std::string, std::string> value_map;
+
+   template <typename T>
+   void set (const std::string &key, const T &value) {
+      values_[key] = boost::lexical_cast <std::string> (value);
+   }
+
+   void set (const std::string &key, bool value) {
+      values_[key] = value ? "true" : "false";
+   }
+
+   void set (const std::string &key, double value) {
+      // Without lexical_cast's round-trip digits
+      std::ostringstream os;
+      os.precision (15);
+      os << value;
+      values_[key] = os.str ();
+   }
+
+   const value_map &values () const {
+      return values_;
+   }
+
+private:
+   value_map values_;
+};
+
+/*!
+ * \brief An INI configuration file, read once and rendered with
+ * overrides for each child. Overridden settings are replaced where they
+ * are in the template and the rest are added at the end.
+ */
+class config_template {
+public:
+   typedef boost::system::error_condition error_type;
+
+   /*!
+    * \brief Read the template.
+    * \returns false if the file couldn't be read.
+    */
+   bool load (const boost::filesystem::path &file);
+
+   /*!
+    * \brief The template with the overrides applied.
+    */
+   std::string render (const config_overrides &overrides) const;
+
+   /*!
+    * \brief Give the rendered config to a child. Where the kernel allows,
+    * it's kept in memory: fd is set to a descriptor for spawn to pass on
+    * and path to where the child finds it. Otherwise it's written to
+    * file, in the child's working directory, fd is -1 and path is the
+    * file's name.
+    */
+   error_type write (const config_overrides &overrides,
+                     const boost::filesystem::path &file,
+                     int &fd,
+                     std::string &path) const;
+
+private:
+   struct line {
+      std::string key;  // lower case, or empty if it's not a setting
+      std::string text;
+   };
+
+   std::vector <line> lines_;
+};
+
+}
+
+#endif // GENESIS_CONFIG_TEMPLATE_HPP
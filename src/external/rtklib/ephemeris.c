@@ -52,6 +52,7 @@
 *           2014/12/07 1.10 modify MAXDTOE for qzss,gal and bds
 *                           test max number of iteration for Kepler
 *-----------------------------------------------------------------------------*/
+#include <stddef.h>
 #include "rtklib.h"
 
 static const char rcsid[]="$Id:$";
@@ -59,6 +60,7 @@ static const char rcsid[]="$Id:$";
 /* constants and macros ------------------------------------------------------*/
 
 #define SQR(x)   ((x)*(x))
+#define MAX(x,y) ((x)>(y)?(x):(y))
 
 #define RE_GLO   6378136.0        /* radius of earth (m)            ref [2] */
 #define MU_GPS   3.9860050E14     /* gravitational constant         ref [1] */
@@ -86,6 +88,28 @@ static const char rcsid[]="$Id:$";
 #define STD_BRDCCLK 30.0          /* error of broadcast clock (m) */
 
 #define MAX_ITER_KEPLER 30        /* max number of iteration of Kelpler */
+#define NBATCH   32               /* number of orbits propagated together */
+#define RND_MAGIC 6755399441055744.0 /* 1.5*2^52: x+RND_MAGIC-RND_MAGIC rounds */
+#define INVPIO2  6.36619772367581382433E-01 /* 2/pi */
+#define PIO2_1   1.57079632673412561417E+00 /* first 33 bits of pi/2 */
+#define PIO2_2   6.07710050630396597660E-11 /* second 33 bits of pi/2 */
+#define PIO2_2T  2.02226624879595063154E-21 /* pi/2-PIO2_1-PIO2_2 */
+#define NSATCACHE 4               /* number of cached states per satellite */
+
+typedef struct {                  /* cached satellite state type */
+    gtime_t time;                 /* quantized transmission time (gpst) */
+    gtime_t toe;                  /* toe of ephemeris */
+    int iode;                     /* iode of ephemeris (-1:empty) */
+    double rs[6],dts[2],var;      /* satellite state (see satposs()) */
+} satstate_t;
+
+/* global variables ----------------------------------------------------------*/
+static satstate_t satcache[MAXSAT][NSATCACHE]; /* satellite state cache */
+static int satcache_next[MAXSAT];  /* next cache entry to replace */
+static double satcache_tol=0.0;    /* cache time tolerance (s) (0:off) */
+static unsigned int satcache_nhit=0,satcache_nmiss=0; /* cache statistics */
+static lock_t satcache_lock;       /* lock for the cache */
+static int satcache_init=0;        /* cache lock initialized */
 
 /* variance by ura ephemeris (ref [1] 20.3.3.3.1.1) --------------------------*/
 static double var_uraeph(int ura)
@@ -248,6 +272,192 @@ extern void eph2pos(gtime_t time, const eph_t *eph, double *rs, double *dts,
     /* position and clock error variance */
     *var=var_uraeph(eph->sva);
 }
+/* sines and cosines of angles ------------------------------------------------
+* compute sin() and cos() of n angles in one loop without calls or branches,
+* so that it is vectorized. the angles are reduced to [-pi/4,pi/4] by the
+* nearest multiple of pi/2 and the kernels are the minimax polynomials of
+* fdlibm (__kernel_sin,__kernel_cos)
+* args   : int    n         I   number of angles
+*          double *x        I   angles (rad) (|x|<2^20)
+*          double *s,*c     O   sines and cosines of the angles
+* return : none
+* notes  : rounding by adding and subtracting RND_MAGIC needs the default
+*          rounding mode and must not be reassociated (no -ffast-math)
+*-----------------------------------------------------------------------------*/
+static void sincosn(int n, const double *x, double *s, double *c)
+{
+    double q,h,odd,neg,r,z,sr,cr,ss,cc;
+    int i;
+    
+    for (i=0;i<n;i++) {
+        q=(x[i]*INVPIO2+RND_MAGIC)-RND_MAGIC; /* nearest multiple of pi/2 */
+        r=x[i]-q*PIO2_1;
+        r-=q*PIO2_2;
+        r-=q*PIO2_2T;
+        z=r*r;
+        sr=r+r*z*(-1.66666666666666324348E-01+z*( 8.33333333332248946124E-03+
+           z*(-1.98412698298579493134E-04+z*( 2.75573137070700676789E-06+
+           z*(-2.50507602534068634195E-08+z*  1.58969099521155010221E-10)))));
+        cr=1.0-0.5*z+z*z*( 4.16666666666666019037E-02+z*(-1.38888888888741095749E-03+
+           z*( 2.48015872894767294178E-05+z*(-2.75573143513906633035E-07+
+           z*( 2.08757232129817482790E-09+z* -1.13596475577881948265E-11)))));
+        
+        /* quadrant: odd=q mod 2, neg=floor(q/2) mod 2 */
+        h=(q*0.5-0.25+RND_MAGIC)-RND_MAGIC;
+        odd=q-2.0*h;
+        neg=h-2.0*((h*0.5-0.25+RND_MAGIC)-RND_MAGIC);
+        ss=odd!=0.0?cr:sr;
+        cc=odd!=0.0?-sr:cr;
+        s[i]=neg!=0.0?-ss:ss;
+        c[i]=neg!=0.0?-cc:cc;
+    }
+}
+/* broadcast ephemeris to satellite positions and velocities -----------------
+* compute satellite positions, velocities and clocks of a batch of satellites
+* with broadcast ephemeris. the parameters of up to NBATCH orbits are gathered
+* into a structure of arrays and propagated together in loops without calls
+* or branches (see sincosn()), which compilers vectorize when optimizing
+* (gcc -O3). velocities and clock drifts are analytic
+* args   : int    n         I   number of satellites
+*          gtime_t *time    I   time (gpst) of each satellite
+*          eph_t  **eph     I   broadcast ephemeris of each satellite
+*          double *rs       O   satellite positions and velocities (ecef)
+*                               {x,y,z,vx,vy,vz} (m|m/s) for each satellite
+*          double *dts      O   satellite clock {bias,drift} (s|s/s)
+*          double *var      O   satellite position and clock error variance (m^2)
+* return : none
+* notes  : see eph2pos(). beidou geo satellites are computed by eph2pos() with
+*          differential velocity
+*-----------------------------------------------------------------------------*/
+extern void eph2posn(int n, const gtime_t *time, const eph_t **eph, double *rs,
+                     double *dts, double *var)
+{
+    const eph_t *p;
+    double A[NBATCH],e[NBATCH],sq[NBATCH],M[NBATCH],Md[NBATCH],E[NBATCH];
+    double Ek[NBATCH],tk[NBATCH],tc[NBATCH],i0[NBATCH],idot[NBATCH];
+    double omg[NBATCH],O0[NBATCH],Od[NBATCH],cus[NBATCH],cuc[NBATCH];
+    double crs[NBATCH],crc[NBATCH],cis[NBATCH],cic[NBATCH],rel[NBATCH];
+    double f0[NBATCH],f1[NBATCH],f2[NBATCH],sE[NBATCH],cE[NBATCH],sw[NBATCH];
+    double cw[NBATCH],in[NBATCH],ind[NBATCH],O[NBATCH],si[NBATCH],ci[NBATCH];
+    double sO[NBATCH],cO[NBATCH],xo[NBATCH],yo[NBATCH],xd[NBATCH],yd[NBATCH];
+    double x[6][NBATCH],c[2][NBATCH],rst[3],dtst[1],tt=1E-3,mu,omge,d;
+    double den,Ed,snu,cnu,sph,cph,s2,c2,du,sdu,cdu,su,cu,phd,ud,r,rd;
+    int i,j,k,m,it,prn,idx[NBATCH];
+    
+    trace(4,"eph2posn: n=%d\n",n);
+    
+    for (i=0;i<n;i+=m) {
+        
+        /* gather ephemeris parameters */
+        for (m=0,k=i;k<n&&m<NBATCH;k++) {
+            p=eph[k];
+            if (p->A<=0.0) {
+                for (j=0;j<6;j++) rs[j+k*6]=0.0;
+                dts[k*2]=dts[1+k*2]=var[k]=0.0;
+                continue;
+            }
+            switch (satsys(p->sat,&prn)) {
+                case SYS_GAL: mu=MU_GAL; omge=OMGE_GAL; break;
+                case SYS_CMP: mu=MU_CMP; omge=OMGE_CMP; break;
+                default:      mu=MU_GPS; omge=OMGE;     break;
+            }
+            if (satsys(p->sat,NULL)==SYS_CMP&&prn<=5) {
+                eph2pos(time[k],p,rs+k*6,dts+k*2,var+k);
+                eph2pos(timeadd(time[k],tt),p,rst,dtst,var+k);
+                for (j=0;j<3;j++) rs[j+3+k*6]=(rst[j]-rs[j+k*6])/tt;
+                dts[1+k*2]=(dtst[0]-dts[k*2])/tt;
+                continue;
+            }
+            tk[m]=timediff(time[k],p->toe);
+            tc[m]=timediff(time[k],p->toc);
+            A[m]=p->A; e[m]=p->e; i0[m]=p->i0; idot[m]=p->idot; omg[m]=p->omg;
+            cus[m]=p->cus; cuc[m]=p->cuc; crs[m]=p->crs; crc[m]=p->crc;
+            cis[m]=p->cis; cic[m]=p->cic;
+            f0[m]=p->f0; f1[m]=p->f1; f2[m]=p->f2;
+            sq[m]=sqrt(1.0-p->e*p->e);
+            Md[m]=sqrt(mu/(p->A*p->A*p->A))+p->deln;
+            M [m]=p->M0+Md[m]*tk[m];
+            O0[m]=p->OMG0-omge*p->toes;
+            Od[m]=p->OMGd-omge;
+            rel[m]=-2.0*sqrt(mu*p->A)*p->e/SQR(CLIGHT);
+            var[k]=var_uraeph(p->sva);
+            idx[m++]=k;
+        }
+        if (m<=0) continue;
+        
+        /* kepler equation by newton's method */
+        for (j=0;j<m;j++) {E[j]=M[j]; Ek[j]=0.0;}
+        for (it=0;it<MAX_ITER_KEPLER;it++) {
+            sincosn(m,E,sE,cE);
+            for (j=0;j<m;j++) {
+                Ek[j]=E[j];
+                E[j]-=(E[j]-e[j]*sE[j]-M[j])/(1.0-e[j]*cE[j]);
+            }
+            for (j=0,d=0.0;j<m;j++) d=MAX(d,fabs(E[j]-Ek[j]));
+            if (d<=RTOL_KEPLER) break;
+        }
+        sincosn(m,E,sE,cE);
+        sincosn(m,omg,sw,cw);
+        
+        /* positions and velocities in the orbital plane, and clocks. the
+           true anomaly is only needed by its sine and cosine, and the
+           argument of latitude correction is small enough for a series */
+        for (j=0;j<m;j++) {
+            den=1.0-e[j]*cE[j];
+            Ed=Md[j]/den;
+            snu=sq[j]*sE[j]/den;
+            cnu=(cE[j]-e[j])/den;
+            sph=snu*cw[j]+cnu*sw[j];
+            cph=cnu*cw[j]-snu*sw[j];
+            s2=2.0*sph*cph;
+            c2=(cph-sph)*(cph+sph);
+            du=cus[j]*s2+cuc[j]*c2;
+            sdu=du*(1.0-du*du/6.0);
+            cdu=1.0-0.5*du*du;
+            su=sph*cdu+cph*sdu;
+            cu=cph*cdu-sph*sdu;
+            phd=sq[j]*Ed/den;
+            ud =phd*(1.0+2.0*(cus[j]*c2-cuc[j]*s2));
+            r  =A[j]*den+crs[j]*s2+crc[j]*c2;
+            rd =A[j]*e[j]*sE[j]*Ed+2.0*phd*(crs[j]*c2-crc[j]*s2);
+            in [j]=i0[j]+idot[j]*tk[j]+cis[j]*s2+cic[j]*c2;
+            ind[j]=idot[j]+2.0*phd*(cis[j]*c2-cic[j]*s2);
+            O  [j]=O0[j]+Od[j]*tk[j];
+            xo[j]=r*cu; yo[j]=r*su;
+            xd[j]=rd*cu-yo[j]*ud; yd[j]=rd*su+xo[j]*ud;
+            
+            /* relativity correction */
+            c[0][j]=f0[j]+f1[j]*tc[j]+f2[j]*tc[j]*tc[j]+rel[j]*sE[j];
+            c[1][j]=f1[j]+2.0*f2[j]*tc[j]+rel[j]*cE[j]*Ed;
+        }
+        sincosn(m,in,si,ci);
+        sincosn(m,O,sO,cO);
+        
+        /* rotate into ecef */
+        for (j=0;j<m;j++) {
+            x[0][j]=xo[j]*cO[j]-yo[j]*ci[j]*sO[j];
+            x[1][j]=xo[j]*sO[j]+yo[j]*ci[j]*cO[j];
+            x[2][j]=yo[j]*si[j];
+            x[3][j]=xd[j]*cO[j]-yd[j]*ci[j]*sO[j]+yo[j]*si[j]*sO[j]*ind[j]-
+                    x[1][j]*Od[j];
+            x[4][j]=xd[j]*sO[j]+yd[j]*ci[j]*cO[j]-yo[j]*si[j]*cO[j]*ind[j]+
+                    x[0][j]*Od[j];
+            x[5][j]=yd[j]*si[j]+yo[j]*ci[j]*ind[j];
+        }
+        /* scatter results */
+        for (j=0;j<m;j++) {
+            k=idx[j];
+            if (fabs(E[j]-Ek[j])>RTOL_KEPLER) {
+                trace(2,"kepler iteration overflow sat=%2d\n",eph[k]->sat);
+                for (it=0;it<6;it++) rs[it+k*6]=0.0;
+                dts[k*2]=dts[1+k*2]=0.0;
+                continue;
+            }
+            for (it=0;it<6;it++) rs[it+k*6]=x[it][j];
+            dts[k*2]=c[0][j]; dts[1+k*2]=c[1][j];
+        }
+    }
+}
 /* glonass orbit differential equations --------------------------------------*/
 static void deq(const double *x, double *xdot, const double *acc)
 {
@@ -381,11 +591,132 @@ extern void seph2pos(gtime_t time, const seph_t *seph, double *rs, double *dts,
     
     *var=var_uraeph(seph->sva);
 }
+/* compare ephemeris index entries ------------------------------------------*/
+static int cmpent(const void *p1, const void *p2)
+{
+    const ephent_t *q1=(const ephent_t *)p1,*q2=(const ephent_t *)p2;
+    double tt;
+    if (q1->sat!=q2->sat) return q1->sat-q2->sat;
+    if ((tt=timediff(q1->toe,q2->toe))!=0.0) return tt<0.0?-1:1;
+    return q1->i-q2->i;
+}
+/* build ephemeris index -----------------------------------------------------*/
+static int buildidx(ephidx_t *idx, const char *data, int n, size_t size,
+                    size_t otoe)
+{
+    ephent_t *ent;
+    int i,j,sat;
+    
+    trace(3,"buildidx: n=%d\n",n);
+    
+    if (n>idx->nmax) {
+        if (!(ent=(ephent_t *)realloc(idx->ent,sizeof(ephent_t)*n))) {
+            trace(1,"buildidx malloc error n=%d\n",n);
+            free(idx->ent); idx->ent=NULL; idx->n=idx->nmax=0;
+            idx->src=NULL; idx->nsrc=0;
+            return 0;
+        }
+        idx->ent=ent; idx->nmax=n;
+    }
+    /* sat is the first member of all ephemeris types */
+    for (i=j=0;i<n;i++) {
+        sat=*(const int *)(data+size*i);
+        if (sat<=0||MAXSAT<sat) continue;
+        idx->ent[j].toe=*(const gtime_t *)(data+size*i+otoe);
+        idx->ent[j].sat=sat;
+        idx->ent[j++].i=i;
+    }
+    if (j>1) qsort(idx->ent,j,sizeof(ephent_t),cmpent);
+    idx->n=j;
+    
+    for (i=0,j=0;i<=MAXSAT;i++) {
+        while (j<idx->n&&idx->ent[j].sat<=i) j++;
+        idx->off[i]=j;
+        if (i>0) idx->last[i-1]=idx->off[i-1];
+    }
+    idx->src=data; idx->nsrc=n;
+    return 1;
+}
+/* select ephemeris by index ---------------------------------------------------
+* select ephemeris of a satellite with toe closest to time, or with iode
+* (iode>=0), as a linear search over the ephemeris would. the index is built
+* on first use and rebuilt when the number of ephemeris changes, so the
+* selection is O(1) for a slowly advancing time
+* args   : gtime_t time     I   time (GPST)
+*          int    sat       I   satellite number
+*          int    iode      I   issue of data (-1:closest toe)
+*          double tmax      I   max time difference to toe (s)
+*          nav_t  *nav      I   navigation data (index updated)
+*          int    type      I   ephemeris type (0:eph,1:geph,2:seph)
+* return : index of ephemeris (-1:no ephemeris)
+*-----------------------------------------------------------------------------*/
+static int selidx(gtime_t time, int sat, int iode, double tmax,
+                  const nav_t *nav, int type)
+{
+    ephidx_t *idx=(ephidx_t *)nav->idx+type; /* cache in const nav */
+    const ephent_t *ent;
+    const char *data;
+    size_t size,otoe,oiode;
+    double t,tl,tr;
+    int i,j,k,a,b,q,l,r,n;
+    
+    switch (type) {
+        case 0: data=(const char *)nav->eph; n=nav->n; size=sizeof(eph_t);
+                otoe=offsetof(eph_t,toe); oiode=offsetof(eph_t,iode); break;
+        case 1: data=(const char *)nav->geph; n=nav->ng; size=sizeof(geph_t);
+                otoe=offsetof(geph_t,toe); oiode=offsetof(geph_t,iode); break;
+        default: data=(const char *)nav->seph; n=nav->ns; size=sizeof(seph_t);
+                otoe=offsetof(seph_t,t0); oiode=0; break;
+    }
+    if (sat<=0||MAXSAT<sat||n<=0) return -1;
+    
+    for (k=0;k<2;k++) {
+        if ((idx->src!=data||idx->nsrc!=n)&&
+            !buildidx(idx,data,n,size,otoe)) return -1;
+        
+        ent=idx->ent;
+        a=idx->off[sat-1];
+        b=idx->off[sat];
+        j=-1;
+        
+        if (iode>=0) { /* first ephemeris with iode */
+            for (i=a;i<b;i++) {
+                if (*(const int *)(data+size*ent[i].i+oiode)!=iode) continue;
+                if (fabs(timediff(ent[i].toe,time))>tmax) continue;
+                if (j<0||ent[i].i<ent[j].i) j=i;
+            }
+        }
+        else if (a<b) { /* toe closest to time (latest on tie) */
+            q=idx->last[sat-1];
+            if (q<a||b<q) q=a;
+            while (q<b&&timediff(ent[q].toe,time)<=0.0) q++;
+            while (q>a&&timediff(ent[q-1].toe,time)>0.0) q--;
+            idx->last[sat-1]=q;
+            
+            l=q-1;
+            for (r=q;r+1<b&&timediff(ent[r+1].toe,ent[q].toe)==0.0;r++) ;
+            tl=l>=a?fabs(timediff(ent[l].toe,time)):tmax+1.0;
+            tr=r< b?fabs(timediff(ent[r].toe,time)):tmax+1.0;
+            
+            if (tl<=tmax&&(tl<tr||(tl==tr&&ent[l].i>ent[r].i))) j=l;
+            else if (tr<=tmax) j=r;
+        }
+        if (j<0) return -1;
+        
+        /* ephemeris replaced in place without rebuilding index */
+        t=timediff(*(const gtime_t *)(data+size*ent[j].i+otoe),ent[j].toe);
+        if (*(const int *)(data+size*ent[j].i)==sat&&t==0.0) {
+            return ent[j].i;
+        }
+        idx->src=NULL;
+    }
+    return -1;
+}
 /* select ephememeris --------------------------------------------------------*/
 static eph_t *seleph(gtime_t time, int sat, int iode, const nav_t *nav)
 {
-    double t,tmax,tmin;
-    int i,j=-1;
+    double tmax;
+    int j;
     
     trace(4,"seleph  : time=%s sat=%2d iode=%d\n",time_str(time,3),sat,iode);
     
@@ -395,16 +726,7 @@ static eph_t *seleph(gtime_t time, int sat, int iode, const nav_t *nav)
         case SYS_CMP: tmax=MAXDTOE_CMP+1.0; break;
         default: tmax=MAXDTOE+1.0; break;
     }
-    tmin=tmax+1.0;
-    
-    for (i=0;i<nav->n;i++) {
-        if (nav->eph[i].sat!=sat) continue;
-        if (iode>=0&&nav->eph[i].iode!=iode) continue;
-        if ((t=fabs(timediff(nav->eph[i].toe,time)))>tmax) continue;
-        if (iode>=0) return nav->eph+i;
-        if (t<=tmin) {j=i; tmin=t;} /* toe closest to time */
-    }
-    if (iode>=0||j<0) {
+    if ((j=selidx(time,sat,iode,tmax,nav,0))<0) {
         trace(2,"no broadcast ephemeris: %s sat=%2d iode=%3d\n",time_str(time,0),
               sat,iode);
         return NULL;
@@ -414,19 +736,11 @@ static eph_t *seleph(gtime_t time, int sat, int iode, const nav_t *nav)
 /* select glonass ephememeris ------------------------------------------------*/
 static geph_t *selgeph(gtime_t time, int sat, int iode, const nav_t *nav)
 {
-    double t,tmax=MAXDTOE_GLO,tmin=tmax+1.0;
-    int i,j=-1;
+    int j;
     
     trace(4,"selgeph : time=%s sat=%2d iode=%2d\n",time_str(time,3),sat,iode);
     
-    for (i=0;i<nav->ng;i++) {
-        if (nav->geph[i].sat!=sat) continue;
-        if (iode>=0&&nav->geph[i].iode!=iode) continue;
-        if ((t=fabs(timediff(nav->geph[i].toe,time)))>tmax) continue;
-        if (iode>=0) return nav->geph+i;
-        if (t<=tmin) {j=i; tmin=t;} /* toe closest to time */
-    }
-    if (iode>=0||j<0) {
+    if ((j=selidx(time,sat,iode,MAXDTOE_GLO,nav,1))<0) {
         trace(3,"no glonass ephemeris  : %s sat=%2d iode=%2d\n",time_str(time,0),
               sat,iode);
         return NULL;
@@ -436,17 +750,11 @@ static geph_t *selgeph(gtime_t time, int sat, int iode, const nav_t *nav)
 /* select sbas ephememeris ---------------------------------------------------*/
 static seph_t *selseph(gtime_t time, int sat, const nav_t *nav)
 {
-    double t,tmax=MAXDTOE_SBS,tmin=tmax+1.0;
-    int i,j=-1;
+    int j;
     
     trace(4,"selseph : time=%s sat=%2d\n",time_str(time,3),sat);
     
-    for (i=0;i<nav->ns;i++) {
-        if (nav->seph[i].sat!=sat) continue;
-        if ((t=fabs(timediff(nav->seph[i].t0,time)))>tmax) continue;
-        if (t<=tmin) {j=i; tmin=t;} /* toe closest to time */
-    }
-    if (j<0) {
+    if ((j=selidx(time,sat,-1,MAXDTOE_SBS,nav,2))<0) {
         trace(3,"no sbas ephemeris     : %s sat=%2d\n",time_str(time,0),sat);
         return NULL;
     }
@@ -691,6 +999,97 @@ extern int satpos(gtime_t time, gtime_t teph, int sat, int ephopt,
     *svh=-1;
     return 0;
 }
+/* set satellite state cache ----------------------------------------------------
+* set process-wide cache of broadcast satellite states shared by satposs()
+* callers. states are keyed by satellite, iode, toe and transmission time
+* quantized to tol, and linearly corrected to the exact time by velocity and
+* clock drift
+* args   : double tol       I   time tolerance (s) (0:disable cache)
+* return : none
+* notes  : call before any thread calls satposs() the first time
+*-----------------------------------------------------------------------------*/
+extern void setsatcache(double tol)
+{
+    int i,j;
+    
+    trace(3,"setsatcache: tol=%.3f\n",tol);
+    
+    if (!satcache_init) {
+        initlock(&satcache_lock);
+        satcache_init=1;
+    }
+    lock(&satcache_lock);
+    for (i=0;i<MAXSAT;i++) {
+        for (j=0;j<NSATCACHE;j++) satcache[i][j].iode=-1;
+        satcache_next[i]=0;
+    }
+    satcache_tol=tol>0.0?tol:0.0;
+    satcache_nhit=satcache_nmiss=0;
+    unlock(&satcache_lock);
+}
+/* get satellite state cache statistics ------------------------------------------
+* get and clear statistics of satellite state cache
+* args   : unsigned int *nhit  O  number of states found in the cache
+*          unsigned int *nmiss O  number of states computed
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void satcachestat(unsigned int *nhit, unsigned int *nmiss)
+{
+    *nhit=*nmiss=0;
+    if (!satcache_init) return;
+    lock(&satcache_lock);
+    *nhit=satcache_nhit; *nmiss=satcache_nmiss;
+    satcache_nhit=satcache_nmiss=0;
+    unlock(&satcache_lock);
+}
+/* quantize transmission time for satellite state cache ----------------------*/
+static gtime_t satcachetime(gtime_t time)
+{
+    double tow;
+    int week;
+    tow=time2gpst(time,&week);
+    return gpst2time(week,floor(tow/satcache_tol+0.5)*satcache_tol);
+}
+/* get satellite state from cache --------------------------------------------*/
+static int getsatcache(gtime_t time, const eph_t *eph, double *rs, double *dts,
+                       double *var)
+{
+    satstate_t *st=satcache[eph->sat-1];
+    int i,j,stat=0;
+    
+    lock(&satcache_lock);
+    for (i=0;i<NSATCACHE;i++) {
+        if (st[i].iode!=eph->iode||timediff(st[i].toe,eph->toe)!=0.0||
+            timediff(st[i].time,time)!=0.0) continue;
+        for (j=0;j<6;j++) rs[j]=st[i].rs[j];
+        dts[0]=st[i].dts[0]; dts[1]=st[i].dts[1];
+        *var=st[i].var;
+        stat=1;
+        break;
+    }
+    if (stat) satcache_nhit++; else satcache_nmiss++;
+    unlock(&satcache_lock);
+    return stat;
+}
+/* put satellite state to cache ----------------------------------------------*/
+static void putsatcache(gtime_t time, const eph_t *eph, const double *rs,
+                        const double *dts, double var)
+{
+    satstate_t *st;
+    int i;
+    
+    lock(&satcache_lock);
+    i=satcache_next[eph->sat-1];
+    satcache_next[eph->sat-1]=(i+1)%NSATCACHE;
+    st=satcache[eph->sat-1]+i;
+    st->time=time;
+    st->toe=eph->toe;
+    st->iode=eph->iode;
+    for (i=0;i<6;i++) st->rs[i]=rs[i];
+    st->dts[0]=dts[0]; st->dts[1]=dts[1];
+    st->var=var;
+    unlock(&satcache_lock);
+}
 /* satellite positions and clocks ----------------------------------------------
 * compute satellite positions, velocities and clocks
 * args   : gtime_t teph     I   time to select ephemeris (gpst)
@@ -718,16 +1117,17 @@ extern int satpos(gtime_t time, gtime_t teph, int sat, int ephopt,
 extern void satposs(gtime_t teph, const obsd_t *obs, int n, const nav_t *nav,
                     int ephopt, double *rs, double *dts, double *var, int *svh)
 {
-    gtime_t time[MAXOBS]={{0}};
+    gtime_t time[MAXOBS]={{0}},timeb[MAXOBS],tc;
+    const eph_t *eph,*ephb[MAXOBS];
     double dt,pr;
-    int i,j;
+    int i,j,k,nb=0,nh=0,sys,prn,ib[MAXOBS];
     
     trace(3,"satposs : teph=%s n=%d ephopt=%d\n",time_str(teph,3),n,ephopt);
     
     for (i=0;i<n&&i<MAXOBS;i++) {
         for (j=0;j<6;j++) rs [j+i*6]=0.0;
         for (j=0;j<2;j++) dts[j+i*2]=0.0;
-        var[i]=0.0; svh[i]=0;
+        var[i]=0.0; svh[i]=0; ib[i]=-1;
         
         /* search any psuedorange */
         for (j=0,pr=0.0;j<NFREQ;j++) if ((pr=obs[i].P[j])!=0.0) break;
@@ -746,6 +1146,40 @@ extern void satposs(gtime_t teph, const obsd_t *obs, int n, const nav_t *nav,
         }
         time[i]=timeadd(time[i],-dt);
         
+        /* broadcast orbits are propagated together below */
+        sys=satsys(obs[i].sat,&prn);
+        if (ephopt==EPHOPT_BRDC&&(sys==SYS_GPS||sys==SYS_GAL||sys==SYS_QZS||
+            (sys==SYS_CMP&&prn>5))) {
+            if (!(eph=seleph(teph,obs[i].sat,-1,nav))) {
+                trace(2,"no ephemeris %s sat=%2d\n",time_str(time[i],3),obs[i].sat);
+                svh[i]=-1;
+                continue;
+            }
+            svh[i]=eph->svh;
+            
+            /* satellite state shared with other receivers */
+            if (satcache_tol>0.0) {
+                tc=satcachetime(time[i]);
+                for (k=0;k<nb;k++) {
+                    if (ephb[k]==eph&&timediff(timeb[k],tc)==0.0) break;
+                }
+                if (k<nb) { /* same state as another receiver in the call */
+                    ib[i]=k; nh++;
+                    continue;
+                }
+                if (getsatcache(tc,eph,rs+i*6,dts+i*2,var+i)) {
+                    dt=timediff(time[i],tc);
+                    for (j=0;j<3;j++) rs[j+i*6]+=rs[j+3+i*6]*dt;
+                    dts[i*2]+=dts[1+i*2]*dt;
+                    continue;
+                }
+                timeb[nb]=tc;
+            }
+            else timeb[nb]=time[i];
+            ephb[nb]=eph;
+            ib[i]=nb++;
+            continue;
+        }
         /* satellite position and clock at transmission time */
         if (!satpos(time[i],teph,obs[i].sat,ephopt,nav,rs+i*6,dts+i*2,var+i,
                     svh+i)) {
@@ -759,6 +1193,40 @@ extern void satposs(gtime_t teph, const obsd_t *obs, int n, const nav_t *nav,
             *var=SQR(STD_BRDCCLK);
         }
     }
+    if (nb>0) {
+        double rsb[MAXOBS*6],dtsb[MAXOBS*2],varb[MAXOBS];
+        
+        eph2posn(nb,timeb,ephb,rsb,dtsb,varb);
+        
+        if (satcache_tol>0.0) {
+            for (k=0;k<nb;k++) {
+                if (rsb[k*6]==0.0) continue;
+                putsatcache(timeb[k],ephb[k],rsb+k*6,dtsb+k*2,varb[k]);
+            }
+            /* states shared within the call count as hits */
+            lock(&satcache_lock);
+            satcache_nhit+=nh;
+            unlock(&satcache_lock);
+        }
+        for (i=0;i<n&&i<MAXOBS;i++) {
+            if ((k=ib[i])<0) continue;
+            for (j=0;j<6;j++) rs [j+i*6]=rsb [j+k*6];
+            for (j=0;j<2;j++) dts[j+i*2]=dtsb[j+k*2];
+            var[i]=varb[k];
+            
+            /* correct quantized time to transmission time */
+            if (satcache_tol>0.0&&rsb[k*6]!=0.0) {
+                dt=timediff(time[i],timeb[k]);
+                for (j=0;j<3;j++) rs[j+i*6]+=rs[j+3+i*6]*dt;
+                dts[i*2]+=dts[1+i*2]*dt;
+            }
+            if (dts[i*2]==0.0) {
+                if (!ephclk(time[i],teph,obs[i].sat,nav,dts+i*2)) continue;
+                dts[1+i*2]=0.0;
+                *var=SQR(STD_BRDCCLK);
+            }
+        }
+    }
     for (i=0;i<n&&i<MAXOBS;i++) {
         trace(4,"%s sat=%2d rs=%13.3f %13.3f %13.3f dts=%12.3f var=%7.3f svh=%02X\n",
               time_str(time[i],6),obs[i].sat,rs[i*6],rs[1+i*6],rs[2+i*6],
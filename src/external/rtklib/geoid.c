@@ -14,13 +14,23 @@
 *                               opengeoid(),closegeoid()
 *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 static const char rcsid[]="$Id: geoid.c,v 1.1 2008/07/17 21:48:06 ttaka Exp $";
 
 static const double range[4];       /* embedded geoid area range {W,E,S,N} (deg) */
 static const float geoid[361][181]; /* embedded geoid heights (m) (lon x lat) */
-static FILE *fp_geoid=NULL;         /* geoid file pointer */
+static const unsigned char *map_geoid=NULL; /* geoid file mapping */
+static long size_geoid=0;           /* geoid file size (bytes) */
 static int model_geoid=GEOID_EMBEDDED; /* geoid model */
+#ifdef WIN32
+static HANDLE hmap_geoid=NULL;      /* geoid file mapping handle */
+#endif
 
 /* bilinear interpolation ----------------------------------------------------*/
 static double interpb(const double *y, double a, double b)
@@ -48,13 +58,15 @@ static double geoidh_emb(const double *pos)
     y[3]=geoid[i2][j2];
     return interpb(y,a,b);
 }
-/* get 2 byte signed integer from file ---------------------------------------*/
-static short fget2b(FILE *fp, long off)
+/* get 2 byte signed integer from mapping ------------------------------------*/
+static short fget2b(long off)
 {
-    unsigned char v[2];
-    if (fseek(fp,off,SEEK_SET)==EOF||fread(v,2,1,fp)<1) {
+    const unsigned char *v;
+    if (off<0||size_geoid<off+2) {
         trace(2,"geoid data file range error: off=%ld\n",off);
+        return 0;
     }
+    v=map_geoid+off;
     return ((short)v[0]<<8)+v[1]; /* big-endian */
 }
 /* egm96 15x15" model --------------------------------------------------------*/
@@ -65,25 +77,27 @@ static double geoidh_egm96(const double *pos)
     double a,b,y[4];
     long i1,i2,j1,j2;
     
-    if (!fp_geoid) return 0.0;
+    if (!map_geoid) return 0.0;
     
     a=(pos[1]-lon0)/dlon;
     b=(pos[0]-lat0)/dlat;
     i1=(long)a; a-=i1; i2=i1<nlon-1?i1+1:0;
     j1=(long)b; b-=j1; j2=j1<nlat-1?j1+1:j1;
-    y[0]=fget2b(fp_geoid,2L*(i1+j1*nlon))*0.01;
-    y[1]=fget2b(fp_geoid,2L*(i2+j1*nlon))*0.01;
-    y[2]=fget2b(fp_geoid,2L*(i1+j2*nlon))*0.01;
-    y[3]=fget2b(fp_geoid,2L*(i2+j2*nlon))*0.01;
+    y[0]=fget2b(2L*(i1+j1*nlon))*0.01;
+    y[1]=fget2b(2L*(i2+j1*nlon))*0.01;
+    y[2]=fget2b(2L*(i1+j2*nlon))*0.01;
+    y[3]=fget2b(2L*(i2+j2*nlon))*0.01;
     return interpb(y,a,b);
 }
-/* get 4byte float from file -------------------------------------------------*/
-static float fget4f(FILE *fp, long off)
+/* get 4byte float from mapping ----------------------------------------------*/
+static float fget4f(long off)
 {
     float v=0.0;
-    if (fseek(fp,off,SEEK_SET)==EOF||fread(&v,4,1,fp)<1) {
+    if (off<0||size_geoid<off+4) {
         trace(2,"geoid data file range error: off=%ld\n",off);
+        return 0.0;
     }
+    memcpy(&v,map_geoid+off,4);
     return v; /* small-endian */
 }
 /* egm2008 model -------------------------------------------------------------*/
@@ -95,7 +109,7 @@ static double geoidh_egm08(const double *pos, int model)
     long i1,i2,j1,j2;
     int nlon,nlat;
     
-    if (!fp_geoid) return 0.0;
+    if (!map_geoid) return 0.0;
     
     if (model==GEOID_EGM2008_M25) { /* 2.5 x 2.5" grid */
         dlon= 2.5/60.0;
@@ -121,31 +135,32 @@ static double geoidh_egm08(const double *pos, int model)
     /* (2) Und_min2.5x2.5_egm2008_isw=82_WGS84_TideFree_SE.gz */
 #if 0
     /* not zero-inserted */
-    y[0]=fget4f(fp_geoid,4L*(i1+j1*(nlon)));
-    y[1]=fget4f(fp_geoid,4L*(i2+j1*(nlon)));
-    y[2]=fget4f(fp_geoid,4L*(i1+j2*(nlon)));
-    y[3]=fget4f(fp_geoid,4L*(i2+j2*(nlon)));
+    y[0]=fget4f(4L*(i1+j1*(nlon)));
+    y[1]=fget4f(4L*(i2+j1*(nlon)));
+    y[2]=fget4f(4L*(i1+j2*(nlon)));
+    y[3]=fget4f(4L*(i2+j2*(nlon)));
 #else
     /* zero-inserted version (2009/12/10) */
-    y[0]=fget4f(fp_geoid,4L*(i1+j1*(nlon+2)+1));
-    y[1]=fget4f(fp_geoid,4L*(i2+j1*(nlon+2)+1));
-    y[2]=fget4f(fp_geoid,4L*(i1+j2*(nlon+2)+1));
-    y[3]=fget4f(fp_geoid,4L*(i2+j2*(nlon+2)+1));
+    y[0]=fget4f(4L*(i1+j1*(nlon+2)+1));
+    y[1]=fget4f(4L*(i2+j1*(nlon+2)+1));
+    y[2]=fget4f(4L*(i1+j2*(nlon+2)+1));
+    y[3]=fget4f(4L*(i2+j2*(nlon+2)+1));
 #endif
     return interpb(y,a,b);
 }
 /* get gsi geoid data --------------------------------------------------------*/
-static double fgetgsi(FILE *fp, int nlon, int nlat, int i, int j)
+static double fgetgsi(int nlon, int nlat, int i, int j)
 {
     const int nf=28,wf=9,nl=nf*wf+2,nr=(nlon-1)/nf+1;
     double v;
     long off=nl+j*nr*nl+i/nf*nl+i%nf*wf;
     char buff[16]="";
     
-    if (fseek(fp,off,SEEK_SET)==EOF||fread(buff,wf,1,fp)<1) {
+    if (off<0||size_geoid<off+wf) {
         trace(2,"out of range for gsi geoid: i=%d j=%d\n",i,j);
         return 0.0;
     }
+    memcpy(buff,map_geoid+off,wf);
     if (sscanf(buff,"%lf",&v)<1) {
         trace(2,"gsi geoid data format error: i=%d j=%d buff=%s\n",i,j,buff);
         return 0.0;
@@ -161,7 +176,7 @@ static double geoidh_gsi(const double *pos)
     double a,b,y[4];
     int i1,i2,j1,j2;
     
-    if (!fp_geoid||pos[1]<lon0||lon1<pos[1]||pos[0]<lat0||lat1<pos[0]) {
+    if (!map_geoid||pos[1]<lon0||lon1<pos[1]||pos[0]<lat0||lat1<pos[0]) {
         trace(2,"out of range for gsi geoid: lat=%.3f lon=%.3f\n",pos[0],pos[1]);
         return 0.0;
     }
@@ -169,16 +184,55 @@ static double geoidh_gsi(const double *pos)
     b=(pos[0]-lat0)/dlat;
     i1=(int)a; a-=i1; i2=i1<nlon-1?i1+1:i1;
     j1=(int)b; b-=j1; j2=j1<nlat-1?j1+1:j1;
-    y[0]=fgetgsi(fp_geoid,nlon,nlat,i1,j1);
-    y[1]=fgetgsi(fp_geoid,nlon,nlat,i2,j1);
-    y[2]=fgetgsi(fp_geoid,nlon,nlat,i1,j2);
-    y[3]=fgetgsi(fp_geoid,nlon,nlat,i2,j2);
+    y[0]=fgetgsi(nlon,nlat,i1,j1);
+    y[1]=fgetgsi(nlon,nlat,i2,j1);
+    y[2]=fgetgsi(nlon,nlat,i1,j2);
+    y[3]=fgetgsi(nlon,nlat,i2,j2);
     if (y[0]==999.0||y[1]==999.0||y[2]==999.0||y[3]==999.0) {
         trace(2,"geoidh_gsi: data outage (lat=%.3f lon=%.3f)\n",pos[0],pos[1]);
         return 0.0;
     }
     return interpb(y,a,b);
 }
+/* map geoid model file ------------------------------------------------------*/
+static int mapgeoid(const char *file)
+{
+#ifdef WIN32
+    HANDLE h;
+    LARGE_INTEGER size;
+    void *p=NULL;
+    
+    h=CreateFile(file,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,
+                 FILE_ATTRIBUTE_NORMAL,NULL);
+    if (h==INVALID_HANDLE_VALUE) return 0;
+    
+    if (GetFileSizeEx(h,&size)&&size.QuadPart>0&&
+        (hmap_geoid=CreateFileMapping(h,NULL,PAGE_READONLY,0,0,NULL))) {
+        if (!(p=MapViewOfFile(hmap_geoid,FILE_MAP_READ,0,0,0))) {
+            CloseHandle(hmap_geoid); hmap_geoid=NULL;
+        }
+    }
+    CloseHandle(h);
+    if (!p) return 0;
+    size_geoid=(long)size.QuadPart;
+#else
+    struct stat st;
+    void *p;
+    int fd;
+    
+    if ((fd=open(file,O_RDONLY))<0) return 0;
+    
+    if (fstat(fd,&st)<0||st.st_size<=0||
+        (p=mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0))==MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    size_geoid=(long)st.st_size;
+#endif
+    map_geoid=(const unsigned char *)p;
+    return 1;
+}
 /* open geoid model file -------------------------------------------------------
 * open geoid model file
 * args   : int    model     I   geoid model type
@@ -195,6 +249,8 @@ static double geoidh_gsi(const double *pos)
 *          Und_min1x1_egm2008_isw=82_WGS84_TideFree_SE    : EGM2008 1.0x1.0"
 *          gsigeome_ver4 : GSI geoid 2000 1.0x1.5" (japanese area)
 *          (byte-order of binary files must be compatible to cpu)
+*          the file is mapped read-only, so geoidh() can be called by many
+*          threads at once. don't open or close it while geoidh() is in use
 *-----------------------------------------------------------------------------*/
 extern int opengeoid(int model, const char *file)
 {
@@ -209,7 +265,7 @@ extern int opengeoid(int model, const char *file)
         trace(2,"invalid geoid model: model=%d file=%s\n",model,file);
         return 0;
     }
-    if (!(fp_geoid=fopen(file,"rb"))) {
+    if (!mapgeoid(file)) {
         trace(2,"geoid model file open error: model=%d file=%s\n",model,file);
         return 0;
     }
@@ -225,9 +281,15 @@ extern void closegeoid(void)
 {
     trace(3,"closegoid:\n");
     
-    if (fp_geoid) fclose(fp_geoid);
-    fp_geoid=NULL;
     model_geoid=GEOID_EMBEDDED;
+    if (!map_geoid) return;
+#ifdef WIN32
+    UnmapViewOfFile((LPCVOID)map_geoid);
+    CloseHandle(hmap_geoid); hmap_geoid=NULL;
+#else
+    munmap((void *)map_geoid,size_geoid);
+#endif
+    map_geoid=NULL; size_geoid=0;
 }
 /* geoid height ----------------------------------------------------------------
 * get geoid height from geoid model
@@ -236,6 +298,7 @@ extern void closegeoid(void)
 * notes  : to use external geoid model, call function opengeoid() to open
 *          geoid model before calling the function. If the external geoid model
 *          is not open, the function uses embedded geoid model.
+*          the function is thread-safe
 *-----------------------------------------------------------------------------*/
 extern double geoidh(const double *pos)
 {
@@ -91,6 +91,7 @@ opt_t sysopts[]={
     {"pos2-rejionno",   1,  (void *)&prcopt_.maxinno,    "m"    },
     {"pos2-rejgdop",    1,  (void *)&prcopt_.maxgdop,    ""     },
     {"pos2-niter",      0,  (void *)&prcopt_.niter,      ""     },
+    {"pos2-maxsat",     0,  (void *)&prcopt_.maxsat,     ""     },
     {"pos2-baselen",    1,  (void *)&prcopt_.baseline[0],"m"    },
     {"pos2-basesig",    1,  (void *)&prcopt_.baseline[1],"m"    },
     
@@ -28,6 +28,8 @@ static const char rcsid[]="$Id:$";
 #define NX          (4+3)       /* # of estimated parameters */
 
 #define MAXITR      10          /* max number of iteration for point pos */
+#define MAXSEEDAGE  30.0        /* max age of solution to seed point pos (s) */
+#define MAXLOOSHIFT 100.0       /* max position shift of closed-form raim (m) */
 #define ERR_ION     5.0         /* ionospheric delay std (m) */
 #define ERR_TROP    3.0         /* tropspheric delay std (m) */
 #define ERR_SAAS    0.3         /* saastamoinen model error std (m) */
@@ -308,23 +310,28 @@ static int valsol(const double *azel, const int *vsat, int n,
 /* estimate receiver position ------------------------------------------------*/
 static int estpos(const obsd_t *obs, int n, const double *rs, const double *dts,
                   const double *vare, const int *svh, const nav_t *nav,
-                  const prcopt_t *opt, sol_t *sol, double *azel, int *vsat,
-                  double *resp, char *msg)
+                  const prcopt_t *opt, int seed, sol_t *sol, double *azel,
+                  int *vsat, double *resp, char *msg)
 {
     double x[NX]={0},dx[NX],Q[NX*NX],*v,*H,*var,sig;
     int i,j,k,info,stat,nv,ns;
     
-    trace(3,"estpos  : n=%d\n",n);
+    trace(3,"estpos  : n=%d seed=%d\n",n,seed);
     
     v=mat(n+4,1); H=mat(NX,n+4); var=mat(n+4,1);
     
     for (i=0;i<3;i++) x[i]=sol->rr[i];
     
+    /* seeded by a recent solution: start from its receiver clock, and use
+       full corrections from the first iteration as its geometry is valid */
+    if (seed) {
+        for (i=0;i<4;i++) x[3+i]=sol->dtr[i]*CLIGHT;
+    }
     for (i=0;i<MAXITR;i++) {
         
         /* pseudorange residuals */
-        nv=rescode(i,obs,n,rs,dts,vare,svh,nav,x,opt,v,H,var,azel,vsat,resp,
-                   &ns);
+        nv=rescode(seed?i+1:i,obs,n,rs,dts,vare,svh,nav,x,opt,v,H,var,azel,
+                   vsat,resp,&ns);
         
         if (nv<NX) {
             sprintf(msg,"lack of valid sats ns=%d",nv);
@@ -373,11 +380,226 @@ static int estpos(const obsd_t *obs, int n, const double *rs, const double *dts,
     
     return 0;
 }
+/* estimate receiver position without a satellite ----------------------------*/
+static int estpos_ex(const obsd_t *obs, int n, int ex, const double *rs,
+                     const double *dts, const double *vare, const int *svh,
+                     const nav_t *nav, const prcopt_t *opt, int seed,
+                     sol_t *sol, double *azel, int *vsat, double *resp,
+                     double *rms, char *msg)
+{
+    obsd_t *obs_e;
+    double *rs_e,*dts_e,*vare_e,*azel_e,*resp_e;
+    int j,k,nvsat,stat=0,*svh_e,*vsat_e;
+    
+    if (!(obs_e=(obsd_t *)malloc(sizeof(obsd_t)*n))) return 0;
+    rs_e = mat(6,n); dts_e = mat(2,n); vare_e=mat(1,n); azel_e=zeros(2,n);
+    svh_e=imat(1,n); vsat_e=imat(1,n); resp_e=mat(1,n); 
+    
+    /* satellite exclution */
+    for (j=k=0;j<n;j++) {
+        if (j==ex) continue;
+        obs_e[k]=obs[j];
+        matcpy(rs_e +6*k,rs +6*j,6,1);
+        matcpy(dts_e+2*k,dts+2*j,2,1);
+        vare_e[k]=vare[j];
+        svh_e[k++]=svh[j];
+    }
+    if (!estpos(obs_e,n-1,rs_e,dts_e,vare_e,svh_e,nav,opt,seed,sol,azel_e,
+                vsat_e,resp_e,msg)) {
+        trace(3,"raim_fde: exsat=%2d (%s)\n",obs[ex].sat,msg);
+    }
+    else {
+        for (j=nvsat=0,*rms=0.0;j<n-1;j++) {
+            if (!vsat_e[j]) continue;
+            *rms+=SQR(resp_e[j]);
+            nvsat++;
+        }
+        if (nvsat<5) {
+            trace(3,"raim_fde: exsat=%2d lack of satellites nvsat=%2d\n",
+                  obs[ex].sat,nvsat);
+        }
+        else {
+            *rms=sqrt(*rms/nvsat);
+            for (j=k=0;j<n;j++) {
+                if (j==ex) continue;
+                matcpy(azel+2*j,azel_e+2*k,2,1);
+                vsat[j]=vsat_e[k];
+                resp[j]=resp_e[k++];
+            }
+            vsat[ex]=0;
+            stat=1;
+        }
+    }
+    free(obs_e);
+    free(rs_e ); free(dts_e ); free(vare_e); free(azel_e);
+    free(svh_e); free(vsat_e); free(resp_e);
+    return stat;
+}
+/* leave-one-out residual rms of every satellite -------------------------------
+* the residuals without satellite i follow in closed form from a single
+* least square solution with all satellites:
+*
+*   e(i)_j = e_j + P_ji*e_i/(1-P_ii), P=A'*(A*A')^-1*A
+*
+* where A is the weighted design matrix and e the weighted post-fit residuals.
+* rms[i] is set to -1 for an exclusion that fails validation (as estpos), or
+* to -2 if excluding the satellite moves the solution too far for the
+* linearization to hold. xs[i*NX] is the estimated solution without the
+* satellite, to seed an exact solution.
+* return : status (1:ok,0:no solution with all satellites)
+*-----------------------------------------------------------------------------*/
+static int raim_loo(const obsd_t *obs, int n, const double *rs,
+                    const double *dts, const double *vare, const int *svh,
+                    const nav_t *nav, const prcopt_t *opt, double *rms,
+                    double *xs)
+{
+    double x[NX]={0},dx[NX],Q[NX*NX],*v,*H,*var,*azel,*resp,*QH,*e,*sig,vv;
+    double azels[MAXOBS*2],dop[4],r,rr;
+    int i,j,k,l,m,nv=0,ns,nvsat,stat=0,*vsat,*row;
+    
+    v=mat(n+4,1); H=mat(NX,n+4); var=mat(n+4,1); azel=zeros(2,n);
+    resp=mat(1,n); vsat=imat(1,n); row=imat(1,n);
+    
+    /* least square estimation with all satellites */
+    for (i=0;i<MAXITR;i++) {
+        nv=rescode(i,obs,n,rs,dts,vare,svh,nav,x,opt,v,H,var,azel,vsat,resp,
+                   &ns);
+        if (nv<NX) break;
+        for (j=0;j<nv;j++) {
+            var[j]=sqrt(var[j]);
+            v[j]/=var[j];
+            for (k=0;k<NX;k++) H[k+j*NX]/=var[j];
+        }
+        if (lsq(H,v,NX,nv,dx,Q)) break;
+        for (j=0;j<NX;j++) x[j]+=dx[j];
+        if (norm(dx,NX)<1E-4) {stat=1; break;}
+    }
+    if (!stat) {
+        free(v); free(H); free(var); free(azel); free(resp); free(vsat);
+        free(row);
+        return 0;
+    }
+    /* rows of the design matrix for each satellite */
+    for (i=m=0;i<n;i++) row[i]=vsat[i]?m++:-1;
+    
+    QH=mat(NX,nv); e=mat(nv,1); sig=var;
+    matmul("NN",NX,nv,NX,1.0,Q,H,0.0,QH);
+    
+    /* post-fit residuals e=v-A'*dx */
+    for (j=0;j<nv;j++) e[j]=v[j]-dot(H+j*NX,dx,NX);
+    vv=dot(e,e,nv);
+    
+    for (i=0;i<n;i++) {
+        rms[i]=-1.0;
+        if ((k=row[i])<0) continue;
+        
+        r=1.0-dot(H+k*NX,QH+k*NX,NX); /* 1-P_kk */
+        nvsat=ns-1;
+        if (r<1E-9||nv-1<NX||nvsat<5) continue;
+        
+        /* solution without the satellite */
+        for (j=0;j<NX;j++) xs[j+i*NX]=x[j]-QH[j+k*NX]*e[k]/r;
+        
+        if (norm(QH+k*NX,3)*fabs(e[k])/r>MAXLOOSHIFT) {
+            rms[i]=-2.0;
+            continue;
+        }
+        /* chi-square validation of residuals */
+        if (nv-1>NX&&vv-SQR(e[k])/r>chisqr[nv-1-NX-1]) continue;
+        
+        /* large gdop check */
+        for (j=l=0;j<n;j++) {
+            if (!vsat[j]||j==i) continue;
+            azels[  l*2]=azel[  j*2];
+            azels[1+l*2]=azel[1+j*2];
+            l++;
+        }
+        dops(l,azels,opt->elmin,dop);
+        if (dop[0]<=0.0||dop[0]>opt->maxgdop) continue;
+        
+        /* rms of unweighted residuals without the satellite */
+        for (j=0,rr=0.0;j<n;j++) {
+            if ((l=row[j])<0||j==i) continue;
+            rr+=SQR(sig[l]*(e[l]+dot(H+l*NX,QH+k*NX,NX)*e[k]/r));
+        }
+        rms[i]=sqrt(rr/nvsat);
+    }
+    free(v); free(H); free(var); free(azel); free(resp); free(vsat);
+    free(row); free(QH); free(e);
+    return 1;
+}
 /* raim fde (failure detection and exclution) -------------------------------*/
 static int raim_fde(const obsd_t *obs, int n, const double *rs,
                     const double *dts, const double *vare, const int *svh,
                     const nav_t *nav, const prcopt_t *opt, sol_t *sol,
                     double *azel, int *vsat, double *resp, char *msg)
+{
+    sol_t sol_e={{0}};
+    char tstr[32],name[16],msg_e[128];
+    double *rms_c,*xs,*azel_e,*resp_e,rms_e,rms=100.0;
+    int i,j,k,seed,stat=0,sat=0,*vsat_e;
+    
+    trace(3,"raim_fde: %s n=%2d\n",time_str(obs[0].time,0),n);
+    
+    rms_c=mat(1,n); xs=zeros(NX,n); azel_e=zeros(2,n); vsat_e=imat(1,n);
+    resp_e=mat(1,n);
+    
+    if (!(seed=raim_loo(obs,n,rs,dts,vare,svh,nav,opt,rms_c,xs))) {
+        for (i=0;i<n;i++) rms_c[i]=-2.0;
+    }
+    /* exclusions which can't be evaluated in closed form */
+    for (i=0;i<n;i++) {
+        if (rms_c[i]!=-2.0) continue;
+        for (k=0;k<6;k++) sol_e.rr[k]=k<3?xs[k+i*NX]:0.0;
+        for (k=0;k<4;k++) sol_e.dtr[k]=xs[3+k+i*NX]/CLIGHT;
+        if (!estpos_ex(obs,n,i,rs,dts,vare,svh,nav,opt,seed,&sol_e,azel_e,
+                       vsat_e,resp_e,rms_c+i,msg_e)) rms_c[i]=-1.0;
+    }
+    /* confirm the best exclusion, then the next best if it fails */
+    for (;;) {
+        for (i=0,j=-1;i<n;i++) {
+            if (rms_c[i]<0.0||rms_c[i]>rms) continue;
+            if (j<0||rms_c[i]<=rms_c[j]) j=i;
+        }
+        if (j<0) break;
+        rms_c[j]=-1.0;
+        
+        trace(3,"raim_fde: exsat=%2d\n",obs[j].sat);
+        
+        for (k=0;k<6;k++) sol_e.rr[k]=k<3?xs[k+j*NX]:0.0;
+        for (k=0;k<4;k++) sol_e.dtr[k]=xs[3+k+j*NX]/CLIGHT;
+        if (estpos_ex(obs,n,j,rs,dts,vare,svh,nav,opt,seed,&sol_e,azel_e,
+                      vsat_e,resp_e,&rms_e,msg_e)&&rms_e<=rms) {
+            stat=1;
+            break;
+        }
+    }
+    if (stat) {
+        for (i=0;i<n;i++) {
+            if (i==j) continue;
+            matcpy(azel+2*i,azel_e+2*i,2,1);
+            vsat[i]=vsat_e[i];
+            resp[i]=resp_e[i];
+        }
+        vsat[j]=0;
+        *sol=sol_e;
+        sat=obs[j].sat;
+        strcpy(msg,msg_e);
+        
+        time2str(obs[0].time,tstr,2); satno2id(sat,name);
+        trace(2,"%s: %s excluded by raim\n",tstr+11,name);
+    }
+    free(rms_c); free(xs); free(azel_e); free(vsat_e); free(resp_e);
+    return stat;
+}
+/* raim fde by exhaustive search ---------------------------------------------
+* the search raim_fde() replaced, re-solving once without each satellite; kept
+* to check raim_fde() against in raimfde()
+*-----------------------------------------------------------------------------*/
+static int raim_fde_exh(const obsd_t *obs, int n, const double *rs,
+                        const double *dts, const double *vare, const int *svh,
+                        const nav_t *nav, const prcopt_t *opt, sol_t *sol,
+                        double *azel, int *vsat, double *resp, char *msg)
 {
     obsd_t *obs_e;
     sol_t sol_e={{0}};
@@ -385,7 +607,7 @@ static int raim_fde(const obsd_t *obs, int n, const double *rs,
     double *rs_e,*dts_e,*vare_e,*azel_e,*resp_e,rms_e,rms=100.0;
     int i,j,k,nvsat,stat=0,*svh_e,*vsat_e,sat=0;
     
-    trace(3,"raim_fde: %s n=%2d\n",time_str(obs[0].time,0),n);
+    trace(3,"raim_fde_exh: %s n=%2d\n",time_str(obs[0].time,0),n);
     
     if (!(obs_e=(obsd_t *)malloc(sizeof(obsd_t)*n))) return 0;
     rs_e = mat(6,n); dts_e = mat(2,n); vare_e=mat(1,n); azel_e=zeros(2,n);
@@ -403,9 +625,9 @@ static int raim_fde(const obsd_t *obs, int n, const double *rs,
             svh_e[k++]=svh[j];
         }
         /* estimate receiver position without a satellite */
-        if (!estpos(obs_e,n-1,rs_e,dts_e,vare_e,svh_e,nav,opt,&sol_e,azel_e,
+        if (!estpos(obs_e,n-1,rs_e,dts_e,vare_e,svh_e,nav,opt,0,&sol_e,azel_e,
                     vsat_e,resp_e,msg_e)) {
-            trace(3,"raim_fde: exsat=%2d (%s)\n",obs[i].sat,msg);
+            trace(3,"raim_fde_exh: exsat=%2d (%s)\n",obs[i].sat,msg);
             continue;
         }
         for (j=nvsat=0,rms_e=0.0;j<n-1;j++) {
@@ -414,13 +636,13 @@ static int raim_fde(const obsd_t *obs, int n, const double *rs,
             nvsat++;
         }
         if (nvsat<5) {
-            trace(3,"raim_fde: exsat=%2d lack of satellites nvsat=%2d\n",
+            trace(3,"raim_fde_exh: exsat=%2d lack of satellites nvsat=%2d\n",
                   obs[i].sat,nvsat);
             continue;
         }
         rms_e=sqrt(rms_e/nvsat);
         
-        trace(3,"raim_fde: exsat=%2d rms=%8.3f\n",obs[i].sat,rms_e);
+        trace(3,"raim_fde_exh: exsat=%2d rms=%8.3f\n",obs[i].sat,rms_e);
         
         if (rms_e>rms) continue;
         
@@ -539,20 +761,64 @@ static void estvel(const obsd_t *obs, int n, const double *rs, const double *dts
 extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
                   const prcopt_t *opt, sol_t *sol, double *azel, ssat_t *ssat,
                   char *msg)
+{
+    double *rs,*dts,*var;
+    int stat,svh[MAXOBS];
+    
+    if (n<=0) {
+        sol->stat=SOLQ_NONE;
+        strcpy(msg,"no observation data");
+        return 0;
+    }
+    rs=mat(6,n); dts=mat(2,n); var=mat(1,n);
+    
+    /* satellite positons, velocities and clocks */
+    satposs(obs[0].time,obs,n,nav,opt->sateph,rs,dts,var,svh);
+    
+    stat=pntposs(obs,n,nav,opt,rs,dts,var,svh,sol,azel,ssat,msg);
+    
+    free(rs); free(dts); free(var);
+    return stat;
+}
+/* single-point positioning with satellite positions ---------------------------
+* compute receiver position, velocity, clock bias by single-point positioning
+* with satellite positions, clocks and health already computed by satposs()
+* args   : obsd_t *obs      I   observation data
+*          int    n         I   number of observation data
+*          nav_t  *nav      I   navigation data
+*          prcopt_t *opt    I   processing options
+*          double *rs       I   satellite positions and velocities (satposs())
+*          double *dts      I   satellite clocks (satposs())
+*          double *var      I   sat position and clock error variances (m^2)
+*          int    *svh      I   sat health flag (-1:correction not available)
+*          sol_t  *sol      IO  solution
+*          double *azel     IO  azimuth/elevation angle (rad) (NULL: no output)
+*          ssat_t *ssat     IO  satellite status              (NULL: no output)
+*          char   *msg      O   error message for error exit
+* return : status(1:ok,0:error)
+* notes  : a solution in sol no older than MAXSEEDAGE seeds the estimation
+*-----------------------------------------------------------------------------*/
+extern int pntposs(const obsd_t *obs, int n, const nav_t *nav,
+                   const prcopt_t *opt, const double *rs, const double *dts,
+                   const double *var, const int *svh, sol_t *sol, double *azel,
+                   ssat_t *ssat, char *msg)
 {
     prcopt_t opt_=*opt;
-    double *rs,*dts,*var,*azel_,*resp;
-    int i,stat,vsat[MAXOBS]={0},svh[MAXOBS];
+    double *azel_,*resp;
+    int i,stat,seed,vsat[MAXOBS]={0};
+    
+    seed=sol->stat!=SOLQ_NONE&&norm(sol->rr,3)>0.0&&
+         fabs(timediff(obs[0].time,sol->time))<=MAXSEEDAGE;
     
     sol->stat=SOLQ_NONE;
     
     if (n<=0) {strcpy(msg,"no observation data"); return 0;}
     
-    trace(3,"pntpos  : tobs=%s n=%d\n",time_str(obs[0].time,3),n);
+    trace(3,"pntposs : tobs=%s n=%d\n",time_str(obs[0].time,3),n);
     
     sol->time=obs[0].time; msg[0]='\0';
     
-    rs=mat(6,n); dts=mat(2,n); var=mat(1,n); azel_=zeros(2,n); resp=mat(1,n);
+    azel_=zeros(2,n); resp=mat(1,n);
     
     if (opt_.mode!=PMODE_SINGLE) { /* for precise positioning */
 #if 0
@@ -561,12 +827,13 @@ extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
         opt_.ionoopt=IONOOPT_BRDC;
         opt_.tropopt=TROPOPT_SAAS;
     }
-    /* satellite positons, velocities and clocks */
-    satposs(sol->time,obs,n,nav,opt_.sateph,rs,dts,var,svh);
-    
     /* estimate receiver position with pseudorange */
-    stat=estpos(obs,n,rs,dts,var,svh,nav,&opt_,sol,azel_,vsat,resp,msg);
+    stat=estpos(obs,n,rs,dts,var,svh,nav,&opt_,seed,sol,azel_,vsat,resp,msg);
     
+    /* a bad seed can mask satellites by elevation; retry from scratch */
+    if (!stat&&seed) {
+        stat=estpos(obs,n,rs,dts,var,svh,nav,&opt_,0,sol,azel_,vsat,resp,msg);
+    }
     /* raim fde */
     if (!stat&&n>=6&&opt->posopt[4]) {
         stat=raim_fde(obs,n,rs,dts,var,svh,nav,&opt_,sol,azel_,vsat,resp,msg);
@@ -593,6 +860,38 @@ extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
             ssat[obs[i].sat-1].resp[0]=resp[i];
         }
     }
-    free(rs); free(dts); free(var); free(azel_); free(resp);
+    free(azel_); free(resp);
     return stat;
 }
+/* raim fde for tests ----------------------------------------------------------
+* exclude a faulty satellite by raim fde as pntposs() does, with either the
+* closed-form search or the exhaustive search it replaced, to check that they
+* make the same exclusions
+* args   : obsd_t *obs      I   observation data
+*          int    n         I   number of observation data
+*          double *rs       I   satellite positions and velocities (satposs())
+*          double *dts      I   satellite clocks (satposs())
+*          double *vare     I   sat position and clock error variances (m^2)
+*          int    *svh      I   sat health flag (-1:correction not available)
+*          nav_t  *nav      I   navigation data
+*          prcopt_t *opt    I   processing options
+*          int    exh       I   search (0:closed form,1:exhaustive)
+*          sol_t  *sol      O   solution without the excluded satellite
+*          double *azel     O   azimuth/elevation angle (rad)
+*          int    *vsat     O   valid satellite flags
+*          double *resp     O   pseudorange residuals (m)
+*          char   *msg      O   error message
+* return : status (1:satellite excluded,0:no exclusion)
+* notes  : for tests only; pntposs() only runs raim fde when the solution with
+*          all satellites fails validation
+*-----------------------------------------------------------------------------*/
+extern int raimfde(const obsd_t *obs, int n, const double *rs,
+                   const double *dts, const double *vare, const int *svh,
+                   const nav_t *nav, const prcopt_t *opt, int exh, sol_t *sol,
+                   double *azel, int *vsat, double *resp, char *msg)
+{
+    msg[0]='\0';
+    if (exh) return raim_fde_exh(obs,n,rs,dts,vare,svh,nav,opt,sol,azel,vsat,
+                                 resp,msg);
+    return raim_fde(obs,n,rs,dts,vare,svh,nav,opt,sol,azel,vsat,resp,msg);
+}
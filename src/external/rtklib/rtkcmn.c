@@ -1619,14 +1619,15 @@ extern double dms2deg(const double *dms)
     double sign=dms[0]<0.0?-1.0:1.0;
     return sign*(fabs(dms[0])+dms[1]/60.0+dms[2]/3600.0);
 }
-/* transform ecef to geodetic postion ------------------------------------------
-* transform ecef position to geodetic position
+/* transform ecef to geodetic postion by iteration ----------------------------
+* transform ecef position to geodetic position by iterating on the height
 * args   : double *r        I   ecef position {x,y,z} (m)
 *          double *pos      O   geodetic position {lat,lon,h} (rad,m)
 * return : none
 * notes  : WGS84, ellipsoidal height
+*          the reference for ecef2pos_cf(), used where that can't be
 *-----------------------------------------------------------------------------*/
-extern void ecef2pos(const double *r, double *pos)
+extern void ecef2pos_itr(const double *r, double *pos)
 {
     double e2=FE_WGS84*(2.0-FE_WGS84),r2=dot(r,r,2),z,zk,v=RE_WGS84,sinp;
     
@@ -1640,6 +1641,66 @@ extern void ecef2pos(const double *r, double *pos)
     pos[1]=r2>1E-12?atan2(r[1],r[0]):0.0;
     pos[2]=sqrt(r2+z*z)-v;
 }
+/* transform ecef to geodetic postion in closed form ---------------------------
+* transform ecef position to geodetic position without iteration
+* args   : double *r        I   ecef position {x,y,z} (m)
+*          double *pos      O   geodetic position {lat,lon,h} (rad,m)
+* return : status (1:ok,0:too close to the center of the earth)
+* notes  : WGS84, ellipsoidal height
+*          ref: H.Vermeille, Direct transformation from geocentric
+*          coordinates to geodetic coordinates, Journal of Geodesy, 76,
+*          451-454, 2002
+*-----------------------------------------------------------------------------*/
+extern int ecef2pos_cf(const double *r, double *pos)
+{
+    const double a2=RE_WGS84*RE_WGS84,e2=FE_WGS84*(2.0-FE_WGS84),e4=e2*e2;
+    double r2=r[0]*r[0]+r[1]*r[1],p,q,rr,s,t,u,v,w,k,d,dz;
+    
+    p=r2/a2;
+    q=(1.0-e2)/a2*r[2]*r[2];
+    rr=(p+q-e4)/6.0;
+    if (rr<=0.0) return 0;
+    s=e4*p*q/(4.0*rr*rr*rr);
+    t=cbrt(1.0+s+sqrt(s*(2.0+s)));
+    u=rr*(1.0+t+1.0/t);
+    v=sqrt(u*u+e4*q);
+    w=e2*(u+v-q)/(2.0*v);
+    k=sqrt(u+v+w*w)-w;
+    d=k*sqrt(r2)/(k+e2);
+    dz=sqrt(d*d+r[2]*r[2]);
+    pos[0]=2.0*atan2(r[2],d+dz);
+    pos[1]=r2>1E-12?atan2(r[1],r[0]):0.0;
+    pos[2]=(k+e2-1.0)/k*dz;
+    return 1;
+}
+/* transform ecef to geodetic postion ------------------------------------------
+* transform ecef position to geodetic position
+* args   : double *r        I   ecef position {x,y,z} (m)
+*          double *pos      O   geodetic position {lat,lon,h} (rad,m)
+* return : none
+* notes  : WGS84, ellipsoidal height
+*          closed form (no iteration) except within about 40 km of the
+*          center of the earth
+*-----------------------------------------------------------------------------*/
+extern void ecef2pos(const double *r, double *pos)
+{
+    if (!ecef2pos_cf(r,pos)) ecef2pos_itr(r,pos);
+}
+/* transform ecef to geodetic postions -----------------------------------------
+* transform ecef positions to geodetic positions, as ecef2pos() for each
+* args   : int    n         I   number of positions
+*          double *r        I   ecef positions {x,y,z;...} (m)
+*          double *pos      O   geodetic positions {lat,lon,h;...} (rad,m)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void ecef2posn(int n, const double *r, double *pos)
+{
+    int i;
+    
+    for (i=0;i<n;i++) {
+        if (!ecef2pos_cf(r+i*3,pos+i*3)) ecef2pos_itr(r+i*3,pos+i*3);
+    }
+}
 /* transform geodetic to ecef position -----------------------------------------
 * transform geodetic position to ecef position
 * args   : double *pos      I   geodetic position {lat,lon,h} (rad,m)
@@ -2506,6 +2567,7 @@ extern void uniqnav(nav_t *nav)
     uniqeph (nav);
     uniqgeph(nav);
     uniqseph(nav);
+    freenavidx(nav);
     
     /* update carrier wave length */
     for (i=0;i<MAXSAT;i++) for (j=0;j<NFREQ;j++) {
@@ -2572,6 +2634,7 @@ extern int screent(gtime_t time, gtime_t ts, gtime_t te, double tint)
 * args   : char    file  I      file path
 *          nav_t   nav   O/I    navigation data
 * return : status (1:ok,0:no file)
+* notes  : galileo ionospheric and utc parameters are in a GALIONUTC line
 *-----------------------------------------------------------------------------*/
 extern int readnav(const char *file, nav_t *nav)
 {
@@ -2585,6 +2648,13 @@ extern int readnav(const char *file, nav_t *nav)
     if (!(fp=fopen(file,"r"))) return 0;
     
     while (fgets(buff,sizeof(buff),fp)) {
+        if (!strncmp(buff,"GALIONUTC",9)) {
+            for (i=0;i<4;i++) nav->ion_gal[i]=nav->utc_gal[i]=0.0;
+            sscanf(buff,"GALIONUTC,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+                   &nav->ion_gal[0],&nav->ion_gal[1],&nav->ion_gal[2],&nav->ion_gal[3],
+                   &nav->utc_gal[0],&nav->utc_gal[1],&nav->utc_gal[2],&nav->utc_gal[3]);
+            continue;
+        }
         if (!strncmp(buff,"IONUTC",6)) {
             for (i=0;i<8;i++) nav->ion_gps[i]=0.0;
             for (i=0;i<4;i++) nav->utc_gps[i]=0.0;
@@ -2615,6 +2685,7 @@ extern int readnav(const char *file, nav_t *nav)
                &nav->eph[sat-1].code, &nav->eph[sat-1].flag);
     }
     fclose(fp);
+    freenavidx(nav);
     return 1;
 }
 extern int savenav(const char *file, const nav_t *nav)
@@ -2644,11 +2715,14 @@ extern int savenav(const char *file, const nav_t *nav)
                 nav->eph[i].tgd[0],nav->eph[i].code,nav->eph[i].flag);
     }
     fprintf(fp,"IONUTC,%.14E,%.14E,%.14E,%.14E,%.14E,%.14E,%.14E,%.14E,%.14E,"
-               "%.14E,%.14E,%.14E,%d",
+               "%.14E,%.14E,%.14E,%d\n",
             nav->ion_gps[0],nav->ion_gps[1],nav->ion_gps[2],nav->ion_gps[3],
             nav->ion_gps[4],nav->ion_gps[5],nav->ion_gps[6],nav->ion_gps[7],
             nav->utc_gps[0],nav->utc_gps[1],nav->utc_gps[2],nav->utc_gps[3],
             nav->leaps);
+    fprintf(fp,"GALIONUTC,%.14E,%.14E,%.14E,%.14E,%.14E,%.14E,%.14E,%.14E",
+            nav->ion_gal[0],nav->ion_gal[1],nav->ion_gal[2],nav->ion_gal[3],
+            nav->utc_gal[0],nav->utc_gal[1],nav->utc_gal[2],nav->utc_gal[3]);
     
     fclose(fp);
     return 1;
@@ -2681,6 +2755,26 @@ extern void freenav(nav_t *nav, int opt)
     if (opt&0x10) {free(nav->pclk); nav->pclk=NULL; nav->nc=nav->ncmax=0;}
     if (opt&0x20) {free(nav->alm ); nav->alm =NULL; nav->na=nav->namax=0;}
     if (opt&0x40) {free(nav->tec ); nav->tec =NULL; nav->nt=nav->ntmax=0;}
+    if (opt&0x07) freenavidx(nav);
+}
+/* free ephemeris index --------------------------------------------------------
+* free ephemeris selection index of navigation data. the index is rebuilt by
+* the next ephemeris selection. call it after broadcast ephemeris are replaced
+* in place, as added ones are detected by the number of ephemeris
+* args   : nav_t *nav    IO     navigation data
+* return : none
+* notes  : the index is updated by ephemeris selection, so navigation data
+*          shared by threads must be accessed under lock
+*-----------------------------------------------------------------------------*/
+extern void freenavidx(nav_t *nav)
+{
+    int i;
+    
+    for (i=0;i<3;i++) {
+        free(nav->idx[i].ent); nav->idx[i].ent=NULL;
+        nav->idx[i].src=NULL; nav->idx[i].nsrc=0;
+        nav->idx[i].n=nav->idx[i].nmax=0;
+    }
 }
 /* debug trace functions -----------------------------------------------------*/
 #ifdef TRACE
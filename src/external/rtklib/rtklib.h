@@ -136,7 +136,7 @@ extern "C" {
 #endif
 #ifdef ENAGAL
 #define MINPRNGAL   1                   /* min satellite PRN number of Galileo */
-#define MAXPRNGAL   27                  /* max satellite PRN number of Galileo */
+#define MAXPRNGAL   36                  /* max satellite PRN number of Galileo */
 #define NSATGAL    (MAXPRNGAL-MINPRNGAL+1) /* number of Galileo satellites */
 #define NSYSGAL     1
 #else
@@ -592,6 +592,21 @@ typedef struct {        /* SBAS ephemeris type */
     double af0,af1;     /* satellite clock-offset/drift (s,s/s) */
 } seph_t;
 
+typedef struct {        /* ephemeris index entry type */
+    gtime_t toe;        /* time of ephemeris */
+    int sat;            /* satellite number */
+    int i;              /* index of ephemeris */
+} ephent_t;
+
+typedef struct {        /* ephemeris selection index type */
+    const void *src;    /* indexed ephemeris (NULL:not built) */
+    int nsrc;           /* number of indexed ephemeris */
+    int n,nmax;         /* number of index entries */
+    ephent_t *ent;      /* index entries sorted by satellite and toe */
+    int off[MAXSAT+1];  /* end of entries of each satellite (off[0]=0) */
+    int last[MAXSAT];   /* entry after toe of last selection */
+} ephidx_t;
+
 typedef struct {        /* norad two line element data type */
     char name [32];     /* common name */
     char alias[32];     /* alias name */
@@ -821,6 +836,7 @@ typedef struct {        /* navigation data type */
     ssr_t ssr[MAXSAT];  /* SSR corrections */
     lexeph_t lexeph[MAXSAT]; /* LEX ephemeris */
     lexion_t lexion;    /* LEX ionosphere correction */
+    ephidx_t idx[3];    /* ephemeris selection index (0:eph,1:geph,2:seph) */
 } nav_t;
 
 typedef struct {        /* station parameter type */
@@ -1011,6 +1027,7 @@ typedef struct {        /* processing options type */
     int  syncsol;       /* solution sync mode (0:off,1:on) */
     double odisp[2][6*11]; /* ocean tide loading parameters {rov,base} */
     exterr_t exterr;    /* extended receiver error model */
+    int maxsat;         /* max number of satellites for relative positioning (0:all) */
 } prcopt_t;
 
 typedef struct {        /* solution options type */
@@ -1093,7 +1110,7 @@ typedef struct {        /* satellite status type */
     unsigned char snr [NFREQ]; /* signal strength (0.25 dBHz) */
     unsigned char fix [NFREQ]; /* ambiguity fix flag (1:fix,2:float,3:hold) */
     unsigned char slip[NFREQ]; /* cycle-slip flag */
-    unsigned int lock [NFREQ]; /* lock counter of phase */
+    int lock [NFREQ];   /* lock counter of phase */
     unsigned int outc [NFREQ]; /* obs outage counter of phase */
     unsigned int slipc[NFREQ]; /* cycle-slip counter */
     unsigned int rejc [NFREQ]; /* reject counter */
@@ -1328,6 +1345,9 @@ extern int reppaths(const char *path, char *rpaths[], int nmax, gtime_t ts,
 
 /* coordinates transformation ------------------------------------------------*/
 extern void ecef2pos(const double *r, double *pos);
+extern void ecef2posn(int n, const double *r, double *pos);
+extern int  ecef2pos_cf(const double *r, double *pos);
+extern void ecef2pos_itr(const double *r, double *pos);
 extern void pos2ecef(const double *pos, double *r);
 extern void ecef2enu(const double *pos, const double *r, double *e);
 extern void enu2ecef(const double *pos, const double *e, double *r);
@@ -1347,6 +1367,7 @@ extern int  readnav(const char *file, nav_t *nav);
 extern int  savenav(const char *file, const nav_t *nav);
 extern void freeobs(obs_t *obs);
 extern void freenav(nav_t *nav, int opt);
+extern void freenavidx(nav_t *nav);
 extern int  readblq(const char *file, const char *sta, double *odisp);
 extern int  readerp(const char *file, erp_t *erp);
 extern int  geterp (const erp_t *erp, gtime_t time, double *val);
@@ -1461,6 +1482,8 @@ extern double geph2clk(gtime_t time, const geph_t *geph);
 extern double seph2clk(gtime_t time, const seph_t *seph);
 extern void eph2pos (gtime_t time, const eph_t  *eph,  double *rs, double *dts,
                      double *var);
+extern void eph2posn(int n, const gtime_t *time, const eph_t **eph, double *rs,
+                     double *dts, double *var);
 extern void geph2pos(gtime_t time, const geph_t *geph, double *rs, double *dts,
                      double *var);
 extern void seph2pos(gtime_t time, const seph_t *seph, double *rs, double *dts,
@@ -1474,6 +1497,8 @@ extern int  satpos(gtime_t time, gtime_t teph, int sat, int ephopt,
                    int *svh);
 extern void satposs(gtime_t time, const obsd_t *obs, int n, const nav_t *nav,
                     int sateph, double *rs, double *dts, double *var, int *svh);
+extern void setsatcache(double tol);
+extern void satcachestat(unsigned int *nhit, unsigned int *nmiss);
 extern void readsp3(const char *file, nav_t *nav, int opt);
 extern int  readsap(const char *file, gtime_t time, nav_t *nav);
 extern int  readdcb(const char *file, nav_t *nav);
@@ -1641,10 +1666,20 @@ extern int lambda(int n, int m, const double *a, const double *Q, double *F,
 extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
                   const prcopt_t *opt, sol_t *sol, double *azel,
                   ssat_t *ssat, char *msg);
+extern int pntposs(const obsd_t *obs, int n, const nav_t *nav,
+                   const prcopt_t *opt, const double *rs, const double *dts,
+                   const double *var, const int *svh, sol_t *sol, double *azel,
+                   ssat_t *ssat, char *msg);
+extern int raimfde(const obsd_t *obs, int n, const double *rs,
+                   const double *dts, const double *vare, const int *svh,
+                   const nav_t *nav, const prcopt_t *opt, int exh, sol_t *sol,
+                   double *azel, int *vsat, double *resp, char *msg);
 
 /* precise positioning -------------------------------------------------------*/
 extern void rtkinit(rtk_t *rtk, const prcopt_t *opt);
 extern void rtkfree(rtk_t *rtk);
+extern int  rtkchgbase(rtk_t *rtk, const double *shift, const int *vsat,
+                       double var, int hold);
 extern int  rtkpos (rtk_t *rtk, const obsd_t *obs, int nobs, const nav_t *nav);
 extern int  rtkopenstat(const char *file, int level);
 extern void rtkclosestat(void);
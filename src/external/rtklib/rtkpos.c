@@ -45,6 +45,7 @@ static const char rcsid[]="$Id:$";
 #define SQR(x)      ((x)*(x))
 #define SQRT(x)     ((x)<=0.0?0.0:sqrt(x))
 #define MIN(x,y)    ((x)<=(y)?(x):(y))
+#define MAX(x,y)    ((x)>=(y)?(x):(y))
 #define ROUND(x)    (int)floor((x)+0.5)
 
 #define VAR_POS     SQR(30.0) /* initial variance of receiver pos (m^2) */
@@ -424,6 +425,62 @@ static int selsat(const obsd_t *obs, double *azel, int nu, int nr,
     }
     return k;
 }
+/* limit common satellites to the best subset ---------------------------------
+* drop satellites from those selected by selsat() until at most opt->maxsat
+* remain. each step drops the satellite whose removal leaves the best gdop,
+* weighted by its signal strength and lock count so that weak and newly
+* risen satellites go first and the subset stays stable between epochs.
+* a satellite left alone in its system can't be double-differenced, so it is
+* dropped before any other.
+*-----------------------------------------------------------------------------*/
+static int capsat(const rtk_t *rtk, const obsd_t *obs, const double *azel,
+                  int ns, int *sat, int *iu, int *ir)
+{
+    double w[MAXSAT],sel[2*MAXSAT],dop[4],cost,mincost;
+    int i,j,n,k,lock,nsys[8]={0},sys[MAXSAT];
+    
+    trace(3,"capsat  : ns=%d maxsat=%d\n",ns,rtk->opt.maxsat);
+    
+    for (i=0;i<ns;i++) {
+        switch ((sys[i]=satsys(sat[i],NULL))) {
+            case SYS_GLO: sys[i]=1; break;
+            case SYS_GAL: sys[i]=2; break;
+            case SYS_QZS: sys[i]=3; break;
+            case SYS_CMP: sys[i]=4; break;
+            case SYS_SBS: sys[i]=5; break;
+            default:      sys[i]=0; break;
+        }
+        nsys[sys[i]]++;
+        
+        /* weight 1-1.5 by cn0 above 30 dBHz and 1-1.5 by lock count */
+        w[i]=1.0+MIN(MAX(obs[iu[i]].SNR[0]*0.25-30.0,0.0),15.0)/30.0;
+        lock=(int)rtk->ssat[sat[i]-1].lock[0];
+        if (lock>0) w[i]*=1.0+MIN(lock,rtk->opt.minlock+10)/
+                          (2.0*(rtk->opt.minlock+10));
+    }
+    while (ns>rtk->opt.maxsat) {
+        for (i=0,k=-1,mincost=1E99;i<ns;i++) {
+            if (nsys[sys[i]]==1) {k=i; break;}
+            
+            for (j=n=0;j<ns;j++) {
+                if (j==i) continue;
+                sel[n*2]=azel[ir[j]*2]; sel[1+n*2]=azel[1+ir[j]*2]; n++;
+            }
+            dops(n,sel,0.0,dop);
+            cost=(dop[0]>0.0?dop[0]:1E9)*w[i];
+            if (cost<mincost) {mincost=cost; k=i;}
+        }
+        trace(4,"capsat  : drop sat=%3d cost=%.2f\n",sat[k],mincost);
+        
+        nsys[sys[k]]--;
+        for (i=k;i<ns-1;i++) {
+            sat[i]=sat[i+1]; iu[i]=iu[i+1]; ir[i]=ir[i+1];
+            w[i]=w[i+1]; sys[i]=sys[i+1];
+        }
+        ns--;
+    }
+    return ns;
+}
 /* temporal update of position/velocity/acceleration -------------------------*/
 static void udpos(rtk_t *rtk, double tt)
 {
@@ -1488,13 +1545,14 @@ static int valpos(rtk_t *rtk, const double *v, const double *R, const int *vflg,
 }
 /* relative positioning ------------------------------------------------------*/
 static int relpos(rtk_t *rtk, const obsd_t *obs, int nu, int nr,
-                  const nav_t *nav)
+                  const nav_t *nav, const double *rs, const double *dts,
+                  const int *svh)
 {
     prcopt_t *opt=&rtk->opt;
     gtime_t time=obs[0].time;
-    double *rs,*dts,*var,*y,*e,*azel,*v,*H,*R,*xp,*Pp,*xa,*bias,dt;
+    double *y,*e,*azel,*v,*H,*R,*xp,*Pp,*xa,*bias,dt;
     int i,j,f,n=nu+nr,ns,ny,nv,sat[MAXSAT],iu[MAXSAT],ir[MAXSAT],niter;
-    int info,vflg[MAXOBS*NFREQ*2+1],svh[MAXOBS*2];
+    int info,vflg[MAXOBS*NFREQ*2+1];
     int stat=rtk->opt.mode<=PMODE_DGPS?SOLQ_DGPS:SOLQ_FLOAT;
     int nf=opt->ionoopt==IONOOPT_IFLC?1:opt->nf;
     
@@ -1502,22 +1560,18 @@ static int relpos(rtk_t *rtk, const obsd_t *obs, int nu, int nr,
     
     dt=timediff(time,obs[nu].time);
     
-    rs=mat(6,n); dts=mat(2,n); var=mat(1,n); y=mat(nf*2,n); e=mat(3,n);
-    azel=zeros(2,n);
+    y=mat(nf*2,n); e=mat(3,n); azel=zeros(2,n);
     
     for (i=0;i<MAXSAT;i++) {
         rtk->ssat[i].sys=satsys(i+1,NULL);
         for (j=0;j<NFREQ;j++) rtk->ssat[i].vsat[j]=rtk->ssat[i].snr[j]=0;
     }
-    /* satellite positions/clocks */
-    satposs(time,obs,n,nav,opt->sateph,rs,dts,var,svh);
-    
     /* undifferenced residuals for base station */
     if (!zdres(1,obs+nu,nr,rs+nu*6,dts+nu*2,svh+nu,nav,rtk->rb,opt,1,
                y+nu*nf*2,e+nu*3,azel+nu*2)) {
         errmsg(rtk,"initial base station position error\n");
         
-        free(rs); free(dts); free(var); free(y); free(e); free(azel);
+        free(y); free(e); free(azel);
         return 0;
     }
     /* time-interpolation of residuals (for post-processing) */
@@ -1528,9 +1582,13 @@ static int relpos(rtk_t *rtk, const obsd_t *obs, int nu, int nr,
     if ((ns=selsat(obs,azel,nu,nr,opt,sat,iu,ir))<=0) {
         errmsg(rtk,"no common satellite\n");
         
-        free(rs); free(dts); free(var); free(y); free(e); free(azel);
+        free(y); free(e); free(azel);
         return 0;
     }
+    /* bound the cost of the filter update */
+    if (opt->maxsat>0&&ns>opt->maxsat) {
+        ns=capsat(rtk,obs,azel,ns,sat,iu,ir);
+    }
     /* temporal update of states */
     udstate(rtk,obs,sat,iu,ir,ns,nav);
     
@@ -1660,7 +1718,7 @@ static int relpos(rtk_t *rtk, const obsd_t *obs, int nu, int nr,
         if (rtk->ssat[i].fix[j]==2&&stat!=SOLQ_FIX) rtk->ssat[i].fix[j]=1;
         if (rtk->ssat[i].slip[j]&1) rtk->ssat[i].slipc[j]++;
     }
-    free(rs); free(dts); free(var); free(y); free(e); free(azel);
+    free(y); free(e); free(azel);
     free(xp); free(Pp);  free(xa);  free(v); free(H); free(R); free(bias);
     
     if (stat!=SOLQ_NONE) rtk->sol.stat=stat;
@@ -1714,6 +1772,124 @@ extern void rtkfree(rtk_t *rtk)
     free(rtk->xa); rtk->xa=NULL;
     free(rtk->Pa); rtk->Pa=NULL;
 }
+/* change base station ---------------------------------------------------------
+* move the L1 phase biases to another base station. the biases are single
+* differences against the base, so each moves by the difference between the
+* phase-code offsets of the two bases
+* args   : rtk_t  *rtk      IO  rtk control/result struct
+*          double *shift    I   bias shift of each satellite (shift[sat-1])
+*                               (cycles)
+*          int    *vsat     I   shift valid flags (vsat[sat-1]) (0:reset bias)
+*          double var       I   variance added to moved biases (cycle^2)
+*          int    hold      I   epochs moved biases are held out of ambiguity
+*                               resolution (at least opt.minlock)
+* return : number of biases moved
+* notes  : the shifts are from code, so var should be about as large as the
+*          error of a bias initialized by phase-code. biases without a valid
+*          shift are reset
+*-----------------------------------------------------------------------------*/
+extern int rtkchgbase(rtk_t *rtk, const double *shift, const int *vsat,
+                      double var, int hold)
+{
+    int i,j,n=0;
+    
+    trace(3,"rtkchgbase: var=%.1f hold=%d\n",var,hold);
+    
+    if (rtk->opt.mode<=PMODE_DGPS||rtk->opt.mode>PMODE_FIXED) return 0;
+    
+    for (i=1;i<=MAXSAT;i++) {
+        j=IB(i,0,&rtk->opt);
+        if (rtk->x[j]==0.0) continue;
+        
+        rtk->ssat[i-1].fix[0]=0;
+        rtk->ssat[i-1].lock[0]=-rtk->opt.minlock;
+        
+        if (vsat[i-1]) {
+            rtk->ssat[i-1].lock[0]=-MAX(rtk->opt.minlock,hold);
+            rtk->x[j]+=shift[i-1];
+            rtk->P[j+j*rtk->nx]+=var;
+            n++;
+        }
+        else {
+            initx(rtk,0.0,0.0,j);
+        }
+    }
+    rtk->nfix=0;
+    return n;
+}
+/* relative positioning with satellite positions -----------------------------*/
+static int rtkposs(rtk_t *rtk, const obsd_t *obs, int nu, int nr,
+                   const nav_t *nav, gtime_t time, const double *rs,
+                   const double *dts, const double *var, const int *svh)
+{
+    prcopt_t *opt=&rtk->opt;
+    sol_t solb={{0}};
+    int i;
+    char msg[128]="";
+    
+    /* rover position by single point positioning */
+    if (!pntposs(obs,nu,nav,&rtk->opt,rs,dts,var,svh,&rtk->sol,NULL,rtk->ssat,
+                 msg)) {
+        errmsg(rtk,"point pos error (%s)\n",msg);
+        
+        if (!rtk->opt.dynamics) {
+            outsolstat(rtk);
+            return 0;
+        }
+    }
+    if (time.time!=0) rtk->tt=timediff(rtk->sol.time,time);
+    
+    /* single point positioning */
+    if (opt->mode==PMODE_SINGLE) {
+        outsolstat(rtk);
+        return 1;
+    }
+    /* precise point positioning */
+    if (opt->mode>=PMODE_PPP_KINEMA) {
+        pppos(rtk,obs,nu,nav);
+        pppoutsolstat(rtk,statlevel,fp_stat);
+        return 1;
+    }
+    /* check number of data of base station and age of differential */
+    if (nr==0) {
+        errmsg(rtk,"no base station observation data for rtk\n");
+        outsolstat(rtk);
+        return 1;
+    }
+    if (opt->mode==PMODE_MOVEB) { /*  moving baseline */
+        
+        /* estimate position/velocity of base station */
+        if (!pntposs(obs+nu,nr,nav,&rtk->opt,rs+nu*6,dts+nu*2,var+nu,svh+nu,
+                     &solb,NULL,NULL,msg)) {
+            errmsg(rtk,"base station position error (%s)\n",msg);
+            return 0;
+        }
+        rtk->sol.age=(float)timediff(rtk->sol.time,solb.time);
+        
+        if (fabs(rtk->sol.age)>TTOL_MOVEB) {
+            errmsg(rtk,"time sync error for moving-base (age=%.1f)\n",rtk->sol.age);
+            return 0;
+        }
+        for (i=0;i<6;i++) rtk->rb[i]=solb.rr[i];
+        
+        /* time-synchronized position of base station */
+        for (i=0;i<3;i++) rtk->rb[i]+=rtk->rb[i+3]*rtk->sol.age;
+    }
+    else {
+        rtk->sol.age=(float)timediff(obs[0].time,obs[nu].time);
+        
+        if (fabs(rtk->sol.age)>opt->maxtdiff) {
+            errmsg(rtk,"age of differential error (age=%.1f)\n",rtk->sol.age);
+            outsolstat(rtk);
+            return 1;
+        }
+    }
+    /* relative potitioning */
+    relpos(rtk,obs,nu,nr,nav,rs,dts,svh);
+    outsolstat(rtk);
+    
+    return 1;
+}
 /* precise positioning ---------------------------------------------------------
 * input observation data and navigation message, compute rover position by 
 * precise positioning
@@ -1775,10 +1951,9 @@ extern void rtkfree(rtk_t *rtk)
 extern int rtkpos(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav)
 {
     prcopt_t *opt=&rtk->opt;
-    sol_t solb={{0}};
     gtime_t time;
-    int i,nu,nr;
-    char msg[128]="";
+    double *rs,*dts,*var;
+    int i,nu,nr,stat,svh[MAXOBS*2];
     
     trace(3,"rtkpos  : time=%s n=%d\n",time_str(obs[0].time,3),n);
     trace(4,"obs=\n"); traceobs(4,obs,n);
@@ -1794,64 +1969,13 @@ extern int rtkpos(rtk_t *rtk, const obsd_t *obs, int n, const nav_t *nav)
     
     time=rtk->sol.time; /* previous epoch */
     
-    /* rover position by single point positioning */
-    if (!pntpos(obs,nu,nav,&rtk->opt,&rtk->sol,NULL,rtk->ssat,msg)) {
-        errmsg(rtk,"point pos error (%s)\n",msg);
-        
-        if (!rtk->opt.dynamics) {
-            outsolstat(rtk);
-            return 0;
-        }
-    }
-    if (time.time!=0) rtk->tt=timediff(rtk->sol.time,time);
+    /* satellite positions/clocks, shared by single point and relative
+       positioning; the previous solution seeds single point positioning */
+    rs=mat(6,n); dts=mat(2,n); var=mat(1,n);
+    satposs(obs[0].time,obs,n,nav,opt->sateph,rs,dts,var,svh);
     
-    /* single point positioning */
-    if (opt->mode==PMODE_SINGLE) {
-        outsolstat(rtk);
-        return 1;
-    }
-    /* precise point positioning */
-    if (opt->mode>=PMODE_PPP_KINEMA) {
-        pppos(rtk,obs,nu,nav);
-        pppoutsolstat(rtk,statlevel,fp_stat);
-        return 1;
-    }
-    /* check number of data of base station and age of differential */
-    if (nr==0) {
-        errmsg(rtk,"no base station observation data for rtk\n");
-        outsolstat(rtk);
-        return 1;
-    }
-    if (opt->mode==PMODE_MOVEB) { /*  moving baseline */
-        
-        /* estimate position/velocity of base station */
-        if (!pntpos(obs+nu,nr,nav,&rtk->opt,&solb,NULL,NULL,msg)) {
-            errmsg(rtk,"base station position error (%s)\n",msg);
-            return 0;
-        }
-        rtk->sol.age=(float)timediff(rtk->sol.time,solb.time);
-        
-        if (fabs(rtk->sol.age)>TTOL_MOVEB) {
-            errmsg(rtk,"time sync error for moving-base (age=%.1f)\n",rtk->sol.age);
-            return 0;
-        }
-        for (i=0;i<6;i++) rtk->rb[i]=solb.rr[i];
-        
-        /* time-synchronized position of base station */
-        for (i=0;i<3;i++) rtk->rb[i]+=rtk->rb[i+3]*rtk->sol.age;
-    }
-    else {
-        rtk->sol.age=(float)timediff(obs[0].time,obs[nu].time);
-        
-        if (fabs(rtk->sol.age)>opt->maxtdiff) {
-            errmsg(rtk,"age of differential error (age=%.1f)\n",rtk->sol.age);
-            outsolstat(rtk);
-            return 1;
-        }
-    }
-    /* relative potitioning */
-    relpos(rtk,obs,nu,nr,nav);
-    outsolstat(rtk);
+    stat=rtkposs(rtk,obs,nu,nr,nav,time,rs,dts,var,svh);
     
-    return 1;
+    free(rs); free(dts); free(var);
+    return stat;
 }
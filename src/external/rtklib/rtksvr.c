@@ -93,6 +93,7 @@ static void updatenav(nav_t *nav)
     for (i=0;i<MAXSAT;i++) for (j=0;j<NFREQ;j++) {
         nav->lam[i][j]=satwavelen(i+1,j,nav);
     }
+    freenavidx(nav);
 }
 /* update glonass frequency channel number in raw data struct ----------------*/
 static void updatefcn(rtksvr_t *svr)
@@ -567,6 +568,7 @@ extern void rtksvrfree(rtksvr_t *svr)
     free(svr->nav.eph );
     free(svr->nav.geph);
     free(svr->nav.seph);
+    freenavidx(&svr->nav);
     for (i=0;i<3;i++) for (j=0;j<MAXOBSBUF;j++) {
         free(svr->obs[i][j].data);
     }
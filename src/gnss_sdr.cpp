@@ -28,111 +28,140 @@
  */
 
 #include "gnss_sdr.hpp"
-#include "fork.hpp"
+#include "config_template.hpp"
+#include "metrics.hpp"
+#include "spawn.hpp"
 #include "station.hpp"
+#include "station_config.hpp"
 #include "log.hpp"
 #include <boost/filesystem.hpp>
 #include <gflags/gflags.h>
-#include <fstream>
-#include <boost/algorithm/string/replace.hpp>
+#include <cerrno>
+#include <unistd.h>
 
 DECLARE_string (socket_file);
 
 namespace fs = boost::filesystem;
 
 extern fs::path GNSS_SDR_EXECUTABLE;
-extern fs::path GNSS_SDR_CONFIG_FILE;
+extern genesis::config_template GNSS_SDR_CONFIG;
 
 namespace genesis {
 
 namespace detail {
 
-// Write the INI file to the local directory
-static gnss_sdr::error_type write_config (const station &st,
-                                          const fs::path &path,
-                                          double bias)
+// gnss-sdr's settings for a station
+static config_overrides overrides (const std::string &address,
+                                   unsigned short port,
+                                   const std::string &prefix,
+                                   double bias)
 {
-    std::ifstream ifs (GNSS_SDR_CONFIG_FILE.c_str (), std::ios::binary);
-    if (!ifs) {
-        return make_error_condition (file_not_found);
-    }
-    std::ofstream ofs (path.c_str (), std::ios::binary);
-    if (!ofs) {
-        return make_error_condition (file_not_found);
-    }
-
-    ofs << ifs.rdbuf ();
-
-    // Writing these at the end will override previous definitions
+    config_overrides o;
     fs::path socket_file = FLAGS_socket_file;
-    ofs << std::endl << "SignalSource.address=" << st.get_address () << std::endl;
-    ofs << "SignalSource.port=" << st.get_port () << std::endl;
-    ofs << "InputFilter.IF=" << bias << std::endl;
+    o.set ("SignalSource.address", address);
+    o.set ("SignalSource.port", port);
+    o.set ("InputFilter.IF", bias);
     if (socket_file.is_absolute ()) {
-        ofs << "OutputFilter.filename=" << socket_file.c_str () << std::endl;
+        o.set ("OutputFilter.filename", socket_file.string ());
     }
     else {
         // relative from run directory
-        ofs << "OutputFilter.filename=../" << socket_file.c_str () << std::endl;
+        o.set ("OutputFilter.filename", "../" + socket_file.string ());
     }
 
-    ofs << "GNSS-SDR.shared_mem=true" << std::endl;
-    if (st.get_type () == station::STATION_TYPE_BASE) {
-        ofs << "GNSS-SDR.shared_mem_prefix=genesis.base" << std::endl;
-    }
-    else {
-        ofs << "GNSS-SDR.shared_mem_prefix=genesis."
-            << st.get_address () << std::endl;
-    }
-    return gnss_sdr::error_type ();
+    o.set ("GNSS-SDR.shared_mem", true);
+    o.set ("GNSS-SDR.shared_mem_prefix", prefix);
+    return o;
 }
 
-} // namespace detail
-
-
-gnss_sdr::error_type gnss_sdr::run (const station &st,
-                                    fork_handler *handler,
+// Configure and start gnss-sdr in a directory
+static gnss_sdr::error_type launch (const std::string &address,
+                                    unsigned short port,
+                                    const std::string &prefix,
+                                    double bias,
+                                    const fs::path &path,
+                                    spawn_handler *handler,
                                     int &out,
-                                    double bias)
+                                    int &pid)
 {
     logger lg;
 
     boost::system::error_code ec;
-    fs::path path (boost::algorithm::replace_all_copy (
-                       st.get_address (), ":", "."));
-    if (!fs::exists (path)) {
-        if (!fs::create_directory (st.get_address (), ec)) {
-            return to_error_condition (ec);
-        }
+    if (!make_directory (path, ec)) {
+        return to_error_condition (ec);
     }
 
-    // Write configuration
-    fs::path config_file = path;
-    config_file /= "gnss-sdr.conf";
-    error_type et = detail::write_config (st, config_file, bias);
+    // Configuration, in memory if possible
+    int config_fd;
+    std::string config_path;
+    gnss_sdr::error_type et;
+    {
+        scoped_timer timer ("gnss_sdr_config_ms");
+        et = GNSS_SDR_CONFIG.write (overrides (address, port, prefix, bias),
+                                    path / "gnss-sdr.conf",
+                                    config_fd,
+                                    config_path);
+    }
     if (et) {
-        BOOST_LOG_SEV (lg, error) << "Failed to write config file "
-                                          << "for station "
-                                          << st.get_address ();
+        BOOST_LOG_SEV (lg, error) << "Failed to write config file in "
+                                  << path;
         return et;
     }
 
     // Execute gnss-sdr
-   BOOST_LOG_SEV (lg, trace) << "Starting gnss-sdr";
-   std::vector<std::string> args;
-   args.push_back ("gnss-sdr");
-   args.push_back ("--config_file");
-   args.push_back ("gnss-sdr.conf");
-   args.push_back ("-log_dir=./");
-   out = genesis::fork (handler,
-                        path,
-                        GNSS_SDR_EXECUTABLE,
-                        args);
+    BOOST_LOG_SEV (lg, trace) << "Starting gnss-sdr";
+    std::vector<std::string> args;
+    args.push_back ("gnss-sdr");
+    args.push_back ("--config_file");
+    args.push_back (config_path);
+    args.push_back ("-log_dir=./");
+    out = genesis::spawn (handler,
+                          path,
+                          GNSS_SDR_EXECUTABLE,
+                          args,
+                          &pid,
+                          config_fd);
+    int e = errno;
+    if (config_fd >= 0) {
+        ::close (config_fd);
+    }
+    if (out < 0) {
+        return to_error_condition (boost::system::error_code (
+           e, boost::system::system_category ()));
+    }
+
+    BOOST_LOG_SEV (lg, trace) << "gnss-sdr started";
+    return et;
+}
+
+} // namespace detail
 
-   BOOST_LOG_SEV (lg, trace) << "gnss-sdr started";
 
+gnss_sdr::error_type gnss_sdr::run (const station &st,
+                                    spawn_handler *handler,
+                                    int &out,
+                                    int &pid,
+                                    double bias)
+{
+    return detail::launch (st.get_address (),
+                           st.get_port (),
+                           shared_memory_prefix (st),
+                           bias,
+                           station_directory (st.get_address ()),
+                           handler,
+                           out,
+                           pid);
+}
 
-   return et;
+gnss_sdr::error_type gnss_sdr::run_idle (const fs::path &dir,
+                                         unsigned short port,
+                                         const std::string &prefix,
+                                         spawn_handler *handler,
+                                         int &out,
+                                         int &pid)
+{
+    return detail::launch ("127.0.0.1", port, prefix, 0, dir,
+                           handler, out, pid);
 }
 
 }
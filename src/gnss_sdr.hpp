@@ -31,11 +31,13 @@
 #define GENESIS_GNSS_SDR_HPP
 
 #include "error.hpp"
+#include <boost/filesystem/path.hpp>
 #include <boost/noncopyable.hpp>
+#include <string>
 
 namespace genesis {
 
-class fork_handler;
+class spawn_handler;
 class station;
 
 /*!
@@ -47,9 +49,23 @@ public:
    typedef boost::system::error_condition error_type;
 
    error_type run (const station &st,
-                   fork_handler *handler,
+                   spawn_handler *handler,
                    int &out, // output stream
+                   int &pid, // gnss-sdr's process ID
                    double bias = 0);
+
+   /*!
+    * \brief Start gnss-sdr in dir, reading samples from an rtl_tcp
+    * server on the local port and publishing navigation data under
+    * the given shared memory prefix. Used for pooled workers, which
+    * are given a station later.
+    */
+   error_type run_idle (const boost::filesystem::path &dir,
+                        unsigned short port,
+                        const std::string &prefix,
+                        spawn_handler *handler,
+                        int &out,
+                        int &pid);
 };
 
 }
@@ -0,0 +1,487 @@
+/*!
+ * \file gnss_sdr_pool.cpp
+ * \brief A pool of idle gnss-sdr processes, ready for new stations.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "gnss_sdr_pool.hpp"
+#include "child_log.hpp"
+#include "gnss_sdr.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "station.hpp"
+#include "station_config.hpp"
+#include <boost/array.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/foreach.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <signal.h>
+
+namespace genesis {
+
+namespace detail {
+
+using boost::asio::ip::tcp;
+
+enum {
+    RTL_TCP_SET_FREQUENCY = 0x01,
+    RTL_TCP_HEADER_SIZE = 12,   // "RTL0", tuner type, gain count
+    RTL_TCP_COMMAND_SIZE = 5,   // command, big-endian parameter
+    RTL_TCP_R820T = 5,          // the tuner idle gnss-sdrs are told of
+    RTL_TCP_R820T_GAINS = 29,
+    SAMPLE_BUFFER_SIZE = 65536
+};
+
+typedef boost::array <unsigned char, RTL_TCP_COMMAND_SIZE> command;
+
+static void put_be32 (unsigned char *p, boost::uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static boost::uint32_t get_be32 (const unsigned char *p) {
+    return (boost::uint32_t (p[0]) << 24) | (boost::uint32_t (p[1]) << 16) |
+       (boost::uint32_t (p[2]) << 8) | p[3];
+}
+
+// Relays rtl_tcp between an idle gnss-sdr and, once bound, a station.
+// Runs on the io_service; its handlers keep it alive. notify is called
+// with true when gnss-sdr is ready for a station, and false when it's
+// gone.
+class relay : public boost::enable_shared_from_this <relay> {
+public:
+    typedef boost::function <void (bool)> notify_function;
+
+    relay (boost::asio::io_service &service, notify_function notify)
+        : pid_ (0),
+          acceptor_ (service),
+          sdr_ (service),
+          station_ (service),
+          notify_ (notify),
+          IF_ (0),
+          bound_ (false),
+          writing_ (false),
+          failed_ (false)
+    {
+        put_be32 (&header_[0], 0x52544c30); // "RTL0"
+        put_be32 (&header_[4], RTL_TCP_R820T);
+        put_be32 (&header_[8], RTL_TCP_R820T_GAINS);
+    }
+
+    // Listen for gnss-sdr. Returns the port, or 0 on failure.
+    unsigned short open () {
+        boost::system::error_code ec;
+        tcp::endpoint ep (boost::asio::ip::address_v4::loopback (), 0);
+        acceptor_.open (ep.protocol (), ec);
+        if (!ec) {
+            acceptor_.bind (ep, ec);
+        }
+        if (!ec) {
+            acceptor_.listen (1, ec);
+        }
+        if (ec) {
+            BOOST_LOG_SEV (lg_, error) << "Failed to open relay: "
+                                       << ec.message ();
+            return 0;
+        }
+        acceptor_.async_accept (sdr_,
+                                boost::bind (&relay::handle_accept,
+                                             shared_from_this (),
+                                             boost::asio::placeholders::error));
+        return acceptor_.local_endpoint ().port ();
+    }
+
+    void bind (const station &st, double IF) {
+        IF_ = IF;
+
+        // Its output goes with it to the station
+        if (log_) {
+            boost::filesystem::path dir =
+               station_directory (st.get_address ());
+            boost::system::error_code ec;
+            make_directory (dir, ec);
+            log_->reopen (dir / "gnss-sdr.log", st.get_address ());
+        }
+
+        boost::system::error_code ec;
+        tcp::endpoint ep (
+           boost::asio::ip::address::from_string (st.get_address (), ec),
+           st.get_port ());
+        if (ec) {
+            fail ("Bad station address", ec);
+            return;
+        }
+        BOOST_LOG_SEV (lg_, debug) << "Relaying " << ep << " to gnss-sdr "
+                                   << pid_;
+        station_.async_connect (ep,
+                                boost::bind (&relay::handle_connect,
+                                             shared_from_this (),
+                                             boost::asio::placeholders::error));
+    }
+
+    // Stop relaying; gnss-sdr is left to notice its source has gone
+    void close () {
+        boost::system::error_code ec;
+        acceptor_.close (ec);
+        sdr_.close (ec);
+        station_.close (ec);
+    }
+
+    int pid_;
+    std::string prefix_;
+    boost::shared_ptr <child_log> log_;
+
+private:
+    void handle_accept (const boost::system::error_code &ec) {
+        boost::system::error_code ignored;
+        acceptor_.close (ignored);
+        if (ec) {
+            fail ("gnss-sdr didn't connect", ec);
+            return;
+        }
+
+        // Answer as a dongle, then take gnss-sdr's settings
+        boost::asio::async_write (sdr_, boost::asio::buffer (header_),
+                                  boost::bind (&relay::handle_header_sent,
+                                               shared_from_this (),
+                                               boost::asio::placeholders::error));
+        read_command ();
+    }
+
+    void handle_header_sent (const boost::system::error_code &ec) {
+        if (ec) {
+            fail ("Lost gnss-sdr", ec);
+            return;
+        }
+        notify_ (true);
+    }
+
+    void read_command () {
+        boost::asio::async_read (sdr_, boost::asio::buffer (command_),
+                                 boost::bind (&relay::handle_command,
+                                              shared_from_this (),
+                                              boost::asio::placeholders::error));
+    }
+
+    void handle_command (const boost::system::error_code &ec) {
+        if (ec) {
+            fail ("Lost gnss-sdr", ec);
+            return;
+        }
+
+        // Until bound, only the latest of each setting matters
+        if (!bound_) {
+            BOOST_FOREACH (command &c, commands_) {
+                if (c[0] == command_[0]) {
+                    c = command_;
+                    read_command ();
+                    return;
+                }
+            }
+        }
+        commands_.push_back (command_);
+        write_command ();
+        read_command ();
+    }
+
+    void write_command () {
+        if (!bound_ || writing_ || commands_.empty ()) {
+            return;
+        }
+
+        // Correct for the station's IF by tuning that much higher
+        command &c = commands_.front ();
+        if (c[0] == RTL_TCP_SET_FREQUENCY) {
+            double f = get_be32 (&c[1]) + IF_;
+            put_be32 (&c[1], static_cast<boost::uint32_t> (
+                         std::floor (f + 0.5)));
+        }
+
+        writing_ = true;
+        boost::asio::async_write (station_, boost::asio::buffer (c),
+                                  boost::bind (&relay::handle_command_sent,
+                                               shared_from_this (),
+                                               boost::asio::placeholders::error));
+    }
+
+    void handle_command_sent (const boost::system::error_code &ec) {
+        writing_ = false;
+        if (ec) {
+            fail ("Lost station", ec);
+            return;
+        }
+        commands_.pop_front ();
+        write_command ();
+    }
+
+    void handle_connect (const boost::system::error_code &ec) {
+        if (ec) {
+            fail ("Failed to connect to station", ec);
+            return;
+        }
+
+        // The station's own dongle header isn't passed on
+        boost::asio::async_read (station_,
+                                 boost::asio::buffer (station_header_),
+                                 boost::bind (&relay::handle_station_header,
+                                              shared_from_this (),
+                                              boost::asio::placeholders::error));
+    }
+
+    void handle_station_header (const boost::system::error_code &ec) {
+        if (ec) {
+            fail ("Lost station", ec);
+            return;
+        }
+        if (std::memcmp (&station_header_[0], &header_[0], 4)) {
+            BOOST_LOG_SEV (lg_, warning)
+               << "Station isn't an rtl_tcp server.";
+        }
+
+        bound_ = true;
+        write_command ();
+        read_samples ();
+    }
+
+    void read_samples () {
+        station_.async_read_some (
+           boost::asio::buffer (samples_),
+           boost::bind (&relay::handle_samples,
+                        shared_from_this (),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred));
+    }
+
+    void handle_samples (const boost::system::error_code &ec, size_t n) {
+        if (ec) {
+            fail ("Lost station", ec);
+            return;
+        }
+        boost::asio::async_write (sdr_, boost::asio::buffer (samples_, n),
+                                  boost::bind (&relay::handle_samples_sent,
+                                               shared_from_this (),
+                                               boost::asio::placeholders::error));
+    }
+
+    void handle_samples_sent (const boost::system::error_code &ec) {
+        if (ec) {
+            fail ("Lost gnss-sdr", ec);
+            return;
+        }
+        read_samples ();
+    }
+
+    // Give up on this gnss-sdr. Its session, if any, ends when it exits.
+    void fail (const char *what, const boost::system::error_code &ec) {
+        if (failed_ || ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        failed_ = true;
+        notify_ (false);
+        BOOST_LOG_SEV (lg_, warning) << what << " (gnss-sdr " << pid_
+                                     << "): " << ec.message ();
+        close ();
+        if (pid_ > 0) {
+            ::kill (pid_, SIGTERM);
+        }
+    }
+
+    tcp::acceptor acceptor_;
+    tcp::socket sdr_;
+    tcp::socket station_;
+    notify_function notify_;
+    double IF_;
+    bool bound_;
+    bool writing_;
+    bool failed_;
+    boost::array <unsigned char, RTL_TCP_HEADER_SIZE> header_;
+    boost::array <unsigned char, RTL_TCP_HEADER_SIZE> station_header_;
+    command command_;
+    std::deque <command> commands_; // to send to the station
+    boost::array <char, SAMPLE_BUFFER_SIZE> samples_;
+    logger lg_;
+};
+
+} // namespace detail
+
+struct gnss_sdr_pool::impl {
+   typedef boost::mutex::scoped_lock scoped_lock;
+   typedef boost::shared_ptr <detail::relay> relay_ptr;
+
+   impl (boost::asio::io_service &service,
+         spawn_handler *handler,
+         int size)
+      : service_ (service),
+        handler_ (handler),
+        size_ (size),
+        closed_ (false)
+      {
+      }
+
+   // A relay's gnss-sdr is ready, or has gone
+   static void notify (boost::shared_ptr <impl> self, int id, bool ready) {
+      scoped_lock guard (self->mutex_);
+      if (ready) {
+         if (self->idle_.count (id)) {
+            self->ready_.insert (id);
+         }
+         return;
+      }
+
+      // Its directory can be used again
+      self->used_.erase (id);
+      self->ready_.erase (id);
+      if (self->idle_.erase (id) && !self->closed_) {
+         self->service_.post (boost::bind (&impl::fill, self));
+      }
+   }
+
+   static void fill (boost::shared_ptr <impl> self) {
+      for (;;) {
+         int id = 0;
+         {
+            scoped_lock guard (self->mutex_);
+            if (self->closed_ ||
+                static_cast<int> (self->idle_.size ()) >= self->size_)
+            {
+               return;
+            }
+            while (self->used_.count (id)) {
+               id++;
+            }
+            self->used_.insert (id);
+         }
+
+         relay_ptr r (new detail::relay (
+            self->service_,
+            boost::bind (&impl::notify, self, id, _1)));
+         unsigned short port = r->open ();
+         std::string name = "pool." + boost::lexical_cast<std::string> (id);
+         r->prefix_ = "genesis." + name;
+         gnss_sdr runner;
+         int out;
+         gnss_sdr::error_type et = port ?
+            runner.run_idle (name, port, r->prefix_, self->handler_, out,
+                             r->pid_) :
+            make_error_condition (boost::system::errc::bad_address);
+         if (et) {
+            BOOST_LOG_SEV (self->lg_, error)
+               << "Failed to start pooled gnss-sdr: " << et.message ();
+            r->close ();
+            scoped_lock guard (self->mutex_);
+            self->used_.erase (id);
+            return;
+         }
+
+         // Kept in the pool directory until it's given to a station
+         r->log_ = boost::make_shared<child_log> (
+            boost::ref (self->service_), out,
+            boost::filesystem::path (name) / "gnss-sdr.log", name);
+         r->log_->start ();
+
+         scoped_lock guard (self->mutex_);
+         self->idle_[id] = r;
+      }
+   }
+
+   boost::asio::io_service &service_;
+   spawn_handler *handler_;
+   const int size_;
+   bool closed_;
+   std::map <int, relay_ptr> idle_; // by directory number
+   std::set <int> ready_;           // idle and ready for a station
+   std::set <int> used_;            // directory numbers in use
+   boost::mutex mutex_;
+   logger_mt lg_;
+};
+
+gnss_sdr_pool::gnss_sdr_pool (boost::asio::io_service &service,
+                              spawn_handler *handler,
+                              int size)
+   : impl_ (new impl (service, handler, size))
+{
+}
+
+gnss_sdr_pool::~gnss_sdr_pool () {
+   close ();
+}
+
+void gnss_sdr_pool::fill () {
+   impl::fill (impl_);
+}
+
+bool gnss_sdr_pool::acquire (const station &st, double IF, worker &w) {
+   impl::relay_ptr r;
+   {
+      impl::scoped_lock guard (impl_->mutex_);
+      if (!impl_->ready_.empty ()) {
+         int id = *impl_->ready_.begin ();
+         r = impl_->idle_[id];
+         impl_->idle_.erase (id);
+         impl_->ready_.erase (id);
+      }
+   }
+
+   // Start its replacement in the background
+   impl_->service_.post (boost::bind (&impl::fill, impl_));
+   if (!r) {
+      count_metric ("gnss_sdr_pool_misses");
+      return false;
+   }
+
+   w.pid = r->pid_;
+   w.prefix = r->prefix_;
+   impl_->service_.post (boost::bind (&detail::relay::bind, r, st, IF));
+   count_metric ("gnss_sdr_pool_hits");
+   return true;
+}
+
+void gnss_sdr_pool::close () {
+   std::map <int, impl::relay_ptr> idle;
+   {
+      impl::scoped_lock guard (impl_->mutex_);
+      impl_->closed_ = true;
+      idle.swap (impl_->idle_);
+      impl_->ready_.clear ();
+   }
+   typedef std::map <int, impl::relay_ptr>::value_type idle_pair;
+   BOOST_FOREACH (const idle_pair &r, idle) {
+      impl_->service_.post (boost::bind (&detail::relay::close, r.second));
+   }
+}
+
+}
@@ -0,0 +1,99 @@
+/*!
+ * \file gnss_sdr_pool.hpp
+ * \brief A pool of idle gnss-sdr processes, ready for new stations.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_GNSS_SDR_POOL_HPP
+#define GENESIS_GNSS_SDR_POOL_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+namespace genesis {
+
+class spawn_handler;
+class station;
+
+/*!
+ * \brief Keeps gnss-sdr processes running ahead of time, so a joining
+ * station doesn't wait for gnss-sdr to start up and build its flowgraph.
+ *
+ * gnss-sdr reads its configuration once, so each idle gnss-sdr reads
+ * samples from an rtl_tcp relay on the loopback interface. Until a
+ * station is bound, the relay answers as a dongle and holds on to the
+ * tuner settings gnss-sdr asks for. When a station is bound, the relay
+ * connects to the station's rtl_tcp server, passes the settings on and
+ * forwards samples. The station's IF is applied by tuning it that much
+ * higher, since gnss-sdr's input filter can't be changed.
+ *
+ * All members are safe to call from any thread.
+ */
+class gnss_sdr_pool : boost::noncopyable {
+public:
+   // A gnss-sdr given to a station
+   struct worker {
+      int pid;            // its process ID
+      std::string prefix; // its shared memory prefix
+   };
+
+   /*!
+    * \brief Create a pool that keeps size gnss-sdrs idle. Relays run on
+    * the io_service.
+    */
+   gnss_sdr_pool (boost::asio::io_service &service,
+                  spawn_handler *handler,
+                  int size);
+
+   ~gnss_sdr_pool ();
+
+   /*!
+    * \brief Start gnss-sdrs until the pool is full.
+    */
+   void fill ();
+
+   /*!
+    * \brief Give an idle gnss-sdr to a station, with the station's IF
+    * (Hz), and start another in its place.
+    * \returns false if none is ready.
+    */
+   bool acquire (const station &st, double IF, worker &w);
+
+   /*!
+    * \brief Stop starting gnss-sdrs and drop the idle ones.
+    */
+   void close ();
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_GNSS_SDR_POOL_HPP
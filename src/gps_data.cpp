@@ -29,11 +29,20 @@
 #include "gps_data.hpp"
 #include "station.hpp"
 #include "concurrent_shared_map.h"
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/named_mutex.hpp>
 
-static std::string shared_name (const genesis::station &st) {
-    return st.get_type () == genesis::station::STATION_TYPE_BASE ?
-       ( std::string ("genesis.base") ) :
-       ( std::string ("genesis") + st.get_address () );
+// Open a map that GNSS-SDR only creates for some configurations
+template <typename Data, typename Ptr>
+static void open_optional (const std::string &name, Ptr &ptr) {
+    if (!ptr) {
+        try {
+            ptr.reset (new concurrent_shared_map<Data> (name));
+        }
+        catch (const boost::interprocess::interprocess_exception &) {
+        }
+    }
 }
 
 namespace genesis {
@@ -42,14 +51,49 @@ enum {
     MAP_SIZE_MULTIPLIER = 128
 };
 
-gps_data::gps_data (const station &st)
+// Every map GNSS-SDR may publish, after its prefix
+static const char *const MAP_NAMES[] = {
+    ".gps_ref_time",
+    ".gps_utc_model",
+    ".gps_almanac",
+    ".gps_iono",
+    ".gps_ephemeris",
+    ".galileo_utc_model",
+    ".galileo_iono",
+    ".galileo_ephemeris"
+};
+
+gps_data::gps_data (const station &st, const std::string &prefix)
     :
-    shared_name_(shared_name (st)),
+    shared_name_(prefix.empty () ? shared_memory_prefix (st) : prefix),
     name_ (st.get_address ())
 {
 }
 
 
+void gps_data::reopen (const std::string &prefix) {
+    shared_name_ = prefix;
+    ref_time_.reset ();
+    utc_model_.reset ();
+    almanac_.reset ();
+    iono_.reset ();
+    ephemeris_.reset ();
+    galileo_utc_model_.reset ();
+    galileo_iono_.reset ();
+    galileo_ephemeris_.reset ();
+}
+
+void gps_data::remove () {
+    using namespace boost::interprocess;
+
+    reopen (shared_name_);
+    for (size_t i = 0; i < sizeof (MAP_NAMES) / sizeof (MAP_NAMES[0]); i++) {
+        std::string name = shared_name_ + MAP_NAMES[i];
+        shared_memory_object::remove (name.c_str ());
+        named_mutex::remove ((name + "_LOCK").c_str ());
+    }
+}
+
 const std::string &gps_data::name () const {
     return name_;
 }
@@ -99,5 +143,22 @@ gps_data::ephemeris_ptr gps_data::ephemeris () {
     return ephemeris_;
 }
 
+gps_data::galileo_utc_model_ptr gps_data::galileo_utc_model () {
+    open_optional<Galileo_Utc_Model> (shared_name_ + ".galileo_utc_model",
+                                      galileo_utc_model_);
+    return galileo_utc_model_;
+}
+
+gps_data::galileo_iono_ptr gps_data::galileo_iono () {
+    open_optional<Galileo_Iono> (shared_name_ + ".galileo_iono",
+                                 galileo_iono_);
+    return galileo_iono_;
+}
+
+gps_data::galileo_ephemeris_ptr gps_data::galileo_ephemeris () {
+    open_optional<Galileo_Ephemeris> (shared_name_ + ".galileo_ephemeris",
+                                      galileo_ephemeris_);
+    return galileo_ephemeris_;
+}
 
 }
@@ -38,12 +38,29 @@
 #include "gps_iono.h"
 #include "gps_ephemeris.h"
 #include "gps_almanac.h"
+#include "galileo_ephemeris.h"
+#include "galileo_iono.h"
+#include "galileo_utc_model.h"
 
 namespace genesis {
 class station;
 
 struct gps_data {
-   gps_data (const station &st);
+   // prefix is the shared memory prefix GNSS-SDR was given, if it
+   // isn't the station's own (as for a pooled gnss-sdr)
+   gps_data (const station &st, const std::string &prefix = std::string ());
+
+   /*!
+    * \brief Drop the open maps, for a restarted GNSS-SDR publishing
+    * under the given prefix. They're opened again as they're used.
+    */
+   void reopen (const std::string &prefix);
+
+   /*!
+    * \brief Drop the open maps and remove GNSS-SDR's shared memory, once
+    * it has been stopped for good.
+    */
+   void remove ();
 
    typedef concurrent_dictionary <Gps_Ref_Time> ref_time_map;
    typedef boost::shared_ptr <ref_time_map> ref_time_ptr;
@@ -60,6 +77,14 @@ struct gps_data {
    typedef concurrent_dictionary <Gps_Ephemeris> ephemeris_map;
    typedef boost::shared_ptr <ephemeris_map> ephemeris_ptr;
 
+   typedef concurrent_dictionary <Galileo_Utc_Model> galileo_utc_model_map;
+   typedef boost::shared_ptr <galileo_utc_model_map> galileo_utc_model_ptr;
+
+   typedef concurrent_dictionary <Galileo_Iono> galileo_iono_map;
+   typedef boost::shared_ptr <galileo_iono_map> galileo_iono_ptr;
+
+   typedef concurrent_dictionary <Galileo_Ephemeris> galileo_ephemeris_map;
+   typedef boost::shared_ptr <galileo_ephemeris_map> galileo_ephemeris_ptr;
 
    const std::string &name () const;
    ref_time_ptr ref_time ();
@@ -68,6 +93,12 @@ struct gps_data {
    iono_ptr iono ();
    ephemeris_ptr ephemeris ();
 
+   // Galileo E1 data is only there if GNSS-SDR has Galileo
+   // channels; these return null until it is.
+   galileo_utc_model_ptr galileo_utc_model ();
+   galileo_iono_ptr galileo_iono ();
+   galileo_ephemeris_ptr galileo_ephemeris ();
+
 private:
    std::string shared_name_;
    std::string name_;
@@ -76,6 +107,9 @@ private:
    almanac_ptr almanac_;
    iono_ptr iono_;
    ephemeris_ptr ephemeris_;
+   galileo_utc_model_ptr galileo_utc_model_;
+   galileo_iono_ptr galileo_iono_;
+   galileo_ephemeris_ptr galileo_ephemeris_;
 };
 }
 
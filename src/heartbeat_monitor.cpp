@@ -0,0 +1,228 @@
+/*!
+ * \file heartbeat_monitor.cpp
+ * \brief Notices stations that stop sending heartbeats.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "heartbeat_monitor.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "station.hpp"
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <gflags/gflags.h>
+#include <map>
+#include <string>
+#include <vector>
+
+DECLARE_int32 (heartbeat_timeout_ms);
+
+namespace genesis {
+
+namespace detail {
+
+enum {
+   HEARTBEAT_TICK_MS = 250,  // how often the wheel turns
+   REORDER_WINDOW = 16       // heartbeats this far behind are just late
+};
+
+}
+
+struct heartbeat_monitor::impl {
+   // A station sending heartbeats
+   struct beating {
+      station station_;
+      unsigned id_;
+      unsigned sequence_;
+      unsigned long last_;  // tick of its last heartbeat
+      unsigned long due_;   // tick of the slot it's in
+   };
+   typedef std::map <std::string, beating> station_map;   // by address
+   typedef std::vector <std::string> slot;
+
+   impl (boost::asio::io_service &service, expired_function expired)
+      : timer_ (service),
+        expired_ (expired),
+        timeout_ ((FLAGS_heartbeat_timeout_ms +
+                   detail::HEARTBEAT_TICK_MS - 1) /
+                  detail::HEARTBEAT_TICK_MS),
+        now_ (0),
+        ticking_ (false),
+        stopped_ (false)
+      {
+         if (timeout_ < 1) {
+            timeout_ = 1;
+         }
+         // A station is never due more than a timeout ahead
+         wheel_.resize (timeout_ + 1);
+      }
+
+   void schedule (beating &b, unsigned long due) {
+      b.due_ = due;
+      wheel_[due % wheel_.size ()].push_back (b.station_.get_address ());
+   }
+
+   static void start (const boost::shared_ptr <impl> &self) {
+      if (self->ticking_) {
+         return;
+      }
+      self->ticking_ = true;
+      self->timer_.expires_from_now (
+         boost::posix_time::milliseconds (long (detail::HEARTBEAT_TICK_MS)));
+      self->timer_.async_wait (boost::bind (&impl::tick,
+                                            self,
+                                            boost::asio::placeholders::error));
+   }
+
+   static void tick (const boost::shared_ptr <impl> &self,
+                     const boost::system::error_code &ec)
+   {
+      if (ec || self->stopped_) {
+         return;
+      }
+
+      // Only the stations in this slot can have timed out
+      self->now_++;
+      slot due;
+      due.swap (self->wheel_[self->now_ % self->wheel_.size ()]);
+      BOOST_FOREACH (const std::string &address, due) {
+         station_map::iterator it = self->stations_.find (address);
+         if (it == self->stations_.end () || it->second.due_ != self->now_) {
+            // Gone, or since put in another slot
+            continue;
+         }
+         beating &b = it->second;
+         unsigned long deadline = b.last_ + self->timeout_;
+         if (deadline > self->now_) {
+            self->schedule (b, deadline);
+            continue;
+         }
+
+         BOOST_LOG_SEV (self->lg_, warning)
+            << "No heartbeat from " << address << " for "
+            << (self->now_ - b.last_) * detail::HEARTBEAT_TICK_MS / 1000.0
+            << " s.";
+         count_metric ("heartbeat_timeouts");
+         if (self->expired_ (b.station_)) {
+            self->stations_.erase (it);
+         }
+         else {
+            self->schedule (b, self->now_ + self->timeout_);
+         }
+      }
+
+      if (self->stations_.empty ()) {
+         self->ticking_ = false;
+         return;
+      }
+      self->timer_.expires_at (
+         self->timer_.expires_at () +
+         boost::posix_time::milliseconds (long (detail::HEARTBEAT_TICK_MS)));
+      self->timer_.async_wait (boost::bind (&impl::tick,
+                                            self,
+                                            boost::asio::placeholders::error));
+   }
+
+   boost::asio::deadline_timer timer_;
+   expired_function expired_;
+   unsigned long timeout_;  // in ticks
+   unsigned long now_;      // ticks so far
+   std::vector <slot> wheel_;
+   station_map stations_;
+   bool ticking_;
+   bool stopped_;
+   logger lg_;
+};
+
+heartbeat_monitor::heartbeat_monitor (boost::asio::io_service &service,
+                                      expired_function expired)
+   : impl_ (boost::make_shared<impl> (boost::ref (service), expired))
+{
+}
+
+heartbeat_monitor::~heartbeat_monitor () {
+   stop ();
+}
+
+bool heartbeat_monitor::beat (const station &st,
+                              unsigned id,
+                              unsigned sequence)
+{
+   if (impl_->stopped_) {
+      return true;
+   }
+
+   impl::station_map::iterator it =
+      impl_->stations_.find (st.get_address ());
+   if (it == impl_->stations_.end ()) {
+      impl::beating b;
+      b.station_ = st;
+      b.id_ = id;
+      b.sequence_ = sequence;
+      b.last_ = impl_->now_;
+      impl::beating &added = impl_->stations_[st.get_address ()] = b;
+      impl_->schedule (added, impl_->now_ + impl_->timeout_);
+      impl::start (impl_);
+      return true;
+   }
+
+   impl::beating &b = it->second;
+   b.last_ = impl_->now_;
+   b.station_ = st;
+   if (b.id_ != id) {
+      BOOST_LOG_SEV (impl_->lg_, info)
+         << "Station ID at " << st.get_address () << " changed from "
+         << b.id_ << " to " << id << ".";
+      b.id_ = id;
+      b.sequence_ = sequence;
+      return false;
+   }
+
+   // Sequence numbers wrap; a big step back is the station restarting
+   unsigned ahead = sequence - b.sequence_;
+   if (ahead > 1 && ahead <= 0x7fffffffu) {
+      count_metric ("heartbeats_lost", ahead - 1);
+      count_metric ("heartbeats_lost." + st.get_address (), ahead - 1);
+   }
+   if ((ahead > 0 && ahead <= 0x7fffffffu) ||
+       -ahead > unsigned (detail::REORDER_WINDOW))
+   {
+      b.sequence_ = sequence;
+   }
+   return true;
+}
+
+void heartbeat_monitor::stop () {
+   impl_->stopped_ = true;
+   impl_->stations_.clear ();
+   boost::system::error_code ec;
+   impl_->timer_.cancel (ec);
+}
+
+}
@@ -0,0 +1,90 @@
+/*!
+ * \file heartbeat_monitor.hpp
+ * \brief Notices stations that stop sending heartbeats.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_HEARTBEAT_MONITOR_HPP
+#define GENESIS_HEARTBEAT_MONITOR_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace genesis {
+
+class station;
+
+/*!
+ * \brief Keeps track of the stations sending heartbeats, and notices
+ * when one has been silent for --heartbeat_timeout_ms. Stations are
+ * kept on a timer wheel that turns every quarter second, so a heartbeat
+ * costs the same however many stations there are, and a silent station
+ * is noticed at most a tick after its timeout.
+ *
+ * Stations that only send a discovery packet aren't tracked.
+ *
+ * Members must be called on the io_service's thread.
+ */
+class heartbeat_monitor : boost::noncopyable {
+public:
+   /*!
+    * \brief Called for a station that's gone silent.
+    * \returns false to be asked again after another timeout, as for a
+    * station that's still being started.
+    */
+   typedef boost::function <bool (const station &)> expired_function;
+
+   /*!
+    * \brief Create a monitor, with its timer on the io_service.
+    */
+   heartbeat_monitor (boost::asio::io_service &service,
+                      expired_function expired);
+
+   ~heartbeat_monitor ();
+
+   /*!
+    * \brief Note a heartbeat from a station.
+    * \returns false if the station's ID has changed, meaning a different
+    * station has taken its address. The new station is tracked from here.
+    */
+   bool beat (const station &st, unsigned id, unsigned sequence);
+
+   /*!
+    * \brief Stop the timer and forget every station.
+    */
+   void stop ();
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_HEARTBEAT_MONITOR_HPP
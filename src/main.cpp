@@ -29,9 +29,11 @@
 
 #include "log.hpp"
 #include "service.hpp"
+#include "config_template.hpp"
 #include <gflags/gflags.h>
 #include <string>
 #include <boost/filesystem.hpp>
+#include "rtklib.h"
 
 namespace fs = boost::filesystem;
 
@@ -54,6 +56,123 @@ DEFINE_string (listen_address,
                "0.0.0.0",
                "The address to listen to pings from (can be multicast).");
 
+DEFINE_string (solution_format,
+               "",
+               "Also write solutions as text: pos, nmea or empty for none.");
+DEFINE_bool (solution_kml,
+             false,
+             "Convert the text solutions to KML on shutdown.");
+DEFINE_bool (orthometric_height,
+             false,
+             "Write text solutions with heights above the geoid rather than "
+             "the ellipsoid.");
+DEFINE_string (geoid_model,
+               "embedded",
+               "The geoid model for orthometric heights: embedded, egm96, "
+               "egm2008_25, egm2008_10 or gsi2000.");
+DEFINE_string (geoid_file,
+               "",
+               "The geoid model file, if the model is not embedded.");
+DEFINE_string (publish_socket,
+               "/var/run/genesis.solutions.socket",
+               "The domain socket to publish live solutions on "
+               "(empty to disable).");
+
+DEFINE_string (base_positions,
+               "base_positions",
+               "File of surveyed base station positions: a line for each "
+               "base with its address, latitude, longitude (degrees) and "
+               "ellipsoidal height (m).");
+
+DEFINE_string (standby_bases,
+               "",
+               "Comma-separated addresses of base stations to keep as hot "
+               "standbys, used only while no other base is.");
+
+DEFINE_string (nav_cache_file,
+               "nav_cache",
+               "Where to keep broadcast ephemerides between runs "
+               "(empty to disable).");
+
+DEFINE_int32 (max_satellites,
+              0,
+              "Use at most this many satellites in each rover epoch, "
+              "chosen by geometry, signal strength and lock (0 for all).");
+
+DEFINE_double (sat_cache_tolerance,
+               0.01,
+               "Share satellite states between stations whose transmission "
+               "times are within this many seconds (0 to disable).");
+
+DEFINE_int32 (child_log_size_kb,
+              1024,
+              "Start a new gnss-sdr.log for a station when it reaches this "
+              "size (0 for no limit).");
+
+DEFINE_int32 (child_log_rate,
+              50,
+              "Keep at most this many lines a second of gnss-sdr's output "
+              "(0 for no limit).");
+
+DEFINE_int32 (gnss_sdr_pool,
+              0,
+              "Keep this many gnss-sdrs running ahead of time, ready for "
+              "new stations (0 to start one as each station joins).");
+
+DEFINE_int32 (max_concurrent_starts,
+              2,
+              "Launch gnss-sdr for at most this many stations at once.");
+
+DEFINE_double (max_load_per_cpu,
+               1.5,
+               "Refuse new stations while the load average per CPU is above "
+               "this (0 for no limit).");
+
+DEFINE_int32 (min_free_memory_mb,
+              128,
+              "Refuse new stations while less than this much memory (MB) is "
+              "available (0 for no limit).");
+
+DEFINE_int32 (max_restarts,
+              10,
+              "Give up on a station after restarting its gnss-sdr this many "
+              "times in a row (0 to never restart).");
+
+DEFINE_int32 (restart_delay_ms,
+              1000,
+              "Wait this long before restarting a gnss-sdr that exited, "
+              "doubling with each restart in a row.");
+
+DEFINE_int32 (max_restart_delay_ms,
+              60000,
+              "Wait at most this long before restarting a gnss-sdr. One that "
+              "stays up longer has its delay start over.");
+
+DEFINE_double (default_if_bias,
+               0,
+               "The IF bias (Hz) to start a station with until it has been "
+               "calibrated.");
+
+DEFINE_int32 (recalibrate_hours,
+              24,
+              "Calibrate a station again once its calibration is this old "
+              "(0 to never recalibrate).");
+
+DEFINE_double (recalibrate_threshold_hz,
+               100,
+               "Only give gnss-sdr a new IF bias if it has moved by more than "
+               "this.");
+
+DEFINE_string (off_peak_hours,
+               "1-5",
+               "Local hours to recalibrate stations in, such as 1-5 for 1am "
+               "to 5am (empty for any time).");
+
+DEFINE_int32 (heartbeat_timeout_ms,
+              5000,
+              "Reclaim a station that sends heartbeats once it has been "
+              "silent this long (0 to never reclaim).");
+
 #ifdef GENESIS_DEBUG
 #define VERY_VERBOSE true
 #else
@@ -67,13 +186,43 @@ DEFINE_bool (very_verbose,
              VERY_VERBOSE,
              "Very verbose output");
 
-fs::path GNSS_SDR_CONFIG_FILE,
-   FRONT_END_CAL_CONFIG_FILE,
-   GNSS_SDR_EXECUTABLE,
+fs::path GNSS_SDR_EXECUTABLE,
    FRONT_END_CAL_EXECUTABLE;
 
+// Read once; each child's configuration is rendered from these
+genesis::config_template GNSS_SDR_CONFIG,
+   FRONT_END_CAL_CONFIG;
+
 genesis::logger lg;
 
+static void open_geoid (const std::string &model, const std::string &file) {
+    static const struct {
+        const char *name;
+        int model;
+    } models[] = {
+        { "embedded", GEOID_EMBEDDED },
+        { "egm96", GEOID_EGM96_M150 },
+        { "egm2008_25", GEOID_EGM2008_M25 },
+        { "egm2008_10", GEOID_EGM2008_M10 },
+        { "gsi2000", GEOID_GSI2000_M15 }
+    };
+
+    for (size_t i = 0; i < sizeof (models) / sizeof (models[0]); i++) {
+        if (model != models[i].name) {
+            continue;
+        }
+        if (!opengeoid (models[i].model, file.c_str ())) {
+            BOOST_LOG_SEV (lg, genesis::critical)
+               << "Cannot open " << model << " geoid model " << file;
+            ::exit (1);
+        }
+        return;
+    }
+    BOOST_LOG_SEV (lg, genesis::critical)
+       << "Unknown geoid model " << model;
+    ::exit (1);
+}
+
 static void check_path (fs::path &dest,
                         const std::string &path,
                         const std::string &desc)
@@ -92,6 +241,19 @@ static void check_path (fs::path &dest,
        << " for " << desc;
 }
 
+static void load_template (genesis::config_template &dest,
+                           const std::string &path,
+                           const std::string &desc)
+{
+    fs::path file;
+    check_path (file, path, desc);
+    if (!dest.load (file)) {
+        BOOST_LOG_SEV (lg, genesis::critical)
+           << "Cannot read " << desc << " " << file;
+        ::exit (1);
+    }
+}
+
 int main (int argc, char *argv[]) {
   const std::string intro_help
     ("Copyright (C) Anthony Arnold 2015.\n"
@@ -104,13 +266,13 @@ int main (int argc, char *argv[]) {
 
   genesis::init_logging ();
 
-  check_path (GNSS_SDR_CONFIG_FILE,
-              FLAGS_config_file,
-              "gnss-sdr config");
+  load_template (GNSS_SDR_CONFIG,
+                 FLAGS_config_file,
+                 "gnss-sdr config");
 
-  check_path (FRONT_END_CAL_CONFIG_FILE,
-              FLAGS_cal_config_file,
-              "front-end-cal config");
+  load_template (FRONT_END_CAL_CONFIG,
+                 FLAGS_cal_config_file,
+                 "front-end-cal config");
 
   check_path (GNSS_SDR_EXECUTABLE,
               FLAGS_gnss_sdr,
@@ -120,6 +282,12 @@ int main (int argc, char *argv[]) {
               FLAGS_front_end_cal,
               "front-end-cal executable");
 
+  // Geoid for orthometric heights in text solutions
+  open_geoid (FLAGS_geoid_model, FLAGS_geoid_file);
+
+  // Share satellite states between all stations
+  setsatcache (FLAGS_sat_cache_tolerance);
+
   // Start the service
   genesis::service service;
 
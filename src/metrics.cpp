@@ -0,0 +1,125 @@
+/*!
+ * \file metrics.cpp
+ * \brief Counters and timings for measuring Genesis.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "metrics.hpp"
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <map>
+#include <time.h>
+
+namespace genesis {
+
+namespace detail {
+
+struct metric {
+   metric ()
+      : count (0), total (0), min (0), max (0), sampled (false)
+      {
+      }
+
+   long long count;
+   double total;
+   double min;
+   double max;
+   bool sampled; // a statistic rather than a counter
+};
+
+typedef std::map <std::string, metric> metric_map;
+
+static boost::mutex metrics_mutex;
+static metric_map metrics;
+
+static clockid_t to_clockid (scoped_timer::clock_type clock) {
+    return clock == scoped_timer::CPU_CLOCK ?
+       CLOCK_THREAD_CPUTIME_ID : CLOCK_MONOTONIC;
+}
+
+} // namespace detail
+
+void count_metric (const std::string &name, long long n) {
+    boost::mutex::scoped_lock guard (detail::metrics_mutex);
+    detail::metrics[name].count += n;
+}
+
+void record_metric (const std::string &name, double value) {
+    boost::mutex::scoped_lock guard (detail::metrics_mutex);
+    detail::metric &m = detail::metrics[name];
+    if (!m.count) {
+        m.min = m.max = value;
+    }
+    m.count++;
+    m.total += value;
+    m.min = std::min (m.min, value);
+    m.max = std::max (m.max, value);
+    m.sampled = true;
+}
+
+void report_metrics (std::ostream &os) {
+    boost::mutex::scoped_lock guard (detail::metrics_mutex);
+    BOOST_FOREACH (const detail::metric_map::value_type &p, detail::metrics) {
+        const detail::metric &m = p.second;
+        os << p.first << ": ";
+        if (m.sampled) {
+            os << "n=" << m.count
+               << " mean=" << m.total / m.count
+               << " min=" << m.min
+               << " max=" << m.max;
+        }
+        else {
+            os << m.count;
+        }
+        os << '\n';
+    }
+}
+
+scoped_timer::scoped_timer (const std::string &name, clock_type clock)
+    : name_ (name),
+      clock_ (clock)
+{
+    clock_gettime (detail::to_clockid (clock_), &start_);
+}
+
+scoped_timer::~scoped_timer () {
+    record_metric (name_, elapsed ());
+}
+
+double monotonic_ms () {
+    timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+double scoped_timer::elapsed () const {
+    timespec now;
+    clock_gettime (detail::to_clockid (clock_), &now);
+    return (now.tv_sec - start_.tv_sec) * 1e3 +
+       (now.tv_nsec - start_.tv_nsec) / 1e6;
+}
+
+}
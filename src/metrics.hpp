@@ -0,0 +1,85 @@
+/*!
+ * \file metrics.hpp
+ * \brief Counters and timings for measuring Genesis.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_METRICS_HPP
+#define GENESIS_METRICS_HPP
+
+#include <boost/noncopyable.hpp>
+#include <ctime>
+#include <ostream>
+#include <string>
+
+namespace genesis {
+
+/*!
+ * \brief Add to a named counter.
+ */
+void count_metric (const std::string &name, long long n = 1);
+
+/*!
+ * \brief Add a sample to a named statistic.
+ */
+void record_metric (const std::string &name, double value);
+
+/*!
+ * \brief Milliseconds on the monotonic clock, for timing across calls.
+ */
+double monotonic_ms ();
+
+/*!
+ * \brief Write every metric, one per line.
+ */
+void report_metrics (std::ostream &os);
+
+/*!
+ * \brief Records the milliseconds spent in a scope.
+ */
+class scoped_timer : boost::noncopyable {
+public:
+   enum clock_type {
+      WALL_CLOCK, // elapsed time
+      CPU_CLOCK   // time spent running the calling thread
+   };
+
+   explicit scoped_timer (const std::string &name,
+                          clock_type clock = WALL_CLOCK);
+   ~scoped_timer ();
+
+   // Milliseconds since the timer started.
+   double elapsed () const;
+
+private:
+   const std::string name_;
+   const clock_type clock_;
+   timespec start_;
+};
+
+}
+
+#endif // GENESIS_METRICS_HPP
@@ -0,0 +1,265 @@
+/*!
+ * \file nav_cache.cpp
+ * \brief A persisted cache of broadcast navigation data.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "nav_cache.hpp"
+#include "log.hpp"
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include "rtklib_types.hpp"
+
+namespace genesis {
+
+namespace fs = boost::filesystem;
+
+namespace detail {
+
+enum {
+    NAV_SAVE_INTERVAL = 60 // seconds between saving changes
+};
+
+// Copy parameters if the source has any
+static bool take_params (const double *src, double *dest, int n) {
+    bool any = false, same = true;
+    for (int i = 0; i < n; i++) {
+        any = any || src[i] != 0.0;
+        same = same && src[i] == dest[i];
+    }
+    if (!any || same) {
+        return false;
+    }
+    memcpy (dest, src, n * sizeof (double));
+    return true;
+}
+
+static bool empty_params (const double *p, int n) {
+    for (int i = 0; i < n; i++) {
+        if (p[i] != 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace detail
+
+struct nav_cache::impl {
+   typedef boost::mutex::scoped_lock scoped_lock;
+
+   impl (boost::asio::io_service &service, const fs::path &file)
+      : file_ (file),
+        timer_ (service),
+        dirty_ (false),
+        version_ (0),
+        stopped_ (false)
+      {
+      }
+
+   bool save () {
+      if (file_.empty () || !nav_.eph || !snapshot_.eph) {
+         return false;
+      }
+
+      // Only one save at a time; updates just wait for the copy
+      scoped_lock saving (save_mutex_);
+      {
+         scoped_lock guard (mutex_);
+         if (!dirty_) {
+            return true;
+         }
+         memcpy (snapshot_.eph, nav_.eph, MAXSAT * sizeof (eph_t));
+         memcpy (snapshot_.ion_gps, nav_.ion_gps, sizeof (nav_.ion_gps));
+         memcpy (snapshot_.utc_gps, nav_.utc_gps, sizeof (nav_.utc_gps));
+         memcpy (snapshot_.ion_gal, nav_.ion_gal, sizeof (nav_.ion_gal));
+         memcpy (snapshot_.utc_gal, nav_.utc_gal, sizeof (nav_.utc_gal));
+         snapshot_.leaps = nav_.leaps;
+         dirty_ = false;
+      }
+
+      // Write to the side and rename, so a crash never leaves
+      // a partially written cache behind.
+      fs::path tmp = file_;
+      tmp += ".tmp";
+      bool saved = savenav (tmp.c_str (), &snapshot_);
+      if (saved) {
+         boost::system::error_code ec;
+         fs::rename (tmp, file_, ec);
+         saved = !ec;
+      }
+      if (!saved) {
+         scoped_lock guard (mutex_);
+         dirty_ = true;
+         return false;
+      }
+      return true;
+   }
+
+   static void start (const boost::shared_ptr <impl> &self) {
+      self->timer_.expires_from_now (
+         boost::posix_time::seconds (long (detail::NAV_SAVE_INTERVAL)));
+      self->timer_.async_wait (boost::bind (&impl::tick,
+                                            self,
+                                            boost::asio::placeholders::error));
+   }
+
+   static void tick (const boost::shared_ptr <impl> &self,
+                     const boost::system::error_code &ec)
+   {
+      if (ec || self->stopped_) {
+         return;
+      }
+      if (!self->save ()) {
+         BOOST_LOG_SEV (self->lg_, warning)
+            << "Failed to save navigation cache to " << self->file_;
+      }
+      start (self);
+   }
+
+   const fs::path file_;
+   boost::asio::deadline_timer timer_;
+   mutable boost::mutex mutex_;
+   boost::mutex save_mutex_;
+   nav_t nav_;
+   nav_t snapshot_;  // what's being saved, copied from nav_
+   bool dirty_;
+   boost::atomic <unsigned long> version_;
+   bool stopped_;
+   logger lg_;
+};
+
+nav_cache::nav_cache (boost::asio::io_service &service, const fs::path &file)
+    : impl_ (boost::make_shared<impl> (boost::ref (service), file))
+{
+    if (file.empty () || !impl_->nav_.eph) {
+        return;
+    }
+    impl::start (impl_);
+
+    if (readnav (file.c_str (), &impl_->nav_)) {
+        int n = 0;
+        for (int i = 0; i < MAXSAT; i++) {
+            if (impl_->nav_.eph[i].sat) {
+                n++;
+            }
+        }
+        BOOST_LOG_SEV (impl_->lg_, debug)
+           << "Loaded " << n << " cached ephemerides from " << file;
+    }
+}
+
+nav_cache::~nav_cache () {
+    impl_->stopped_ = true;
+    impl_->timer_.cancel ();
+    if (!impl_->file_.empty () && !impl_->save ()) {
+        BOOST_LOG_SEV (impl_->lg_, warning)
+           << "Failed to save navigation cache to " << impl_->file_;
+    }
+}
+
+unsigned long nav_cache::version () const {
+    return impl_->version_;
+}
+
+void nav_cache::seed (nav_t &nav) const {
+    if (!nav.eph || !impl_->nav_.eph) {
+        return;
+    }
+
+    impl::scoped_lock guard (impl_->mutex_);
+    const nav_t &cached = impl_->nav_;
+    bool seeded = false;
+    for (int i = 0; i < MAXSAT; i++) {
+        if (!nav.eph[i].sat && cached.eph[i].sat) {
+            nav.eph[i] = cached.eph[i];
+            seeded = true;
+        }
+    }
+    if (seeded) {
+        freenavidx (&nav);
+    }
+    if (detail::empty_params (nav.ion_gps, 8)) {
+        memcpy (nav.ion_gps, cached.ion_gps, sizeof (nav.ion_gps));
+    }
+    if (detail::empty_params (nav.utc_gps, 4)) {
+        memcpy (nav.utc_gps, cached.utc_gps, sizeof (nav.utc_gps));
+        nav.leaps = cached.leaps;
+    }
+    if (detail::empty_params (nav.ion_gal, 4)) {
+        memcpy (nav.ion_gal, cached.ion_gal, sizeof (nav.ion_gal));
+    }
+    if (detail::empty_params (nav.utc_gal, 4)) {
+        memcpy (nav.utc_gal, cached.utc_gal, sizeof (nav.utc_gal));
+    }
+}
+
+void nav_cache::update (const nav_t &nav) {
+    if (!nav.eph || !impl_->nav_.eph) {
+        return;
+    }
+
+    impl::scoped_lock guard (impl_->mutex_);
+    nav_t &cached = impl_->nav_;
+    bool changed = false;
+    for (int i = 0; i < MAXSAT; i++) {
+        const eph_t &e = nav.eph[i];
+        eph_t &c = cached.eph[i];
+        if (!e.sat) {
+            continue;
+        }
+        if (c.sat && (c.iode == e.iode && c.toe.time == e.toe.time)) {
+            continue; // already have it
+        }
+        if (c.sat && timediff (e.toe, c.toe) < 0.0) {
+            continue; // older than the cached one
+        }
+        c = e;
+        changed = true;
+    }
+    changed = detail::take_params (nav.ion_gps, cached.ion_gps, 8) || changed;
+    if (detail::take_params (nav.utc_gps, cached.utc_gps, 4)) {
+        cached.leaps = nav.leaps;
+        changed = true;
+    }
+    changed = detail::take_params (nav.ion_gal, cached.ion_gal, 4) || changed;
+    changed = detail::take_params (nav.utc_gal, cached.utc_gal, 4) || changed;
+
+    if (changed) {
+        impl_->dirty_ = true;
+        impl_->version_++;
+    }
+}
+
+bool nav_cache::save () {
+    return impl_->save ();
+}
+
+}
@@ -0,0 +1,94 @@
+/*!
+ * \file nav_cache.hpp
+ * \brief A persisted cache of broadcast navigation data.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_NAV_CACHE_HPP
+#define GENESIS_NAV_CACHE_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace genesis {
+
+struct nav_t;
+
+/*!
+ * \brief Keeps the latest ephemeris of every satellite, along with the
+ * GPS and Galileo ionospheric and UTC parameters, shared by all stations
+ * and saved to disk. Stations are seeded from the cache so they can
+ * position without waiting for GNSS-SDR to decode a full set of subframes.
+ *
+ * Changes are saved periodically from the io_service, never from the
+ * threads updating the cache. All members are safe to call from any thread.
+ */
+class nav_cache : boost::noncopyable {
+public:
+   /*!
+    * \brief Create the cache, loading it from file if it exists.
+    * An empty path keeps the cache in memory only.
+    */
+   nav_cache (boost::asio::io_service &service,
+              const boost::filesystem::path &file);
+
+   // Saves any changes.
+   ~nav_cache ();
+
+   /*!
+    * \brief The number of times the cache has taken something new.
+    * Cheap; use it to skip seeding when nothing has changed.
+    */
+   unsigned long version () const;
+
+   /*!
+    * \brief Fill in anything missing from the navigation data
+    * with cached entries.
+    */
+   void seed (nav_t &nav) const;
+
+   /*!
+    * \brief Take anything newer than the cached entries from the
+    * navigation data. Changes are saved periodically.
+    */
+   void update (const nav_t &nav);
+
+   /*!
+    * \brief Save any changes now.
+    * \returns true if the cache is saved.
+    */
+   bool save ();
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_NAV_CACHE_HPP
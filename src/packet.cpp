@@ -35,7 +35,14 @@ namespace genesis {
 
 using namespace boost::asio::detail::socket_ops;
 
-void packet::unpack_impl (const char *pkt) {
+// A 32 bit value in network byte order
+static unsigned unpack_long (const char *pkt) {
+    unsigned l;
+    std::memcpy (&l, pkt, sizeof (l));
+    return network_to_host_long (l);
+}
+
+void packet::unpack_impl (const char *pkt, size_t length) {
     // unpack the port number
     port_ = *reinterpret_cast <const unsigned short *> (&pkt[0]);
     port_ = network_to_host_short (port_);
@@ -48,6 +55,16 @@ void packet::unpack_impl (const char *pkt) {
     {
         type_ = station::STATION_TYPE_UNKNOWN;
     }
+
+    version_ = DISCOVERY_VERSION;
+    id_ = sequence_ = 0;
+    if (length >= HEARTBEAT_DATA_SIZE &&
+        static_cast<unsigned char> (pkt[VERSION_OFFSET]) >= HEARTBEAT_VERSION)
+    {
+        version_ = static_cast<unsigned char> (pkt[VERSION_OFFSET]);
+        id_ = unpack_long (&pkt[ID_OFFSET]);
+        sequence_ = unpack_long (&pkt[SEQUENCE_OFFSET]);
+    }
 }
 
 
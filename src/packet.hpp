@@ -38,6 +38,11 @@ namespace genesis {
 
 /*!
  * \brief The information contained in a UDP packet received from a client.
+ *
+ * The first six bytes are the port and the station type. A discovery
+ * packet is only those; a heartbeat goes on with a version, a
+ * reserved byte, the station's ID and a sequence number, all in
+ * network byte order. Later versions only add to the end.
  */
 struct packet {
    typedef genesis::station::station_type station_type;
@@ -45,25 +50,48 @@ struct packet {
    enum {
        PORT_SIZE = 2,
        TYPE_SIZE = 4,
-       FIXED_DATA_SIZE = PORT_SIZE + TYPE_SIZE
+       FIXED_DATA_SIZE = PORT_SIZE + TYPE_SIZE,
+       VERSION_OFFSET = FIXED_DATA_SIZE,
+       ID_OFFSET = VERSION_OFFSET + 2,
+       SEQUENCE_OFFSET = ID_OFFSET + 4,
+       HEARTBEAT_DATA_SIZE = SEQUENCE_OFFSET + 4
+   };
+
+   enum {
+       DISCOVERY_VERSION = 0,
+       HEARTBEAT_VERSION = 1
    };
 
    inline packet ()
-       : type_ (genesis::station::STATION_TYPE_UNKNOWN)
+       : type_ (genesis::station::STATION_TYPE_UNKNOWN),
+         version_ (DISCOVERY_VERSION),
+         id_ (0),
+         sequence_ (0)
       {
       }
 
    template <size_t N>
    void unpack (char (&pkt)[N]) {
        BOOST_STATIC_ASSERT (N == FIXED_DATA_SIZE);
-       unpack_impl (pkt);
+       unpack_impl (pkt, N);
    }
 
 
    template <size_t N>
    void unpack (const boost::array<char, N> &pkt) {
        BOOST_STATIC_ASSERT (N == FIXED_DATA_SIZE);
-       unpack_impl (&pkt[0]);
+       unpack_impl (&pkt[0], N);
+   }
+
+   /*!
+    * \brief Unpack the first length bytes of a buffer, which must be at
+    * least FIXED_DATA_SIZE. A packet too short for its version is taken
+    * as a discovery packet.
+    */
+   template <size_t N>
+   void unpack (const boost::array<char, N> &pkt, size_t length) {
+       BOOST_STATIC_ASSERT (N >= HEARTBEAT_DATA_SIZE);
+       unpack_impl (&pkt[0], length);
    }
 
    inline unsigned short get_port () const {
@@ -74,12 +102,34 @@ struct packet {
        return type_;
    }
 
+   // DISCOVERY_VERSION for a discovery packet
+   inline unsigned get_version () const {
+       return version_;
+   }
+
+   inline bool is_heartbeat () const {
+       return version_ >= HEARTBEAT_VERSION;
+   }
+
+   // The ID the station gives itself; heartbeats only
+   inline unsigned get_station_id () const {
+       return id_;
+   }
+
+   // Counts up with each heartbeat a station sends
+   inline unsigned get_sequence () const {
+       return sequence_;
+   }
+
 private:
    unsigned short port_;
    station_type type_;
+   unsigned version_;
+   unsigned id_;
+   unsigned sequence_;
 
 private:
-   void unpack_impl (const char *pkt);
+   void unpack_impl (const char *pkt, size_t length);
 };
 
 inline station make_station (const packet &pkt,
@@ -28,261 +28,430 @@
  */
 
 #include <map>
+#include <cmath>
 #include <algorithm>
+#include <boost/cstdint.hpp>
 #include <boost/foreach.hpp>
 #include <boost/range.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/move/core.hpp>
 #include "position.hpp"
-#include "rtklib.h"
 #include "log.hpp"
+#include "metrics.hpp"
 #include "gps_data.hpp"
 #include "client_controller.hpp"
-#include <boost/date_time/posix_time/posix_time_types.hpp>
-#include <boost/tuple/tuple.hpp>
+#include "solution.hpp"
+#include "solution_handler.hpp"
+#include "nav_cache.hpp"
+#include <gflags/gflags.h>
+#include "rtklib_types.hpp"
+
+DECLARE_int32 (max_satellites);
 
 #define TWO_PI 6.28318530718
 
 namespace genesis {
 
-struct rtk_t : ::rtk_t {};
+/*!
+ * \brief Scratch space for converting an epoch of observables: a slot
+ * for each satellite number, a bitmap of the slots filled, and the
+ * observations in the order RTKLIB wants them. It's kept between
+ * epochs so that converting doesn't allocate.
+ */
+struct obs_table {
+   enum {
+      WORDS = MAXSAT / 64 + 1
+   };
+
+   obsd_t slot[MAXSAT + 1];
+   boost::uint64_t present[WORDS];
+   std::vector <obsd_t> obs;
+
+   obs_table () {
+      memset (present, 0, sizeof (present));
+      obs.reserve (2 * MAXSAT);
+   }
+};
 
 namespace detail {
 
 // convert to GPS time
 void to_gtime_t (double gps_t, int week, gtime_t &out) {
-    // convert to time since gps rollover
-    double ms = (gps_t + 604800 * static_cast<double>(week % 1024)) * 1000;
-
-    boost::posix_time::time_duration t = boost::posix_time::millisec(ms);
+    // convert to time since gps rollover, keeping the whole seconds
+    // separate so the fraction isn't rounded by the week offset
+    double whole = std::floor (gps_t);
+    out.time = static_cast<time_t> (604800) * (week % 1024) +
+       static_cast<time_t> (whole);
+    out.sec = gps_t - whole;
+}
 
-    out.time = t.total_seconds ();
-    out.sec = t.fractional_seconds ();
+// RTKLIB satellite number of an observable, or 0 if it isn't used
+int to_sat (const gnss_sdr_data &data) {
+    switch (data.System) {
+    case 'G':
+        return satno (SYS_GPS, data.PRN);
+    case 'E':
+        return satno (SYS_GAL, data.PRN);
+    }
+    return 0;
 }
 
 // Convert observables
 void get_obs (const std::vector <gnss_sdr_data> &observables,
               bool base,
               const Gps_Ref_Time &ref_time,
-              std::vector <obsd_t> &out)
+              obs_table &table)
 {
-    std::map <unsigned int, obsd_t> rtkobs;
-    typedef std::map<unsigned int, obsd_t>::value_type obs_pair;
+    gtime_t time;
+    to_gtime_t (ref_time.d_TOW, ref_time.d_Week, time);
 
     BOOST_FOREACH (const gnss_sdr_data &data, observables) {
+        if (!data.Flag_valid_pseudorange || !data.Flag_valid_tracking) {
+            continue;
+        }
+        int sat = to_sat (data);
+        if (!sat) {
+            continue;
+        }
 
         // Convert the GNSS-SDR observable data to the RTKLIB
         // observable o
-        obsd_t &o = rtkobs[data.PRN];
-        to_gtime_t (ref_time.d_TOW, ref_time.d_Week, o.time);
-        o.sat = (unsigned char)data.PRN;
+        obsd_t &o = table.slot[sat];
+        memset (&o, 0, sizeof (o));
+        o.time = time;
+        o.sat = (unsigned char)sat;
         o.rcv = base ? 2 : 1;
-        o.code [0] = CODE_L1C;
+        o.code [0] = data.System == 'E' ? CODE_L1B : CODE_L1C;
         o.L[0] = data.Carrier_phase_rads / TWO_PI; // radians to cycles
         o.P[0] = data.Pseudorange_m;
         o.D[0] = data.Carrier_Doppler_hz;
+        o.SNR[0] = (unsigned char)(std::max (0.0, std::min (data.CN0_dB_hz, 63.0)) * 4.0);
+        table.present[sat / 64] |=
+           static_cast<boost::uint64_t> (1) << (sat % 64);
     }
 
-    BOOST_FOREACH (const obs_pair pair, rtkobs) {
-        out.push_back (pair.second);
+    // Gather in satellite order
+    for (int i = 0; i < obs_table::WORDS; i++) {
+        boost::uint64_t bits = table.present[i];
+        for (int sat = i * 64; bits; sat++, bits >>= 1) {
+            if (bits & 1) {
+                table.obs.push_back (table.slot[sat]);
+            }
+        }
+        table.present[i] = 0;
     }
 }
 
-// Convert cartesion coordinates (x,y,z) to geographical (lat,long,height)
-// Uses World Geodetic System 1984
-boost::tuple <double, double, double> to_geo (double X, double Y, double Z) {
-    // From GNSS-SDR (gps_l1_ca_ls_pvt.cc)
-    const double a = 6378137.0;
-    const double f = 1.0 / 298.257223563;
-
-    double lambda  = atan2(Y,X);
-    double ex2 = (2.0 - f) * f / ((1.0 - f) * (1.0 - f));
-    double c = a * sqrt(1.0 + ex2);
-    double phi = atan(Z / ((sqrt(X * X + Y * Y) * (1.0 - (2.0 - f)) * f)));
-
-    double h = 0.1;
-    double oldh = 0.0;
-    double N;
-    int iterations = 0;
-    do
+// Convert a GNSS-SDR ephemeris to an RTKLIB ephemeris
+void to_eph (const Gps_Ephemeris &dat, eph_t &eph) {
+    memset (&eph, 0, sizeof (eph));
+    eph.sat = dat.i_satellite_PRN;
+    eph.iodc = dat.d_IODC;
+    eph.iode = dat.d_IODE_SF2; // GNSS-SDR validates this
+    eph.sva = dat.i_SV_accuracy;
+    eph.svh = dat.i_SV_health;
+    eph.week = dat.i_GPS_week;
+    eph.code = dat.i_code_on_L2;
+    eph.flag = (int)dat.b_L2_P_data_flag;
+    to_gtime_t (dat.d_Toe, dat.i_GPS_week, eph.toe);
+    to_gtime_t (dat.d_Toc, dat.i_GPS_week, eph.toc);
+
+    // correct clock
+    double dt =  dat.d_TOW - dat.d_Toc;
+    static const double half_week = 302400;     // seconds
+    if (dt > half_week)
     {
-        oldh = h;
-        N = c / sqrt(1 + ex2 * (cos(phi) * cos(phi)));
-        phi = atan(Z / ((sqrt(X*X + Y*Y) * (1.0 - (2.0 -f) * f * N / (N + h) ))));
-        h = sqrt(X * X + Y * Y) / cos(phi) - N;
-        iterations = iterations + 1;
-        if (iterations > 100)
-        {
-            break;
+        dt = dt - 2 * half_week;
+    }
+    else if (dt < -half_week)
+    {
+        dt = dt + 2 * half_week;
+    }
+    double corr =
+       (dat.d_A_f2 * dt + dat.d_A_f1) * dt + dat.d_A_f0 + dat.d_dtr;
+    corr = dat.d_TOW - corr;
+    to_gtime_t (corr, dat.i_GPS_week, eph.ttr);
+
+    // Orbital parameters
+    eph.A = (dat.d_sqrt_A * dat.d_sqrt_A);
+    eph.e = dat.d_e_eccentricity;
+    eph.i0 = dat.d_i_0;
+    eph.OMG0 = dat.d_OMEGA0;
+    eph.omg = dat.d_OMEGA;
+    eph.M0 = dat.d_M_0;
+    eph.deln = dat.d_Delta_n;
+    eph.OMGd = dat.d_OMEGA_DOT;
+    eph.idot = dat.d_IDOT;
+
+    eph.crc = dat.d_Crc;
+    eph.cic = dat.d_Cic;
+    eph.cis = dat.d_Cis;
+    eph.cus = dat.d_Cus;
+    eph.crs = dat.d_Crs;
+    eph.cuc = dat.d_Cuc;
+
+    eph.toes = dat.d_TOW;
+    eph.fit = dat.b_fit_interval_flag;
+    eph.f0 = dat.d_A_f0;
+    eph.f1 = dat.d_A_f1;
+    eph.f2 = dat.d_A_f2;
+
+    eph.tgd[0] = dat.d_TGD;
+}
+
+// Convert a GNSS-SDR Galileo ephemeris to an RTKLIB ephemeris
+void to_eph (const Galileo_Ephemeris &dat, eph_t &eph) {
+    memset (&eph, 0, sizeof (eph));
+    eph.sat = satno (SYS_GAL, dat.i_satellite_PRN);
+    eph.iode = eph.iodc = dat.IOD_ephemeris;
+    eph.sva = (int)dat.SISA_3;
+    eph.svh = ((int)dat.E5b_HS_5 << 7) | ((int)dat.E5b_DVS_5 << 6) |
+       ((int)dat.E1B_HS_5 << 1) | (int)dat.E1B_DVS_5;
+    eph.code = 1 | (1 << 9); // I/NAV E1-B, clock for E5b,E1
+
+    // GST weeks start at GPS week 1024, so they are already
+    // weeks since the rollover
+    int week = (int)dat.WN_5;
+    eph.week = week + 1024;
+    to_gtime_t (dat.t0e_1, week, eph.toe);
+    to_gtime_t (dat.t0c_4, week, eph.toc);
+    to_gtime_t (dat.TOW_5, week, eph.ttr);
+
+    // Orbital parameters
+    eph.A = dat.A_1 * dat.A_1;
+    eph.e = dat.e_1;
+    eph.i0 = dat.i_0_2;
+    eph.OMG0 = dat.OMEGA_0_2;
+    eph.omg = dat.omega_2;
+    eph.M0 = dat.M0_1;
+    eph.deln = dat.delta_n_3;
+    eph.OMGd = dat.OMEGA_dot_3;
+    eph.idot = dat.iDot_2;
+
+    eph.crc = dat.C_rc_3;
+    eph.cic = dat.C_ic_4;
+    eph.cis = dat.C_is_4;
+    eph.cus = dat.C_us_3;
+    eph.crs = dat.C_rs_3;
+    eph.cuc = dat.C_uc_3;
+
+    eph.toes = dat.t0e_1;
+    eph.f0 = dat.af0_4;
+    eph.f1 = dat.af1_4;
+    eph.f2 = dat.af2_4;
+
+    eph.tgd[0] = dat.BGD_E1E5a_5;
+    eph.tgd[1] = dat.BGD_E1E5b_5;
+}
+
+// Replace a satellite's ephemeris if this one is new
+bool take_eph (const eph_t &eph, ::nav_t &nav) {
+    eph_t &current = nav.eph[eph.sat - 1];
+    if (current.sat == eph.sat && current.iode == eph.iode &&
+        current.toe.time == eph.toe.time)
+    {
+        return false;
+    }
+    current = eph;
+    return true;
+}
+
+bool no_params (const double *p, int n) {
+    for (int i = 0; i < n; i++) {
+        if (p[i] != 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether any observed satellite lacks an ephemeris, or the
+// ionospheric or UTC parameters it needs are missing
+bool missing_nav (const std::vector <obsd_t> &obs, const ::nav_t &nav) {
+    bool galileo = false;
+    for (size_t i = 0; i < obs.size (); i++) {
+        if (!nav.eph[obs[i].sat - 1].sat) {
+            return true;
+        }
+        galileo = galileo || satsys (obs[i].sat, 0) == SYS_GAL;
+    }
+    if (no_params (nav.ion_gps, 8) || no_params (nav.utc_gps, 4)) {
+        return true;
+    }
+    return galileo && (no_params (nav.ion_gal, 4) ||
+                       no_params (nav.utc_gal, 4));
+}
+
+// Convert an RTKLIB solution to a solution record
+void to_record (const sol_t &sol, solution_record &rec) {
+    memset (&rec, 0, sizeof (rec));
+    rec.time = sol.time.time;
+    rec.sec = sol.time.sec;
+    for (int i = 0; i < 3; i++) {
+        rec.rr[i] = sol.rr[i];
+    }
+    for (int i = 0; i < 6; i++) {
+        rec.qr[i] = sol.qr[i];
+    }
+    rec.stat = sol.stat;
+    rec.ns = sol.ns;
+    rec.ratio = sol.ratio;
+    rec.age = sol.age;
+}
+
+// L1 code noise of one receiver in a single epoch (cycles). An ambiguity
+// carried over to another base is moved by one epoch of code on both
+// bases, so it is uncertain by this much twice over.
+static const double BASE_CHANGE_CODE_STD = 15.0;
+
+// Epochs an ambiguity carried over to another base is kept out of
+// ambiguity resolution, while the filter pulls it back in
+static const int BASE_CHANGE_HOLD = 10;
+
+// How fast the old base's phase-code offsets go stale (cycles/s). They
+// drift with twice the ionospheric delay and wander with multipath, so
+// offsets from a failed base's last epoch are less certain the older
+// they are.
+static const double BASE_CHANGE_DRIFT = 1.0;
+
+// Ambiguities are never carried over from observables older than this (s)
+static const double BASE_CHANGE_MAX_AGE = 10.0;
+
+// Phase-code offset of an observable (cycles)
+static double phase_code (const gnss_sdr_data &data, int sat) {
+    return data.Carrier_phase_rads / TWO_PI -
+       data.Pseudorange_m / satwavelen (sat, 0, 0);
+}
+
+// Move the ambiguities in the filter from one base to another by the
+// difference between the bases' phase-code offsets, the old base's
+// being age seconds older. They are held out of ambiguity resolution
+// until they converge again; those not seen by both bases are reset.
+// Returns the number of ambiguities kept.
+int change_base (const std::vector <gnss_sdr_data> &from,
+                 const std::vector <gnss_sdr_data> &to,
+                 double age,
+                 ::rtk_t &rtk)
+{
+    std::map <int, double> offset;
+    BOOST_FOREACH (const gnss_sdr_data &data, from) {
+        int sat = to_sat (data);
+        if (sat && data.Flag_valid_pseudorange && data.Flag_valid_tracking) {
+            offset[sat] = phase_code (data, sat);
         }
     }
-    while (std::abs(h - oldh) > 1.0e-12);
 
-    double lat = phi * 180.0 / GPS_PI;
-    double lon = lambda * 180.0 / GPS_PI;
+    std::vector <double> shift (MAXSAT, 0.0);
+    std::vector <int> valid (MAXSAT, 0);
+    BOOST_FOREACH (const gnss_sdr_data &data, to) {
+        int sat = to_sat (data);
+        if (offset.count (sat) && data.Flag_valid_pseudorange &&
+            data.Flag_valid_tracking)
+        {
+            shift[sat - 1] = offset[sat] - phase_code (data, sat);
+            valid[sat - 1] = 1;
+        }
+    }
 
-    return boost::make_tuple (lat, lon, h);
+    double var = 2.0 * BASE_CHANGE_CODE_STD * BASE_CHANGE_CODE_STD +
+       BASE_CHANGE_DRIFT * BASE_CHANGE_DRIFT * age * age;
+    return rtkchgbase (&rtk, &shift[0], &valid[0], var, BASE_CHANGE_HOLD);
 }
 
 } // namespace detail
 
 
-position::position (controller_ptr controller, gps_data_ptr gps)
-    : controller_ (controller), gps_data_ (gps), rtk_(new rtk_t)
+position::position (controller_ptr controller,
+                    gps_data_ptr gps,
+                    solution_handler *handler,
+                    nav_cache_ptr cache)
+    : controller_ (controller),
+      gps_data_ (gps),
+      handler_ (handler),
+      rtk_(new rtk_t),
+      base_epoch_ (0),
+      base_lost_ (false),
+      failover_start_ (0),
+      nav_ (new nav_t),
+      nav_cache_ (cache),
+      nav_version_ (0),
+      obs_ (new obs_table)
 {
     prcopt_t options = prcopt_default;
 
     // TODO: Allow more options
-    options.mode = PMODE_FIXED; // Fixed base station
-    options.nf = 1; // GPS L1
+    options.mode = PMODE_KINEMA; // Rover relative to a surveyed base
+    options.nf = 1; // GPS L1, Galileo E1
+    options.navsys = SYS_GPS | SYS_GAL;
+    options.maxsat = FLAGS_max_satellites;
 
     rtkinit (rtk_.get (), &options);
+
+    // Start from the shared navigation data instead of waiting
+    // for GNSS-SDR to decode it
+    if (nav_cache_) {
+        nav_version_ = nav_cache_->version ();
+        nav_cache_->seed (*nav_);
+    }
 }
 
 position::~position () {
     rtkfree (rtk_.get ());
 }
 
-position::error_type position::rtk_position (
-    const std::vector <gnss_sdr_data> &observables)
-{
-    if (!controller_->has_base ()) {
-        return make_error_condition (no_base_station);
-    }
-
-    // Copy GNSS-SDR Observables to RTKLIB observables (observations)
-    // get_obs pushes in PRN order
-    // rtklib requires in order of receiver, followed by satellite
-
-    // BASE STATION OBSERVABLES
-    std::vector <obsd_t> observations;
-    Gps_Ref_Time ref_time;
-    controller_->base_ref_time ()->read (0, ref_time);
-    const std::vector <gnss_sdr_data> &base_observables =
-       controller_->base_observables ();
-
-    detail::get_obs (base_observables,
-                     true,
-                     ref_time,
-                     observations);
-
-    // ROVER OBSERVABLES
-    gps_data_->ref_time()->read (0, ref_time);
-    detail::get_obs (observables, false, ref_time, observations);
-
-    // Set up navigation data
-    nav_t nav;
-    memset (&nav, 0, sizeof (nav));
+void position::update_navigation () {
+    bool changed = false;
 
-    // Convert GNSS-SDR ephemeris to RTKLIB ephemeris
-    std::vector <eph_t> ephemeris;
+    // Convert GNSS-SDR ephemeris to RTKLIB ephemeris. A satellite's
+    // entry is only replaced when a new ephemeris has been decoded.
     std::map <int, Gps_Ephemeris> ephms =
        gps_data_->ephemeris()->get_map_copy ();
 
     typedef  std::map <int, Gps_Ephemeris>::value_type eph_pair;
     BOOST_FOREACH (const eph_pair &e, ephms) {
-        eph_t eph;
-        const Gps_Ephemeris &dat = e.second;
-
-        eph.sat = dat.i_satellite_PRN;
-        eph.iodc = dat.d_IODC;
-        eph.iode = dat.d_IODE_SF2; // GNSS-SDR validates this
-        eph.sva = dat.i_SV_accuracy;
-        eph.svh = dat.i_SV_health;
-        eph.week = dat.i_GPS_week;
-        eph.code = dat.i_code_on_L2;
-        eph.flag = (int)dat.b_L2_P_data_flag;
-        detail::to_gtime_t (dat.d_Toe, dat.i_GPS_week, eph.toe);
-        detail::to_gtime_t (dat.d_Toc, dat.i_GPS_week, eph.toc);
-
-        // correct clock
-        double dt =  dat.d_TOW - dat.d_Toc;
-        static const double half_week = 302400;     // seconds
-        if (dt > half_week)
-        {
-            dt = dt - 2 * half_week;
+        int sat = satno (SYS_GPS, e.second.i_satellite_PRN);
+        if (!sat) {
+            continue;
         }
-        else if (dt < -half_week)
-        {
-            dt = dt + 2 * half_week;
+
+        eph_t eph;
+        detail::to_eph (e.second, eph);
+        changed = detail::take_eph (eph, *nav_) || changed;
+    }
+
+    gps_data::galileo_ephemeris_ptr gal = gps_data_->galileo_ephemeris ();
+    if (gal) {
+        std::map <int, Galileo_Ephemeris> gal_ephms = gal->get_map_copy ();
+
+        typedef std::map <int, Galileo_Ephemeris>::value_type gal_eph_pair;
+        BOOST_FOREACH (const gal_eph_pair &e, gal_ephms) {
+            if (!e.second.flag_all_ephemeris ||
+                !satno (SYS_GAL, e.second.i_satellite_PRN))
+            {
+                continue;
+            }
+
+            eph_t eph;
+            detail::to_eph (e.second, eph);
+            changed = detail::take_eph (eph, *nav_) || changed;
         }
-        double corr =
-           (dat.d_A_f2 * dt + dat.d_A_f1) * dt + dat.d_A_f0 + dat.d_dtr;
-        corr = dat.d_TOW - corr;
-        detail::to_gtime_t (corr, dat.i_GPS_week, eph.ttr);
-
-        // Orbital parameters
-        eph.A = (dat.d_sqrt_A * dat.d_sqrt_A);
-        eph.e = dat.d_e_eccentricity;
-        eph.i0 = dat.d_i_0;
-        eph.OMG0 = dat.d_OMEGA0;
-        eph.omg = dat.d_OMEGA;
-        eph.M0 = dat.d_M_0;
-        eph.deln = dat.d_Delta_n;
-        eph.OMGd = dat.d_OMEGA_DOT;
-        eph.idot = dat.d_IDOT;
-
-        eph.crc = dat.d_Crc;
-        eph.cic = dat.d_Cic;
-        eph.cis = dat.d_Cis;
-        eph.cus = dat.d_Cus;
-        eph.crs = dat.d_Crs;
-        eph.cuc = dat.d_Cuc;
-
-        eph.toes = dat.d_TOW;
-        eph.fit = dat.b_fit_interval_flag;
-        eph.f0 = dat.d_A_f0;
-        eph.f1 = dat.d_A_f1;
-        eph.f2 = dat.d_A_f2;
-
-        eph.tgd[0] = dat.d_TGD;
-
-        ephemeris.emplace_back (boost::move (eph));
-    }
-    nav.eph = &ephemeris[0];
-    nav.n = nav.nmax = ephemeris.size ();
-
-    // Convert GNSS-SDR almanac objects to RTKLIB almanacs
-    std::vector <alm_t> almanac;
-    std::map <int, Gps_Almanac> alms = gps_data_->almanac()->get_map_copy ();
-    typedef  std::map <int, Gps_Almanac>::value_type alm_pair;
-    BOOST_FOREACH (const alm_pair &a, alms) {
-        alm_t alm;
-        const Gps_Almanac &dat = a.second;
-
-        alm.sat = dat.i_satellite_PRN;
-        alm.svh = dat.i_SV_health;
-        alm.svconf = 0; // fixme
-        alm.week = ref_time.d_Week;
-        alm.toa.time = dat.d_Toa;
-        alm.toa.sec = (dat.d_Toa - (time_t)dat.d_Toa) / 1000000.0;
-        detail::to_gtime_t (dat.d_Toa, ref_time.d_Week, alm.toa);
-        alm.A = (dat.d_sqrt_A * dat.d_sqrt_A);
-        alm.e = dat.d_e_eccentricity;
-        alm.i0 = 0; // fixme
-        alm.OMG0 = dat.d_OMEGA0;
-        alm.omg = dat.d_OMEGA;
-        alm.M0 = dat.d_M_0;
-        alm.OMGd = dat.d_OMEGA_DOT;
-        alm.toas = dat.d_Toa;
-        alm.f0 = dat.d_A_f0;
-        alm.f1 = dat.d_A_f1;
-
-        almanac.emplace_back (boost::move (alm));
-    }
-    nav.alm = &almanac[0];
-    nav.na = nav.namax = almanac.size ();
+    }
+    if (changed) {
+        freenavidx (nav_.get ()); // reindex the replaced ephemerides
+    }
 
     // Convert UTC time params from GNSS-SDR to RTKLIB
     Gps_Utc_Model utc;
     if (gps_data_->utc_model()->read (0, utc)) {
         if (utc.valid) {
-            nav.utc_gps[0] = utc.d_A0;
-            nav.utc_gps[1] = utc.d_A1;
-            nav.utc_gps[2] = utc.d_t_OT;
-            nav.utc_gps[3] = utc.i_WN_T;
-            nav.leaps = utc.d_DeltaT_LS;
+            double params[4] = {
+                utc.d_A0, utc.d_A1, utc.d_t_OT, (double)utc.i_WN_T
+            };
+            if (memcmp (nav_->utc_gps, params, sizeof (params))) {
+                memcpy (nav_->utc_gps, params, sizeof (params));
+                changed = true;
+            }
+            nav_->leaps = utc.d_DeltaT_LS;
         }
     }
 
@@ -290,39 +459,206 @@ position::error_type position::rtk_position (
     Gps_Iono iono;
     if (gps_data_->iono()->read (0, iono)) {
         if (iono.valid) {
-            nav.ion_gps[0] = iono.d_alpha0;
-            nav.ion_gps[1] = iono.d_alpha1;
-            nav.ion_gps[2] = iono.d_alpha2;
-            nav.ion_gps[3] = iono.d_alpha3;
-            nav.ion_gps[4] = iono.d_beta0;
-            nav.ion_gps[5] = iono.d_beta1;
-            nav.ion_gps[6] = iono.d_beta2;
-            nav.ion_gps[7] = iono.d_beta3;
+            double params[8] = {
+                iono.d_alpha0, iono.d_alpha1, iono.d_alpha2, iono.d_alpha3,
+                iono.d_beta0, iono.d_beta1, iono.d_beta2, iono.d_beta3
+            };
+            if (memcmp (nav_->ion_gps, params, sizeof (params))) {
+                memcpy (nav_->ion_gps, params, sizeof (params));
+                changed = true;
+            }
+        }
+    }
+
+    // Galileo UTC and ionospheric parameters, if there are any
+    gps_data::galileo_utc_model_ptr gal_utc_model =
+       gps_data_->galileo_utc_model ();
+    Galileo_Utc_Model gal_utc;
+    if (gal_utc_model && gal_utc_model->read (0, gal_utc) &&
+        gal_utc.flag_utc_model)
+    {
+        double params[4] = {
+            gal_utc.A0_6, gal_utc.A1_6, gal_utc.t0t_6, gal_utc.WNot_6
+        };
+        if (memcmp (nav_->utc_gal, params, sizeof (params))) {
+            memcpy (nav_->utc_gal, params, sizeof (params));
+            changed = true;
+        }
+    }
+
+    gps_data::galileo_iono_ptr gal_iono_model = gps_data_->galileo_iono ();
+    Galileo_Iono gal_iono;
+    if (gal_iono_model && gal_iono_model->read (0, gal_iono) &&
+        gal_iono.ai0_5 != 0.0)
+    {
+        double params[4] = {
+            gal_iono.ai0_5, gal_iono.ai1_5, gal_iono.ai2_5, 0.0
+        };
+        if (memcmp (nav_->ion_gal, params, sizeof (params))) {
+            memcpy (nav_->ion_gal, params, sizeof (params));
+            changed = true;
+        }
+    }
+
+    if (nav_cache_) {
+        if (changed) {
+            nav_cache_->update (*nav_);
+        }
+        // Pick up satellites decoded by other stations, but only when
+        // something is missing that the cache may since have taken
+        unsigned long version = nav_cache_->version ();
+        if (version != nav_version_ && detail::missing_nav (obs_->obs, *nav_)) {
+            nav_version_ = version;
+            nav_cache_->seed (*nav_);
+        }
+    }
+}
+
+void position::change_base (const std::string &base,
+                            const std::vector <gnss_sdr_data> &observables,
+                            double epoch)
+{
+    if (!base_.empty ()) {
+        // Time a failover from when the failed base went quiet
+        if (base_lost_ || !controller_->base_usable (base_)) {
+            failover_start_ = controller_->base_updated (base_);
+            if (!failover_start_) {
+                failover_start_ = monotonic_ms ();
+            }
+            count_metric ("base_failovers");
         }
+
+        // Move the ambiguities across using the last observables from
+        // the old base, if they're recent enough
+        double age = std::fabs (epoch - base_epoch_);
+        bool recent = base_observables_ && age <= detail::BASE_CHANGE_MAX_AGE;
+        int n = detail::change_base (
+           recent ? *base_observables_ :
+              client_controller::observable_vector (),
+           observables,
+           age,
+           *rtk_);
+        BOOST_LOG (lg_)
+           << "Rover " << gps_data_->name () << " moved from base "
+           << base_ << " to " << base << " keeping " << n
+           << " ambiguities from " << age << " s before.";
+        count_metric ("base_switches");
+    }
+    else {
+        BOOST_LOG_SEV (lg_, debug)
+           << "Rover " << gps_data_->name () << " using base " << base;
     }
 
+    double rr[3] = { 0, 0, 0 };
+    if (!controller_->base_position (base, rr)) {
+        BOOST_LOG_SEV (lg_, warning)
+           << "Position of base " << base << " is not known.";
+    }
+    for (int i = 0; i < 3; i++) {
+        rtk_->opt.rb[i] = rr[i];
+    }
+    base_ = base;
+}
+
+position::error_type position::rtk_position (
+    const std::vector <gnss_sdr_data> &observables)
+{
+    // Difference against the nearest base that is running
+    std::string base = controller_->select_base (rtk_->sol.rr, base_);
+    client_controller::observables_ptr base_observables;
+    client_controller::ref_time_ptr base_ref_time;
+    if (!base.empty ()) {
+        base_observables = controller_->base_observables (base);
+        base_ref_time = controller_->base_ref_time (base);
+    }
+    if (!base_observables || !base_ref_time) {
+        if (!base_.empty () && !base_lost_) {
+            BOOST_LOG_SEV (lg_, warning)
+               << "Rover " << gps_data_->name () << " lost base " << base_;
+            base_lost_ = true;
+        }
+        return make_error_condition (no_base_station);
+    }
+
+    Gps_Ref_Time base_time;
+    base_ref_time->read (0, base_time);
+    double epoch = base_time.d_Week * 604800.0 + base_time.d_TOW;
+    if (base != base_ || base_lost_) {
+        // Also when the same base comes back: it has new ambiguities
+        change_base (base, *base_observables, epoch);
+        base_lost_ = false;
+    }
+    base_observables_ = base_observables;
+    base_epoch_ = epoch;
+
+    // Copy GNSS-SDR Observables to RTKLIB observables (observations)
+    // get_obs pushes in satellite order
+    // rtklib requires in order of receiver, followed by satellite
+
+    // ROVER OBSERVABLES
+    std::vector <obsd_t> &observations = obs_->obs;
+    observations.clear ();
+    Gps_Ref_Time ref_time;
+    gps_data_->ref_time()->read (0, ref_time);
+    detail::get_obs (observables, false, ref_time, *obs_);
+
+    // BASE STATION OBSERVABLES
+    detail::get_obs (*base_observables, true, base_time, *obs_);
+
+    // Bring navigation data up to date
+    update_navigation ();
+
     // Ready to run
-    int rv = rtkpos (rtk_.get (), &observations[0], observations.size (), &nav);
+    int rv;
+    {
+        scoped_timer timer ("rtkpos_cpu_ms", scoped_timer::CPU_CLOCK);
+        rv = rtkpos (rtk_.get (), &observations[0], observations.size (),
+                     nav_.get ());
+    }
+
+    // Satellite states are shared by all stations; the counts taken here
+    // include those of other stations since the last call.
+    unsigned int hits, misses;
+    satcachestat (&hits, &misses);
+    if (hits + misses) {
+        count_metric ("sat_cache_hits", hits);
+        count_metric ("sat_cache_misses", misses);
+        record_metric ("sat_cache_hit_rate",
+                       static_cast<double> (hits) / (hits + misses));
+    }
     if (!rv) {
         return make_error_condition (rtk_failure);
     }
 
+    if (rtk_->sol.stat == SOLQ_NONE) {
+        return make_error_condition (rtk_failure);
+    }
+
+    if (failover_start_) {
+        record_metric ("base_failover_ms", monotonic_ms () - failover_start_);
+        failover_start_ = 0;
+    }
+
     // Got valid position
-    // TODO: Print to KML somewhere
     BOOST_LOG_SEV (lg_, debug)
        << "Got valid position for station "
        << gps_data_->name();
 
-    // Convert to geographical
-    boost::tuple <double, double, double> geo = detail::to_geo (rtk_->sol.rr[0],
-                                                                rtk_->sol.rr[1],
-                                                                rtk_->sol.rr[2]);
+    if (handler_) {
+        solution_record rec;
+        detail::to_record (rtk_->sol, rec);
+        handler_->handle_solution (gps_data_->name (), rec);
+    }
+
+    // Convert to geographical (WGS84)
+    double geo[3];
+    ecef2pos (rtk_->sol.rr, geo);
 
     BOOST_LOG (lg_)
        << gps_data_->name () << ": "
-       << "Lat=" << boost::get<0> (geo) << " deg "
-       << "Long=" << boost::get<1> (geo) << " deg "
-       << "Height=" << boost::get<2> (geo) << " m";
+       << "Lat=" << geo[0] * R2D << " deg "
+       << "Long=" << geo[1] * R2D << " deg "
+       << "Height=" << geo[2] << " m";
 
     return error_type ();
 }
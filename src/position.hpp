@@ -30,6 +30,7 @@
 #ifndef GENESIS_POSITION_HPP
 #define GENESIS_POSITION_HPP
 
+#include <string>
 #include <vector>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
@@ -41,7 +42,11 @@
 namespace genesis {
 
 class client_controller;
+class nav_cache;
+class solution_handler;
 struct gps_data;
+struct nav_t;
+struct obs_table;
 struct rtk_t;
 
 /*!
@@ -54,17 +59,50 @@ public:
    typedef boost::shared_ptr<client_controller> controller_ptr;
    typedef boost::shared_ptr<gps_data> gps_data_ptr;
    typedef boost::shared_ptr<rtk_t> rtk_ptr;
+   typedef boost::shared_ptr<nav_t> nav_ptr;
+   typedef boost::shared_ptr<nav_cache> nav_cache_ptr;
 
-   position (controller_ptr controller, gps_data_ptr gps);
+   position (controller_ptr controller,
+             gps_data_ptr gps,
+             solution_handler *handler = 0,
+             nav_cache_ptr cache = nav_cache_ptr ());
    ~position ();
 
    error_type rtk_position (const std::vector <gnss_sdr_data> &observables);
 
+private:
+   void update_navigation ();
+   void change_base (const std::string &base,
+                     const std::vector <gnss_sdr_data> &observables,
+                     double epoch);
+
 private:
    controller_ptr controller_;
    gps_data_ptr gps_data_;
+   solution_handler *handler_;
    logger lg_;
    rtk_ptr rtk_;
+
+   // The base station being differenced against, and the observables
+   // and epoch (GPS seconds) it last gave
+   std::string base_;
+   boost::shared_ptr <const std::vector <gnss_sdr_data> > base_observables_;
+   double base_epoch_;
+
+   // Set while no base is usable
+   bool base_lost_;
+
+   // When a failed base last sent observables (monotonic_ms), until the
+   // rover has a solution from another; 0 otherwise
+   double failover_start_;
+
+   // Navigation data, kept between epochs
+   nav_ptr nav_;
+   nav_cache_ptr nav_cache_;
+   unsigned long nav_version_;  // of the cache when last seeded
+
+   // Observables are converted here for every epoch
+   boost::shared_ptr <obs_table> obs_;
 };
 
 }
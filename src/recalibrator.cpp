@@ -0,0 +1,277 @@
+/*!
+ * \file recalibrator.cpp
+ * \brief Calibrates stations' front ends in the background.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "recalibrator.hpp"
+#include "calibrator.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "station.hpp"
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <gflags/gflags.h>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+DECLARE_int32 (recalibrate_hours);
+DECLARE_double (recalibrate_threshold_hz);
+DECLARE_string (off_peak_hours);
+
+namespace genesis {
+
+namespace detail {
+
+enum {
+    CHECK_INTERVAL_S = 60,     // how often to look for a station that's due
+    RETRY_INTERVAL_S = 3600,   // after a failed calibration
+    FRONT_END_CAL_NICE = 19    // front-end-cal mustn't hold up the stations
+};
+
+// A station's calibration
+struct calibration {
+    station station_;
+    double IF_;             // what its gnss-sdr is using
+    bool is_calibrated_;
+    std::time_t calibrated_;
+    std::time_t retry_;     // not before this, after a failure
+};
+
+// Parse hours like "1-5" (local time, the end excluded). Empty is all day.
+static bool parse_hours (const std::string &s, int &from, int &to) {
+    if (s.empty ()) {
+        from = to = 0;
+        return true;
+    }
+    char end;
+    return std::sscanf (s.c_str (), "%d-%d%c", &from, &to, &end) == 2 &&
+       from >= 0 && from < 24 && to >= 0 && to <= 24;
+}
+
+} // namespace detail
+
+struct recalibrator::impl {
+   typedef boost::mutex::scoped_lock scoped_lock;
+   typedef std::map <std::string, detail::calibration> calibration_map;
+   typedef calibrator::error_type error_type;
+
+   impl (spawn_handler *handler,
+         pause_function pause,
+         resume_function resume)
+      : handler_ (handler),
+        pause_ (pause),
+        resume_ (resume),
+        stopping_ (false)
+      {
+         if (!detail::parse_hours (FLAGS_off_peak_hours, from_, to_)) {
+            BOOST_LOG_SEV (lg_, error)
+               << "Bad --off_peak_hours \"" << FLAGS_off_peak_hours
+               << "\"; recalibrating at any time.";
+            from_ = to_ = 0;
+         }
+      }
+
+   bool off_peak (std::time_t now) const {
+      if (from_ == to_) {
+         return true;
+      }
+      std::tm local;
+      ::localtime_r (&now, &local);
+      int hour = local.tm_hour;
+      return from_ < to_ ?
+         hour >= from_ && hour < to_ :
+         hour >= from_ || hour < to_;
+   }
+
+   // The next station to calibrate. Called with the mutex held.
+   bool next_due (detail::calibration &next) const {
+      std::time_t now = std::time (0);
+      const detail::calibration *due = 0;
+      BOOST_FOREACH (const calibration_map::value_type &v, calibrations_) {
+         const detail::calibration &c = v.second;
+         if (c.retry_ > now) {
+            continue;
+         }
+         if (!c.is_calibrated_) {
+            // Uncalibrated stations can't wait for the off-peak hours
+            due = &c;
+            break;
+         }
+         if (FLAGS_recalibrate_hours > 0 &&
+             now - c.calibrated_ >= FLAGS_recalibrate_hours * 3600 &&
+             (!due || c.calibrated_ < due->calibrated_))
+         {
+            due = &c;
+         }
+      }
+      if (!due || (due->is_calibrated_ && !off_peak (now))) {
+         return false;
+      }
+      next = *due;
+      return true;
+   }
+
+   void calibrate (const detail::calibration &next) {
+      const station &st = next.station_;
+      if (!pause_ (st)) {
+         // It's gone, or wouldn't stop; it's added again if it comes back
+         scoped_lock guard (mutex_);
+         calibrations_.erase (st.get_address ());
+         return;
+      }
+
+      BOOST_LOG_SEV (lg_, info) << "Calibrating " << st.get_address ();
+      calibrator cal;
+      error_type et;
+      {
+         scoped_timer timer ("recalibration_ms");
+         et = cal.calibrate (st, handler_);
+      }
+
+      double IF = next.IF_;
+      if (et) {
+         BOOST_LOG_SEV (lg_, warning)
+            << "Failed to calibrate " << st.get_address () << ": "
+            << et.message ();
+         count_metric ("recalibrations_failed");
+      }
+      else {
+         double change = std::fabs (cal.get_IF () - next.IF_);
+         record_metric ("if_bias_change_hz", change);
+
+         // Small changes are front-end-cal's noise
+         if (!next.is_calibrated_ ||
+             change > FLAGS_recalibrate_threshold_hz)
+         {
+            BOOST_LOG_SEV (lg_, info)
+               << "IF for " << st.get_address () << " moved from "
+               << next.IF_ << " to " << cal.get_IF () << " Hz.";
+            IF = cal.get_IF ();
+         }
+         count_metric ("recalibrations");
+      }
+      resume_ (st, IF);
+
+      scoped_lock guard (mutex_);
+      calibration_map::iterator it = calibrations_.find (st.get_address ());
+      if (it != calibrations_.end ()) {
+         detail::calibration &c = it->second;
+         c.IF_ = IF;
+         if (et) {
+            c.retry_ = std::time (0) + detail::RETRY_INTERVAL_S;
+         }
+         else {
+            c.is_calibrated_ = true;
+            c.calibrated_ = cal.get_calibrated ();
+         }
+      }
+   }
+
+   void run () {
+      // Linux gives each thread its own nice value, which front-end-cal
+      // inherits
+      if (::setpriority (PRIO_PROCESS, ::syscall (SYS_gettid),
+                         detail::FRONT_END_CAL_NICE))
+      {
+         BOOST_LOG_SEV (lg_, warning)
+            << "Failed to lower calibration priority.";
+      }
+
+      for (;;) {
+         detail::calibration next;
+         {
+            scoped_lock guard (mutex_);
+            while (!stopping_ && !next_due (next)) {
+               cond_.timed_wait (guard, boost::posix_time::seconds (
+                                    long (detail::CHECK_INTERVAL_S)));
+            }
+            if (stopping_) {
+               break;
+            }
+         }
+         calibrate (next);
+      }
+   }
+
+   spawn_handler *handler_;
+   pause_function pause_;
+   resume_function resume_;
+   int from_;  // off-peak hours
+   int to_;
+   calibration_map calibrations_; // by address
+   bool stopping_;
+   boost::mutex mutex_;
+   boost::condition_variable cond_;
+   logger_mt lg_;
+};
+
+recalibrator::recalibrator (spawn_handler *handler,
+                            pause_function pause,
+                            resume_function resume)
+   : impl_ (new impl (handler, pause, resume))
+{
+   // Detached, like the startup threads; front-end-cal can't be
+   // interrupted
+   boost::thread (boost::bind (&impl::run, impl_));
+}
+
+recalibrator::~recalibrator () {
+   stop ();
+}
+
+void recalibrator::add (const station &st,
+                        double IF,
+                        bool is_calibrated,
+                        std::time_t calibrated)
+{
+   detail::calibration c;
+   c.station_ = st;
+   c.IF_ = IF;
+   c.is_calibrated_ = is_calibrated;
+   c.calibrated_ = calibrated;
+   c.retry_ = 0;
+
+   impl::scoped_lock guard (impl_->mutex_);
+   impl_->calibrations_[st.get_address ()] = c;
+   impl_->cond_.notify_one ();
+}
+
+void recalibrator::stop () {
+   impl::scoped_lock guard (impl_->mutex_);
+   impl_->stopping_ = true;
+   impl_->cond_.notify_all ();
+}
+
+}
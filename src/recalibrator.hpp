@@ -0,0 +1,101 @@
+/*!
+ * \file recalibrator.hpp
+ * \brief Calibrates stations' front ends in the background.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_RECALIBRATOR_HPP
+#define GENESIS_RECALIBRATOR_HPP
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <ctime>
+
+namespace genesis {
+
+class spawn_handler;
+class station;
+
+/*!
+ * \brief Keeps stations' IF calibrations up to date without holding up
+ * their start. A station that has never been calibrated is calibrated
+ * as soon as it starts; one whose calibration is older than
+ * --recalibrate_hours is calibrated again in the --off_peak_hours.
+ *
+ * front-end-cal runs at the lowest priority, one station at a time. It
+ * needs the station's rtl_tcp server to itself, so it only starts once the
+ * station's gnss-sdr has been paused and has exited. The new IF is only
+ * given to gnss-sdr if it's moved by more than --recalibrate_threshold_hz.
+ *
+ * All members are safe to call from any thread.
+ */
+class recalibrator : boost::noncopyable {
+public:
+   /*!
+    * \brief Stops a station's gnss-sdr so front-end-cal can connect,
+    * returning once it has exited.
+    * \returns false if the station isn't running or its gnss-sdr didn't
+    * exit.
+    */
+   typedef boost::function <bool (const station &)> pause_function;
+
+   /*!
+    * \brief Starts a paused station's gnss-sdr with the given IF (Hz).
+    */
+   typedef boost::function <void (const station &, double)> resume_function;
+
+   recalibrator (spawn_handler *handler,
+                 pause_function pause,
+                 resume_function resume);
+
+   // Stops calibrating; a calibration under way carries on.
+   ~recalibrator ();
+
+   /*!
+    * \brief Look after a station's calibration. IF is the IF (Hz) its
+    * gnss-sdr was started with, and calibrated when that was found (0 if
+    * it isn't known). A station that isn't calibrated is done first.
+    */
+   void add (const station &st,
+             double IF,
+             bool is_calibrated,
+             std::time_t calibrated);
+
+   /*!
+    * \brief Stop calibrating.
+    */
+   void stop ();
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_RECALIBRATOR_HPP
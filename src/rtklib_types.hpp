@@ -0,0 +1,71 @@
+/*!
+ * \file rtklib_types.hpp
+ * \brief Wrappers which let RTKLIB types be forward declared.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_RTKLIB_TYPES_HPP
+#define GENESIS_RTKLIB_TYPES_HPP
+
+// Include after any boost thread headers; rtklib.h defines lock ().
+#include <cstdlib>
+#include <cstring>
+#include "rtklib.h"
+
+namespace genesis {
+
+struct rtk_t : ::rtk_t {};
+
+/*!
+ * \brief Navigation data with one broadcast ephemeris per satellite,
+ * indexed by satellite number - 1. This is the layout used by RTKLIB's
+ * readnav and savenav.
+ */
+struct nav_t : ::nav_t {
+   nav_t () {
+      memset (static_cast< ::nav_t *> (this), 0, sizeof (::nav_t));
+      eph = static_cast<eph_t *> (calloc (MAXSAT, sizeof (eph_t)));
+      n = nmax = eph ? MAXSAT : 0;
+      for (int i = 0; i < MAXSAT; i++) {
+         for (int j = 0; j < NFREQ; j++) {
+            lam[i][j] = satwavelen (i + 1, j, this);
+         }
+      }
+   }
+
+   ~nav_t () {
+      freenavidx (this);
+      free (eph);
+   }
+
+private:
+   nav_t (const nav_t &);
+   nav_t &operator= (const nav_t &);
+};
+
+}
+
+#endif // GENESIS_RTKLIB_TYPES_HPP
@@ -31,14 +31,40 @@
 #include <boost/make_shared.hpp>
 #include "service.hpp"
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include "session.hpp"
 #include "calibrator.hpp"
 #include "gnss_sdr.hpp"
+#include "gnss_sdr_pool.hpp"
+#include "heartbeat_monitor.hpp"
+#include "metrics.hpp"
+#include "nav_cache.hpp"
 #include "packet.hpp"
+#include "recalibrator.hpp"
+#include "solution_publisher.hpp"
+#include "solution_writer.hpp"
+#include "startup_executor.hpp"
+#include "station_config.hpp"
+#include "supervisor.hpp"
 #include <boost/thread.hpp>
 #include <boost/foreach.hpp>
+#include <gflags/gflags.h>
+#include <fstream>
+#include <sstream>
+
+DECLARE_string (solution_format);
+DECLARE_bool (solution_kml);
+DECLARE_bool (orthometric_height);
+DECLARE_string (publish_socket);
+DECLARE_string (nav_cache_file);
+DECLARE_string (base_positions);
+DECLARE_string (standby_bases);
+DECLARE_int32 (max_concurrent_starts);
+DECLARE_int32 (gnss_sdr_pool);
+DECLARE_double (default_if_bias);
+DECLARE_int32 (heartbeat_timeout_ms);
 
 namespace genesis {
 
@@ -49,14 +75,95 @@ enum {
 using boost::asio::ip::udp;
 using boost::asio::local::stream_protocol;
 
+namespace detail {
+
+enum {
+   MAX_CHILD_DEPTH = 8 // how far up from a peer to look for our child
+};
+
+// The parent of a process, or 0 if it can't be found
+static int parent_pid (int pid) {
+   std::ostringstream path;
+   path << "/proc/" << pid << "/stat";
+   std::ifstream ifs (path.str ().c_str ());
+   std::string stat;
+   std::getline (ifs, stat);
+
+   // pid (comm) state ppid ...; comm may have spaces and parentheses
+   std::string::size_type end = stat.rfind (')');
+   if (end == std::string::npos) {
+      return 0;
+   }
+   std::istringstream is (stat.substr (end + 1));
+   char state;
+   int ppid = 0;
+   is >> state >> ppid;
+   return ppid;
+}
+
+}
+
 service::service ()
    : acceptor_ (io_service_),
      signal_ (io_service_, SIGCHLD),
      udp_socket_ (io_service_),
      stdin_ (io_service_, ::dup (STDIN_FILENO)),
      stdin_buf_ ((size_t)MAX_STDIN),
-     controller_ (boost::make_shared<client_controller> ())
+     controller_ (boost::make_shared<client_controller> ()),
+     nav_cache_ (boost::make_shared<nav_cache> (boost::ref (io_service_),
+                                                FLAGS_nav_cache_file))
 {
+   solution_writer::output_format format;
+   if (!parse_output_format (FLAGS_solution_format, format)) {
+      BOOST_LOG_SEV (lg_, warning) << "Unknown solution format "
+                                   << FLAGS_solution_format
+                                   << "; writing binary solutions only.";
+      format = solution_writer::FORMAT_NONE;
+   }
+   writer_ = boost::make_shared<solution_writer> (format,
+                                                  FLAGS_solution_kml,
+                                                  FLAGS_orthometric_height);
+   publisher_ = boost::make_shared<solution_publisher> (
+      boost::ref (io_service_));
+   if (FLAGS_gnss_sdr_pool > 0) {
+      pool_ = boost::make_shared<gnss_sdr_pool> (boost::ref (io_service_),
+                                                 this,
+                                                 FLAGS_gnss_sdr_pool);
+   }
+   supervisor_ = boost::make_shared<supervisor> (
+      boost::ref (io_service_),
+      boost::bind (&service::restart_station, this, _1, _2));
+   recalibrator_ = boost::make_shared<recalibrator> (
+      this,
+      boost::bind (&supervisor::pause, supervisor_, _1),
+      boost::bind (&supervisor::resume, supervisor_, _1, _2));
+   if (FLAGS_heartbeat_timeout_ms > 0) {
+      heartbeats_ = boost::make_shared<heartbeat_monitor> (
+         boost::ref (io_service_),
+         boost::bind (&service::reclaim_station, this, _1));
+   }
+   starter_ = boost::make_shared<startup_executor> (
+      boost::bind (&service::start_station, this, _1),
+      FLAGS_max_concurrent_starts);
+
+   base_position_map bases;
+   if (load_base_positions (FLAGS_base_positions, bases)) {
+      BOOST_FOREACH (const base_position_map::value_type &b, bases) {
+         controller_->set_base_position (b.first, b.second.data ());
+      }
+      BOOST_LOG_SEV (lg_, debug) << "Loaded " << bases.size ()
+                                 << " base positions from "
+                                 << FLAGS_base_positions;
+   }
+
+   std::istringstream standby (FLAGS_standby_bases);
+   std::string address;
+   while (std::getline (standby, address, ',')) {
+      if (!address.empty ()) {
+         controller_->set_standby_base (address);
+      }
+   }
+
    start_signal_wait ();
 }
 
@@ -75,9 +182,19 @@ service::error_type service::run (const std::string &socket_file,
    error_type ec;
    ec = setup_acceptor (socket_file);
    if (!ec) {
+      start_accept ();
+      if (pool_) {
+         // Idle gnss-sdrs connect to the acceptor too
+         pool_->fill ();
+      }
       ec = setup_listener (multicast_address);
 
       if (!ec) {
+         // publishing is optional; carry on without it
+         if (!FLAGS_publish_socket.empty ()) {
+            publisher_->listen (FLAGS_publish_socket);
+         }
+
          // handle input
          boost::asio::async_read_until (
             stdin_, stdin_buf_, '\n',
@@ -126,6 +243,72 @@ service::error_type service::setup_acceptor (const std::string &socket_file) {
 
    return error_type ();
 }
+void service::start_accept () {
+   accepting_.reset (new stream_protocol::socket (io_service_));
+   acceptor_.async_accept (*accepting_,
+                           boost::bind (&service::handle_accept,
+                                        this,
+                                        boost::asio::placeholders::error));
+}
+
+void service::handle_accept (const boost::system::error_code &err) {
+   if (err == boost::asio::error::operation_aborted) {
+      return;
+   }
+
+   if (err) {
+      BOOST_LOG_SEV (lg_, error) << "Failed to accept connection: "
+                                 << err.message ();
+   }
+   else {
+      // Hand the connection to the session for the gnss-sdr it came
+      // from, or keep it until that session is ready
+      session_ptr sesh;
+      {
+         scoped_lock lock (mutex_);
+         int pid = find_child (*accepting_);
+         std::map <int, session_ptr>::iterator it = pending_.find (pid);
+         if (!pid) {
+            BOOST_LOG_SEV (lg_, warning)
+               << "Ignoring connection from an unknown process.";
+         }
+         else if (it != pending_.end ()) {
+            sesh = it->second;
+            pending_.erase (it);
+            sesh->socket () = boost::move (*accepting_);
+         }
+         else {
+            unclaimed_[pid] = accepting_;
+         }
+      }
+      if (sesh) {
+         sesh->start ();
+      }
+   }
+
+   start_accept ();
+}
+
+int service::find_child (stream_protocol::socket &s) {
+   ucred cred;
+   socklen_t len = sizeof (cred);
+   if (::getsockopt (s.native_handle (), SOL_SOCKET, SO_PEERCRED,
+                     &cred, &len))
+   {
+      return 0;
+   }
+
+   // gnss-sdr may have connected from a process of its own
+   int pid = cred.pid;
+   for (int i = 0; pid > 1 && i < detail::MAX_CHILD_DEPTH; i++) {
+      if (to_kill_.count (pid)) {
+         return pid;
+      }
+      pid = detail::parent_pid (pid);
+   }
+   return 0;
+}
+
 service::error_type service::setup_listener
 (const std::string &multicast_address)
 {
@@ -208,13 +391,13 @@ void service::handle_udp_receive (const boost::system::error_code &error,
       shutdown ();
    }
    else {
-      if (bytes_received != MAX_DATA_LENGTH) {
+      if (bytes_received < packet::FIXED_DATA_SIZE) {
          // Didn't read the whole packet
          BOOST_LOG_SEV (lg_, warning) <<
             "Short packet received";
       }
       else {
-         handle_packet ();
+         handle_packet (bytes_received);
       }
 
       udp_socket_.async_receive_from (
@@ -227,10 +410,10 @@ void service::handle_udp_receive (const boost::system::error_code &error,
 }
 
 
-void service::handle_packet () {
+void service::handle_packet (size_t length) {
    // Unwrap packet
    packet p;
-   p.unpack (data_);
+   p.unpack (data_, length);
    data_.assign (0);
 
    std::string address = sender_endpoint_.address ().to_string ();
@@ -240,7 +423,16 @@ void service::handle_packet () {
       << "Received station packet from "
       << st.get_address ()
       << " port=" << st.get_port ()
-      << " type=" << st.get_type ();
+      << " type=" << st.get_type ()
+      << " version=" << p.get_version ();
+
+   if (p.is_heartbeat () && heartbeats_ &&
+       !heartbeats_->beat (st, p.get_station_id (), p.get_sequence ()))
+   {
+      // Another station has its address; it's started once the
+      // old one has gone
+      reclaim_station (st);
+   }
 
    // Adding the station to the controller
    // prevents duplicates from being initiated.
@@ -253,76 +445,145 @@ void service::handle_packet () {
               << "Error adding new station: " << e.message();
        }
    }
-   else {
-      // New thread to calibrate and run
-      boost::thread (boost::bind (&service::start_station,
-                                  this,
-                                  st));
+   else if (!starter_->submit (st)) {
+      // Let it try again with its next ping
+      BOOST_LOG_SEV (lg_, warning)
+         << "Too busy to start station " << st.get_address ();
+      controller_->remove_station (st);
    }
 }
 
-void service::prepare_fork () {
-   boost::log::core::get ()->flush ();
-   boost::log::core::get ()->set_logging_enabled (false);
-   io_service_.notify_fork (boost::asio::io_service::fork_prepare);
-}
+bool service::reclaim_station (const station &st) {
+   session_ptr sesh = supervisor_->remove (st);
+   if (!sesh) {
+      // Nothing to reclaim unless it's still starting
+      return !controller_->has_station (st);
+   }
 
-void service::child_fork () {
-   acceptor_.close ();
-   udp_socket_.close ();
-   signal_.cancel ();
+   {
+      scoped_lock lock (mutex_);
+      std::map <int, session_ptr>::iterator it = pending_.begin ();
+      while (it != pending_.end ()) {
+         if (it->second == sesh) {
+            pending_.erase (it++);
+         }
+         else {
+            ++it;
+         }
+      }
+   }
 
-   io_service_.notify_fork (boost::asio::io_service::fork_child);
+   // The session, and the station's position, go once its last
+   // read has finished
+   sesh->stop ();
+   BOOST_LOG_SEV (lg_, warning) << "Reclaimed station " << st.get_address ();
+   count_metric ("stations_reclaimed");
+   return true;
 }
 
-void service::parent_fork (int pid) {
-   io_service_.notify_fork (boost::asio::io_service::fork_parent);
-   boost::log::core::get ()->set_logging_enabled (true);
-   if (pid > 0) {
-      scoped_lock lock (mutex_);
-      to_kill_.insert (pid);
-   }
+void service::child_spawned (int pid) {
+   scoped_lock lock (mutex_);
+   to_kill_.insert (pid);
 }
 
 void service::start_station (const station &st) {
-   // Calibrate
+   double joined = monotonic_ms ();
+
+   // Start with the last calibration, or the default until the station
+   // has been calibrated in the background
    calibrator cal;
-   error_type et = cal.calibrate (st, this);
+   bool calibrated = cal.load (st);
+   double IF = calibrated ? cal.get_IF () : FLAGS_default_if_bias;
 
+   int out, pid;
+   std::string prefix;
+   bool pooled;
+   error_type et = launch (st, IF, out, pid, prefix, pooled);
    if (et) {
-      BOOST_LOG_SEV (lg_, error) << "Failed to calibrate station "
-                                 << st.get_address ()
-                                 << ": "
-                                 << et.message ();
-      controller_->remove_station (st);
+       BOOST_LOG_SEV (lg_, error) << "Failed to start gnss-sdr: "
+                                  << et.message ();
+       controller_->remove_station (st);
    }
    else {
-       // Run GNSS-SDR
-       gnss_sdr runner;
-       int out;
-       et = runner.run (st, this, out, cal.get_IF ());
-       if (et) {
-           BOOST_LOG_SEV (lg_, error) << "Failed to start gnss-sdr: "
-                                      << et.message ();
-           controller_->remove_station (st);
+       session_ptr sesh (new session (io_service_,
+                                      st,
+                                      out,
+                                      controller_,
+                                      this,
+                                      nav_cache_,
+                                      prefix));
+       sesh->time_join (joined, pooled);
+       supervisor_->watch (pid, sesh, IF);
+       claim (pid, sesh);
+       recalibrator_->add (st, IF, calibrated, cal.get_calibrated ());
+   }
+}
+
+service::error_type service::launch (const station &st,
+                                     double IF,
+                                     int &out,
+                                     int &pid,
+                                     std::string &prefix,
+                                     bool &pooled)
+{
+   // Take a running GNSS-SDR from the pool, or start one
+   gnss_sdr_pool::worker worker;
+   pooled = pool_ && pool_->acquire (st, IF, worker);
+   if (pooled) {
+      out = -1;
+      pid = worker.pid;
+      prefix = worker.prefix;
+      return error_type ();
+   }
+
+   scoped_timer timer ("startup_launch_ms");
+   gnss_sdr runner;
+   prefix.clear ();
+   return runner.run (st, this, out, pid, IF);
+}
+
+void service::claim (int pid, const session_ptr &sesh) {
+   // gnss-sdr connects to the acceptor; the connection is
+   // matched to this session by its process ID
+   bool connected = false;
+   {
+       scoped_lock lock (mutex_);
+       std::map <int, socket_ptr>::iterator it = unclaimed_.find (pid);
+       if (it != unclaimed_.end ()) {
+           sesh->socket () = boost::move (*it->second);
+           unclaimed_.erase (it);
+           connected = true;
        }
        else {
-           session_ptr sesh (new session (io_service_,
-                                          st,
-                                          out,
-                                          controller_));
-
-           boost::system::error_code ec;
-           acceptor_.accept (sesh->socket (), ec);
-           if (ec) {
-               BOOST_LOG_SEV (lg_, error) << "No socket accepted for station: "
-                                          << ec.message ();
-           }
-           else {
-               sesh->start ();
-           }
+           pending_[pid] = sesh;
        }
    }
+   if (connected) {
+       sesh->start ();
+   }
+}
+
+int service::restart_station (const session_ptr &sesh, double IF) {
+   int out, pid;
+   std::string prefix;
+   bool pooled;
+   error_type et = launch (sesh->get_station (), IF, out, pid, prefix, pooled);
+   if (et) {
+       BOOST_LOG_SEV (lg_, error) << "Failed to restart gnss-sdr: "
+                                  << et.message ();
+       return -1;
+   }
+
+   sesh->restart (out, prefix);
+   claim (pid, sesh);
+   return pid;
+}
+
+void service::handle_solution (const std::string &name,
+                               const solution_record &sol)
+{
+   writer_->handle_solution (name, sol);
+   publisher_->handle_solution (name, sol);
 }
 
 void service::start_signal_wait () {
@@ -336,8 +597,19 @@ void service::handle_signal_wait () {
       int pid;
       while ((pid = waitpid (-1, &status, WNOHANG)) > 0) {
          count++;
-         scoped_lock lock (mutex_);
-         to_kill_.erase (pid);
+         {
+            scoped_lock lock (mutex_);
+            to_kill_.erase (pid);
+            unclaimed_.erase (pid);
+
+            if (pending_.erase (pid)) {
+               BOOST_LOG_SEV (lg_, error)
+                  << "gnss-sdr exited before connecting.";
+            }
+         }
+
+         // Its station's gnss-sdr is started again after a while
+         supervisor_->exited (pid);
       }
 
       BOOST_LOG_SEV (lg_, trace) << "Reaped " << count << " zombies.";
@@ -374,6 +646,13 @@ void service::on_stdin (const boost::system::error_code &ec,
       shutdown ();
    }
    else {
+      if (s == "m" || s == "M") {
+         // show metrics
+         std::ostringstream os;
+         report_metrics (os);
+         BOOST_LOG (lg_) << "Metrics:\n" << os.str ();
+      }
+
       // handle input
       boost::asio::async_read_until (
 	 stdin_, stdin_buf_, '\n',
@@ -387,6 +666,18 @@ void service::on_stdin (const boost::system::error_code &ec,
 void service::shutdown () {
    BOOST_LOG_SEV (lg_, trace) << "Shutting down.";
    io_service_.stop ();
+   starter_->stop ();
+   if (pool_) {
+      pool_->close ();
+   }
+   if (heartbeats_) {
+      heartbeats_->stop ();
+   }
+   recalibrator_->stop ();
+   supervisor_->stop ();
+   publisher_->close ();
+   writer_->stop ();
+   nav_cache_->save ();
    // cleanly shutdown children
    scoped_lock lock (mutex_);
    BOOST_FOREACH (int pid, to_kill_) {
@@ -37,8 +37,10 @@
 #include <boost/thread/mutex.hpp>
 #include "client_controller.hpp"
 #include "error.hpp"
-#include "fork_handler.hpp"
+#include "spawn_handler.hpp"
 #include "log.hpp"
+#include "solution_handler.hpp"
+#include <map>
 #include <set>
 #include <string>
 
@@ -52,13 +54,21 @@
 
 namespace genesis {
 
+class gnss_sdr_pool;
+class heartbeat_monitor;
+class nav_cache;
+class recalibrator;
 class station;
 class session;
+class solution_publisher;
+class solution_writer;
+class startup_executor;
+class supervisor;
 
 /*!
  * Class for operating the IO of Genesis.
  */
-class service : public fork_handler {
+class service : public spawn_handler, public solution_handler {
    BOOST_MOVABLE_BUT_NOT_COPYABLE (service)
 public:
    typedef boost::system::error_condition error_type;
@@ -71,16 +81,46 @@ public:
 private:
    typedef boost::shared_ptr <session> session_ptr;
 
+   typedef boost::shared_ptr <boost::asio::local::stream_protocol::socket>
+      socket_ptr;
+
    error_type setup_acceptor (const std::string &socket_file);
+
+   // Accept connections from gnss-sdr
+   void start_accept ();
+   void handle_accept (const boost::system::error_code &err);
+
+   // The child process a connection came from, or 0
+   int find_child (boost::asio::local::stream_protocol::socket &s);
    error_type setup_listener (const std::string &multicast_address);
 
    // Handle a new incoming UDP packet
    void handle_udp_receive (const boost::system::error_code &error,
                             size_t bytes_received);
 
-   void handle_packet ();
+   void handle_packet (size_t length);
    void start_station (const station &st);
 
+   // Stop a station that's gone silent and free what it was using.
+   // Returns false if it's still being started.
+   bool reclaim_station (const station &st);
+
+   // Start gnss-sdr for a station, taking one from the pool if there is
+   // one. out is its output pipe (-1 if pooled) and prefix its shared
+   // memory prefix (empty for the station's own).
+   error_type launch (const station &st,
+                      double IF,
+                      int &out,
+                      int &pid,
+                      std::string &prefix,
+                      bool &pooled);
+
+   // Give gnss-sdr's connection to a session, now or when it connects
+   void claim (int pid, const session_ptr &sesh);
+
+   // Start a new gnss-sdr for a session whose gnss-sdr exited
+   int restart_station (const session_ptr &sesh, double IF);
+
    // Child proceses
    void start_signal_wait ();
    void handle_signal_wait ();
@@ -91,13 +131,15 @@ private:
 
    void shutdown ();
 
-   // fork_handler
-   virtual void prepare_fork ();
-   virtual void child_fork ();
-   virtual void parent_fork (int pid);
+   // spawn_handler
+   virtual void child_spawned (int pid);
+
+   // solution_handler
+   virtual void handle_solution (const std::string &name,
+                                 const solution_record &sol);
 private:
    enum {
-       MAX_DATA_LENGTH = 6
+       MAX_DATA_LENGTH = 64 // room for later heartbeat versions
    };
    // IO service members
    boost::asio::io_service io_service_;
@@ -125,9 +167,37 @@ private:
    // Station members
    boost::shared_ptr <client_controller> controller_;
 
+   // Starts new stations a few at a time
+   boost::shared_ptr <startup_executor> starter_;
+
+   // Restarts gnss-sdrs that exit
+   boost::shared_ptr <supervisor> supervisor_;
+
+   // Calibrates stations once they've started
+   boost::shared_ptr <recalibrator> recalibrator_;
+
+   // Notices stations that stop sending heartbeats, if enabled
+   boost::shared_ptr <heartbeat_monitor> heartbeats_;
+
+   // gnss-sdrs started ahead of time, if enabled
+   boost::shared_ptr <gnss_sdr_pool> pool_;
+
+   // Navigation data shared by every station
+   boost::shared_ptr <nav_cache> nav_cache_;
+
+   // Solution output members
+   boost::shared_ptr <solution_writer> writer_;
+   boost::shared_ptr <solution_publisher> publisher_;
+
    // Logging members
    logger_mt lg_;
 
+   // Sessions waiting for their gnss-sdr to connect, and connections not
+   // yet claimed by a session, by gnss-sdr process ID
+   std::map <int, session_ptr> pending_;
+   std::map <int, socket_ptr> unclaimed_;
+   socket_ptr accepting_;
+
    // to kill
    std::set <int> to_kill_;
    boost::mutex mutex_;
@@ -27,11 +27,14 @@
  * -------------------------------------------------------------------------
  */
 #include "session.hpp"
+#include "child_log.hpp"
 #include "client_controller.hpp"
 #include "station.hpp"
 #include "log.hpp"
 #include "position.hpp"
 #include "gps_data.hpp"
+#include "metrics.hpp"
+#include "station_config.hpp"
 #include <boost/bind.hpp>
 #include <boost/array.hpp>
 #include <boost/make_shared.hpp>
@@ -42,10 +45,14 @@
 #include <boost/thread/mutex.hpp>
 //#include <boost/archive/binary_iarchive.hpp>
 
+// gnss-sdr's output, in the station directory
+static const char *const GNSS_SDR_LOG_FILE = "gnss-sdr.log";
+
 namespace genesis {
 
 struct session::impl {
    typedef session::controller_ptr controller_ptr;
+   typedef session::nav_cache_ptr nav_cache_ptr;
 
    enum {
        BUFFER_SIZE = 1024
@@ -54,17 +61,40 @@ struct session::impl {
    impl (boost::asio::io_service& service,
          const station &st,
          int outfd,
-         controller_ptr controller)
-       : socket_(service),
+         controller_ptr controller,
+         solution_handler *handler,
+         nav_cache_ptr navigation,
+         const std::string &prefix)
+       : service_ (service),
+         socket_(service),
          mut_buf_(buffer_.prepare (sizeof (gnss_sdr_data) * 32)),
          station_ (st),
          controller_ (controller),
-         outfd_ (outfd),
-         gps_data_ (new gps_data (st)),
-         pos_ (controller_, gps_data_)
+         log_ (make_log (service, st, outfd)),
+         gps_data_ (new gps_data (st, prefix)),
+         pos_ (controller_, gps_data_, handler, navigation),
+         joined_ (0),
+         pooled_ (false),
+         base_ref_time_set_ (false),
+         generation_ (0)
       {
       }
 
+   static boost::shared_ptr <child_log> make_log (
+      boost::asio::io_service &service,
+      const station &st,
+      int outfd)
+   {
+      if (outfd < 0) {
+         return boost::shared_ptr <child_log> ();
+      }
+      return boost::make_shared<child_log> (
+         boost::ref (service), outfd,
+         station_directory (st.get_address ()) / GNSS_SDR_LOG_FILE,
+         st.get_address ());
+   }
+
+   boost::asio::io_service &service_;
    boost::asio::local::stream_protocol::socket socket_;
    boost::asio::streambuf buffer_;
    boost::asio::streambuf::mutable_buffers_type mut_buf_;
@@ -72,36 +102,103 @@ struct session::impl {
    const station station_;
    controller_ptr controller_;
    logger lg_;
-   int outfd_;
+   boost::shared_ptr <child_log> log_;
    boost::shared_ptr <gps_data> gps_data_;
    position pos_;
+
+   // When the station joined (monotonic_ms), until its first observables
+   double joined_;
+   bool pooled_;
+
+   // Whether a base's reference time has been given to the controller
+   bool base_ref_time_set_;
+
+   // Which gnss-sdr the socket is for; reads started for an earlier one
+   // must leave it alone
+   unsigned generation_;
 };
 
 
 session::session(boost::asio::io_service& service,
                  const station &st,
                  int outfd,
-                 controller_ptr controller)
-    : impl_ (new impl (service, st, outfd, controller))
+                 controller_ptr controller,
+                 solution_handler *handler,
+                 nav_cache_ptr navigation,
+                 const std::string &shared_memory_prefix)
+    : impl_ (new impl (service, st, outfd, controller, handler, navigation,
+                       shared_memory_prefix))
 {
+    // Keep gnss-sdr's output flowing from the start; it may block on a
+    // full pipe before it ever connects
+    if (impl_->log_) {
+        impl_->log_->start ();
+    }
 }
 
 session::~session () {
     impl_->controller_->remove_station (impl_->station_);
-    close (impl_->outfd_);
+    if (impl_->log_) {
+        impl_->log_->close ();
+    }
+}
+
+const station &session::get_station () const {
+    return impl_->station_;
+}
+
+void session::restart (int outfd, const std::string &prefix) {
+    boost::system::error_code ec;
+    impl_->socket_.close (ec);
+    impl_->generation_++;
+    impl_->buffer_.consume (impl_->buffer_.size ());
+
+    if (impl_->log_) {
+        impl_->log_->close ();
+    }
+    impl_->log_ = impl::make_log (impl_->service_,
+                                  impl_->station_, outfd);
+    if (impl_->log_) {
+        impl_->log_->start ();
+    }
+
+    // The new GNSS-SDR publishes afresh
+    impl_->gps_data_->reopen (prefix.empty () ?
+                              shared_memory_prefix (impl_->station_) :
+                              prefix);
+    impl_->base_ref_time_set_ = false;
+}
+
+void session::stop () {
+    boost::system::error_code ec;
+    impl_->socket_.close (ec);
+    impl_->gps_data_->remove ();
 }
 
 boost::asio::local::stream_protocol::socket &session::socket () {
     return impl_->socket_;
 }
 
+void session::time_join (double joined, bool pooled) {
+    impl_->joined_ = joined;
+    impl_->pooled_ = pooled;
+}
+
 void session::start() {
     start_read ();
 }
 
 void session::handle_read(const boost::system::error_code& err,
-                          size_t /* bytes_transferred */ )
+                          size_t /* bytes_transferred */,
+                          unsigned generation)
 {
+    // Started for a gnss-sdr that's since been replaced, or cancelled
+    if (generation != impl_->generation_ ||
+        err == boost::asio::error::operation_aborted)
+    {
+        return;
+    }
+
     if (!err)
     {
         // Data to RTKLIB
@@ -135,9 +232,26 @@ void session::handle_read(const boost::system::error_code& err,
                << "Received " << observables.size () << " observables "
                << "from GNSS-SDR@" << impl_->station_.get_address ();
 
+            if (impl_->joined_) {
+                record_metric (impl_->pooled_ ?
+                                  "first_observable_pooled_ms" :
+                                  "first_observable_ms",
+                               monotonic_ms () - impl_->joined_);
+                impl_->joined_ = 0;
+            }
+
             if (impl_->station_.get_type () == station::STATION_TYPE_BASE) {
-                // set global base observables
-                impl_->controller_->set_base_observables (observables);
+                // GNSS-SDR has published its reference time by now
+                if (!impl_->base_ref_time_set_) {
+                    impl_->controller_->set_base_ref_time (
+                       impl_->station_.get_address (),
+                       impl_->gps_data_->ref_time ());
+                    impl_->base_ref_time_set_ = true;
+                }
+
+                // set this base's observables
+                impl_->controller_->set_base_observables (
+                   impl_->station_.get_address (), observables);
             }
             else {
                 // perform RTK
@@ -153,10 +267,11 @@ void session::handle_read(const boost::system::error_code& err,
         start_read ();
     }
     else {
-        impl_->socket_.close ();
-        BOOST_LOG (impl_->lg_) << "Removing station "
+        // The station is removed when the supervisor gives up on it
+        boost::system::error_code ec;
+        impl_->socket_.close (ec);
+        BOOST_LOG (impl_->lg_) << "Lost gnss-sdr for station "
                                << impl_->station_.get_address ();
-        impl_->controller_->remove_station (impl_->station_);
     }
 }
 
@@ -170,7 +285,8 @@ void session::start_read () {
         boost::bind(&session::handle_read,
                     shared_from_this(),
                     boost::asio::placeholders::error,
-                    boost::asio::placeholders::bytes_transferred));
+                    boost::asio::placeholders::bytes_transferred,
+                    impl_->generation_));
 
 }
 
@@ -33,11 +33,14 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/asio/local/stream_protocol.hpp>
+#include <string>
 
 
 namespace genesis {
 
 class client_controller;
+class nav_cache;
+class solution_handler;
 class station;
 
 /*!
@@ -46,20 +49,49 @@ class station;
 class session : public boost::enable_shared_from_this<session> {
 public:
    typedef boost::shared_ptr <client_controller> controller_ptr;
+   typedef boost::shared_ptr <nav_cache> nav_cache_ptr;
 
+   // outfd is gnss-sdr's output pipe, or -1 if it's read elsewhere
    session(boost::asio::io_service& service,
            const station &st,
            int outfd,
-           controller_ptr controller);
+           controller_ptr controller,
+           solution_handler *handler,
+           nav_cache_ptr navigation,
+           const std::string &shared_memory_prefix = std::string ());
 
    ~session ();
 
+   /*!
+    * \brief Record the time from the station joining (monotonic_ms)
+    * to its first observables, in first_observable_ms or, for a pooled
+    * gnss-sdr, first_observable_pooled_ms.
+    */
+   void time_join (double joined, bool pooled);
+
+   const station &get_station () const;
+
+   /*!
+    * \brief Carry on with a new gnss-sdr, once the last has exited.
+    * The station's position and navigation data are kept.
+    */
+   void restart (int outfd, const std::string &prefix = std::string ());
+
+   /*!
+    * \brief Stop reading from gnss-sdr, for a station that's gone, and
+    * remove the shared memory it published in. The station is removed
+    * once the session is dropped.
+    */
+   void stop ();
+
    boost::asio::local::stream_protocol::socket &socket ();
 
    void start();
 
+   // generation is that of the gnss-sdr the read was started for
    void handle_read(const boost::system::error_code& error,
-                    size_t bytes_transferred);
+                    size_t bytes_transferred,
+                    unsigned generation);
 
 private:
    void start_read ();
@@ -0,0 +1,78 @@
+/*!
+ * \file solution.hpp
+ * \brief Defines the fixed-size record for a single RTK solution.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_SOLUTION_HPP
+#define GENESIS_SOLUTION_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+
+namespace genesis {
+
+/*!
+ * \brief A single epoch's solution, as written to the solution
+ * stream. The layout is fixed so that a stream can be mapped
+ * straight into memory as an array of records after the header.
+ */
+struct solution_record {
+   boost::int64_t time;   // GPS time (seconds since epoch)
+   double sec;            // fractional seconds
+   double rr[3];          // position {x,y,z} (ecef) (m)
+   float qr[6];           // position covariance (m^2)
+                          // {c_xx,c_yy,c_zz,c_xy,c_yz,c_zx}
+   boost::uint8_t stat;   // solution status (SOLQ_???)
+   boost::uint8_t ns;     // number of valid satellites
+   boost::uint16_t reserved;
+   float ratio;           // AR ratio factor for validation
+   float age;             // age of differential (s)
+   boost::uint32_t padding;
+};
+
+BOOST_STATIC_ASSERT (sizeof (solution_record) == 80);
+
+/*!
+ * \brief The header at the start of every solution stream.
+ */
+struct solution_header {
+   enum {
+      MAGIC = 0x4c4f5347, // "GSOL"
+      VERSION = 1
+   };
+
+   boost::uint32_t magic;
+   boost::uint16_t version;
+   boost::uint16_t record_size;
+   boost::uint64_t reserved;
+};
+
+BOOST_STATIC_ASSERT (sizeof (solution_header) == 16);
+
+}
+
+#endif // GENESIS_SOLUTION_HPP
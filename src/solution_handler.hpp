@@ -1,6 +1,6 @@
 /*!
- * \file fork.hpp
- * \brief An interface for forking.
+ * \file solution_handler.hpp
+ * \brief An interface for consuming RTK solutions.
  * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
  *
  * -------------------------------------------------------------------------
@@ -27,28 +27,26 @@
  * -------------------------------------------------------------------------
  */
 #pragma once
-#ifndef GENESIS_FORK_HPP
-#define GENESIS_FORK_HPP
+#ifndef GENESIS_SOLUTION_HANDLER_HPP
+#define GENESIS_SOLUTION_HANDLER_HPP
 
-#include <vector>
 #include <string>
 
-namespace boost {
-namespace filesystem {
-class path;
-}
-}
-
 namespace genesis {
 
-class fork_handler;
+struct solution_record;
 
-// Returns a file handle for a combined stdout/stderr stream.
-int fork (fork_handler *handler,
-          const boost::filesystem::path &dir,
-          const boost::filesystem::path &cmd,
-          const std::vector <std::string> &args);
+/*!
+ * \brief Interface for a solution handler.
+ */
+class solution_handler {
+public:
+   // Called on the solve path for every valid solution.
+   // Implementations must not block.
+   virtual void handle_solution (const std::string &name,
+                                 const solution_record &sol) = 0;
+};
 
 }
 
-#endif // GENESIS_FORK_HPP
+#endif // GENESIS_SOLUTION_HANDLER_HPP
@@ -0,0 +1,336 @@
+/*!
+ * \file solution_publisher.cpp
+ * \brief Publishes live solutions to local subscribers.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "solution_publisher.hpp"
+#include "solution.hpp"
+#include "log.hpp"
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <set>
+#include <vector>
+
+namespace genesis {
+
+using boost::asio::local::stream_protocol;
+
+namespace detail {
+
+typedef boost::shared_ptr <const std::vector <char> > frame_ptr;
+
+// A single connected client
+class subscriber : public boost::enable_shared_from_this <subscriber> {
+public:
+   enum {
+      MAX_PENDING = 64,   // queued frames before old ones are skipped
+      MAX_GATHER = 16,    // frames per write
+      MAX_SKIPPED = 1024, // skipped frames without progress before dropping
+      MAX_LINE = 256
+   };
+
+   explicit subscriber (boost::asio::io_service &service)
+      : socket_ (service),
+        input_ (MAX_LINE),
+        all_ (false),
+        closed_ (false),
+        in_flight_ (0),
+        skipped_ (0)
+      {
+      }
+
+   stream_protocol::socket &socket () {
+      return socket_;
+   }
+
+   bool closed () const {
+      return closed_;
+   }
+
+   void start () {
+      read_next ();
+   }
+
+   void close () {
+      if (!closed_) {
+         closed_ = true;
+         boost::system::error_code ec;
+         socket_.close (ec);
+      }
+   }
+
+   void publish (const std::string &name, const frame_ptr &frame) {
+      if (closed_ || (!all_ && topics_.find (name) == topics_.end ())) {
+         return;
+      }
+
+      if (queue_.size () - in_flight_ >= MAX_PENDING) {
+         // Too slow; skip the oldest solution not yet being written
+         queue_.erase (queue_.begin () + in_flight_);
+         if (++skipped_ >= MAX_SKIPPED) {
+            BOOST_LOG_SEV (lg_, warning)
+               << "Dropping solution subscriber which stopped reading.";
+            close ();
+            return;
+         }
+      }
+
+      queue_.push_back (frame);
+      if (!in_flight_) {
+         write_next ();
+      }
+   }
+
+private:
+   void read_next () {
+      boost::asio::async_read_until (
+         socket_, input_, '\n',
+         boost::bind (&subscriber::handle_read,
+                      shared_from_this (),
+                      boost::asio::placeholders::error));
+   }
+
+   void handle_read (const boost::system::error_code &ec) {
+      if (ec) {
+         close ();
+         return;
+      }
+
+      std::istream is (&input_);
+      std::string line;
+      std::getline (is, line);
+      if (!line.empty () && line[line.length () - 1] == '\r') {
+         line.erase (line.length () - 1);
+      }
+
+      if (line == "*") {
+         all_ = true;
+      }
+      else if (line == "-*") {
+         all_ = false;
+         topics_.clear ();
+      }
+      else if (!line.empty () && line[0] == '-') {
+         topics_.erase (line.substr (1));
+      }
+      else if (!line.empty ()) {
+         topics_.insert (line);
+      }
+
+      read_next ();
+   }
+
+   void write_next () {
+      // Gather as many queued frames as possible into one write
+      std::vector <boost::asio::const_buffer> buffers;
+      in_flight_ = std::min (queue_.size (), static_cast<size_t> (MAX_GATHER));
+      for (size_t i = 0; i < in_flight_; i++) {
+         buffers.push_back (boost::asio::buffer (*queue_[i]));
+      }
+
+      boost::asio::async_write (
+         socket_, buffers,
+         boost::bind (&subscriber::handle_write,
+                      shared_from_this (),
+                      boost::asio::placeholders::error));
+   }
+
+   void handle_write (const boost::system::error_code &ec) {
+      if (ec || closed_) {
+         close ();
+         return;
+      }
+
+      queue_.erase (queue_.begin (), queue_.begin () + in_flight_);
+      in_flight_ = 0;
+      skipped_ = 0;
+      if (!queue_.empty ()) {
+         write_next ();
+      }
+   }
+
+   stream_protocol::socket socket_;
+   boost::asio::streambuf input_;
+   std::set <std::string> topics_;
+   bool all_;
+   bool closed_;
+   std::deque <frame_ptr> queue_;
+   size_t in_flight_;
+   size_t skipped_;
+   logger lg_;
+};
+
+typedef boost::shared_ptr <subscriber> subscriber_ptr;
+
+// Encode a solution once for all subscribers
+static frame_ptr encode (const std::string &name,
+                         const solution_record &sol)
+{
+    solution_frame frame;
+    frame.length = sizeof (frame) + name.length () + sizeof (sol);
+    frame.name_length = static_cast<boost::uint16_t> (name.length ());
+    frame.reserved = 0;
+
+    boost::shared_ptr <std::vector <char> > buf =
+       boost::make_shared <std::vector <char> > (frame.length);
+    char *p = &(*buf)[0];
+    memcpy (p, &frame, sizeof (frame));
+    p += sizeof (frame);
+    memcpy (p, name.data (), name.length ());
+    p += name.length ();
+    memcpy (p, &sol, sizeof (sol));
+    return buf;
+}
+
+} // namespace detail
+
+struct solution_publisher::impl
+   : public boost::enable_shared_from_this <solution_publisher::impl>
+{
+   explicit impl (boost::asio::io_service &service)
+      : service_ (service),
+        acceptor_ (service)
+      {
+      }
+
+   void start_accept () {
+      detail::subscriber_ptr sub (new detail::subscriber (service_));
+      acceptor_.async_accept (
+         sub->socket (),
+         boost::bind (&impl::handle_accept,
+                      shared_from_this (),
+                      sub,
+                      boost::asio::placeholders::error));
+   }
+
+   void handle_accept (detail::subscriber_ptr sub,
+                       const boost::system::error_code &ec)
+   {
+      if (ec) {
+         if (ec != boost::asio::error::operation_aborted) {
+            BOOST_LOG_SEV (lg_, error)
+               << "Failed to accept solution subscriber: " << ec.message ();
+         }
+         return;
+      }
+
+      BOOST_LOG_SEV (lg_, debug) << "New solution subscriber.";
+      subscribers_.push_back (sub);
+      sub->start ();
+      start_accept ();
+   }
+
+   void fan_out (const std::string &name, const detail::frame_ptr &frame) {
+      std::list <detail::subscriber_ptr>::iterator it = subscribers_.begin ();
+      while (it != subscribers_.end ()) {
+         (*it)->publish (name, frame);
+         if ((*it)->closed ()) {
+            it = subscribers_.erase (it);
+         }
+         else {
+            ++it;
+         }
+      }
+   }
+
+   void close () {
+      boost::system::error_code ec;
+      if (acceptor_.is_open ()) {
+         acceptor_.close (ec);
+         std::remove (socket_file_.c_str ());
+      }
+      BOOST_FOREACH (const detail::subscriber_ptr &sub, subscribers_) {
+         sub->close ();
+      }
+      subscribers_.clear ();
+   }
+
+   boost::asio::io_service &service_;
+   stream_protocol::acceptor acceptor_;
+   std::string socket_file_;
+   std::list <detail::subscriber_ptr> subscribers_;
+   logger lg_;
+};
+
+solution_publisher::solution_publisher (boost::asio::io_service &service)
+    : impl_ (new impl (service))
+{
+}
+
+solution_publisher::~solution_publisher () {
+    impl_->close ();
+}
+
+solution_publisher::error_type solution_publisher::listen (
+    const std::string &socket_file)
+{
+    boost::system::error_code ec;
+
+    impl_->socket_file_ = socket_file;
+    std::remove (socket_file.c_str ());
+
+    impl_->acceptor_.open (stream_protocol (), ec);
+    if (!ec) {
+        impl_->acceptor_.bind (stream_protocol::endpoint (socket_file), ec);
+    }
+    if (!ec) {
+        impl_->acceptor_.listen (
+            boost::asio::socket_base::max_connections, ec);
+    }
+    if (ec) {
+        BOOST_LOG_SEV (impl_->lg_, error)
+           << "Failed to publish solutions on "
+           << socket_file << ": " << ec.message ();
+        boost::system::error_code ignored;
+        impl_->acceptor_.close (ignored);
+        return to_error_condition (ec);
+    }
+
+    impl_->start_accept ();
+    return error_type ();
+}
+
+void solution_publisher::close () {
+    impl_->close ();
+}
+
+void solution_publisher::handle_solution (const std::string &name,
+                                          const solution_record &sol)
+{
+    impl_->service_.post (boost::bind (&impl::fan_out,
+                                       impl_,
+                                       name,
+                                       detail::encode (name, sol)));
+}
+
+}
@@ -0,0 +1,86 @@
+/*!
+ * \file solution_publisher.hpp
+ * \brief Interface for publishing live solutions to local subscribers.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_SOLUTION_PUBLISHER_HPP
+#define GENESIS_SOLUTION_PUBLISHER_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "error.hpp"
+#include "solution_handler.hpp"
+#include <string>
+
+namespace genesis {
+
+/*!
+ * \brief The frame which precedes every solution sent to a subscriber.
+ * It is followed by name_length bytes of rover name and then a
+ * solution_record.
+ */
+struct solution_frame {
+   boost::uint32_t length;      // total length of the frame, in bytes
+   boost::uint16_t name_length; // length of the rover name
+   boost::uint16_t reserved;
+};
+
+/*!
+ * \brief Fans live solutions out to clients connected on a local
+ * domain socket.
+ *
+ * Clients send newline-terminated commands: a rover name subscribes to
+ * that rover, "*" subscribes to every rover, and a name prefixed with
+ * "-" unsubscribes. Each solution is encoded once and shared by every
+ * subscriber. A subscriber which can't keep up has its oldest queued
+ * solutions skipped, and is disconnected if it stops reading entirely.
+ */
+class solution_publisher : public solution_handler, boost::noncopyable {
+public:
+   typedef boost::system::error_condition error_type;
+
+   explicit solution_publisher (boost::asio::io_service &service);
+   ~solution_publisher ();
+
+   error_type listen (const std::string &socket_file);
+
+   void close ();
+
+   // Safe to call from any thread.
+   virtual void handle_solution (const std::string &name,
+                                 const solution_record &sol);
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_SOLUTION_PUBLISHER_HPP
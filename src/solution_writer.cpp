@@ -0,0 +1,355 @@
+/*!
+ * \file solution_writer.cpp
+ * \brief Writes solution streams to disk.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "solution_writer.hpp"
+#include "solution.hpp"
+#include "station_config.hpp"
+#include "log.hpp"
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <utility>
+#include "rtklib.h"
+
+namespace fs = boost::filesystem;
+
+static const fs::path SOLUTION_FILE = "solution.bin";
+
+namespace genesis {
+
+namespace detail {
+
+// Convert a solution record back to an RTKLIB solution
+static void to_sol_t (const solution_record &rec, sol_t &sol) {
+    memset (&sol, 0, sizeof (sol));
+    sol.time.time = static_cast<time_t> (rec.time);
+    sol.time.sec = rec.sec;
+    for (int i = 0; i < 3; i++) {
+        sol.rr[i] = rec.rr[i];
+    }
+    for (int i = 0; i < 6; i++) {
+        sol.qr[i] = rec.qr[i];
+    }
+    sol.type = 0; // xyz-ecef
+    sol.stat = rec.stat;
+    sol.ns = rec.ns;
+    sol.age = rec.age;
+    sol.ratio = rec.ratio;
+}
+
+// Check the header of an existing stream
+static bool valid_header (const fs::path &file) {
+    FILE *fp = ::fopen (file.c_str (), "rb");
+    if (!fp) {
+        return false;
+    }
+
+    solution_header header;
+    bool valid = ::fread (&header, sizeof (header), 1, fp) == 1 &&
+       header.magic == solution_header::MAGIC &&
+       header.version == solution_header::VERSION &&
+       header.record_size == sizeof (solution_record);
+    ::fclose (fp);
+    return valid;
+}
+
+// Open the binary stream, ready to append.
+static FILE *open_binary (const fs::path &file, logger &lg) {
+    boost::system::error_code ec;
+    boost::uintmax_t size = fs::file_size (file, ec);
+
+    if (!ec && size >= sizeof (solution_header)) {
+        if (valid_header (file)) {
+            // Drop any partially written record from a previous run
+            boost::uintmax_t tail =
+               (size - sizeof (solution_header)) % sizeof (solution_record);
+            if (tail) {
+                BOOST_LOG_SEV (lg, warning)
+                   << "Truncating partial record in " << file;
+                fs::resize_file (file, size - tail, ec);
+            }
+            return ::fopen (file.c_str (), "ab");
+        }
+
+        BOOST_LOG_SEV (lg, warning)
+           << "Unrecognised solution stream " << file
+           << "; moving it aside.";
+        fs::path old = file;
+        old += ".old";
+        fs::rename (file, old, ec);
+    }
+
+    FILE *fp = ::fopen (file.c_str (), "wb");
+    if (fp) {
+        solution_header header;
+        memset (&header, 0, sizeof (header));
+        header.magic = solution_header::MAGIC;
+        header.version = solution_header::VERSION;
+        header.record_size = sizeof (solution_record);
+        ::fwrite (&header, sizeof (header), 1, fp);
+    }
+    return fp;
+}
+
+} // namespace detail
+
+bool parse_output_format (const std::string &name,
+                          solution_writer::output_format &format)
+{
+    if (name.empty () || name == "none") {
+        format = solution_writer::FORMAT_NONE;
+    }
+    else if (name == "pos") {
+        format = solution_writer::FORMAT_POS;
+    }
+    else if (name == "nmea") {
+        format = solution_writer::FORMAT_NMEA;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+struct solution_writer::impl {
+   enum {
+      MAX_QUEUE = 4096
+   };
+
+   typedef std::pair <std::string, solution_record> item;
+   typedef boost::mutex::scoped_lock scoped_lock;
+
+   struct stream {
+      stream ()
+         : bin (0), text (0)
+         {
+         }
+
+      FILE *bin;
+      FILE *text;
+      fs::path text_file;
+   };
+
+   impl (output_format format, bool kml, bool orthometric)
+      : format_ (format),
+        kml_ (kml),
+        stopping_ (false),
+        dropped_ (0)
+      {
+         opt_ = solopt_default;
+         opt_.posf = format == FORMAT_NMEA ? SOLF_NMEA : SOLF_LLH;
+         opt_.timef = 1; // yyyy/mm/dd hh:mm:ss.s
+         opt_.timeu = 3;
+         opt_.height = orthometric ? 1 : 0; // geodetic or ellipsoidal
+      }
+
+   void run () {
+      std::deque <item> batch;
+      for (;;) {
+         {
+            scoped_lock guard (mutex_);
+            while (queue_.empty () && !stopping_) {
+               cond_.wait (guard);
+            }
+            if (queue_.empty ()) {
+               break; // stopping and drained
+            }
+            batch.swap (queue_);
+            if (dropped_) {
+               BOOST_LOG_SEV (lg_, warning)
+                  << "Solution writer dropped " << dropped_
+                  << " solutions.";
+               dropped_ = 0;
+            }
+         }
+
+         std::map <std::string, stream *> touched;
+         BOOST_FOREACH (const item &it, batch) {
+            stream *s = get_stream (it.first);
+            if (s) {
+               write (*s, it.second);
+               touched[it.first] = s;
+            }
+         }
+         batch.clear ();
+
+         typedef std::map <std::string, stream *>::value_type touched_pair;
+         BOOST_FOREACH (const touched_pair &t, touched) {
+            ::fflush (t.second->bin);
+            if (t.second->text) {
+               ::fflush (t.second->text);
+            }
+         }
+      }
+
+      close_all ();
+   }
+
+   stream *get_stream (const std::string &name) {
+      std::map <std::string, stream>::iterator it = streams_.find (name);
+      if (it != streams_.end ()) {
+         return it->second.bin ? &it->second : 0;
+      }
+
+      stream &s = streams_[name];
+      boost::system::error_code ec;
+      fs::path dir = station_directory (name);
+      fs::create_directories (dir, ec);
+
+      s.bin = detail::open_binary (dir / SOLUTION_FILE, lg_);
+      if (!s.bin) {
+         BOOST_LOG_SEV (lg_, error)
+            << "Failed to open solution stream for " << name;
+         return 0;
+      }
+
+      if (format_ != FORMAT_NONE) {
+         s.text_file = dir /
+            (format_ == FORMAT_NMEA ? "solution.nmea" : "solution.pos");
+         bool fresh = !fs::exists (s.text_file, ec);
+         s.text = ::fopen (s.text_file.c_str (), "a");
+         if (!s.text) {
+            BOOST_LOG_SEV (lg_, warning)
+               << "Failed to open " << s.text_file;
+         }
+         else if (fresh && format_ == FORMAT_POS) {
+            outsolhead (s.text, &opt_);
+         }
+      }
+
+      BOOST_LOG_SEV (lg_, debug)
+         << "Writing solutions for " << name << " to " << dir;
+      return &s;
+   }
+
+   void write (stream &s, const solution_record &rec) {
+      ::fwrite (&rec, sizeof (rec), 1, s.bin);
+
+      if (s.text) {
+         sol_t sol;
+         detail::to_sol_t (rec, sol);
+         if (format_ == FORMAT_NMEA) {
+            // outsols would also emit RMC; only GGA is wanted per epoch
+            unsigned char buff[1024];
+            int n = outnmea_gga (buff, &sol);
+            ::fwrite (buff, 1, n, s.text);
+         }
+         else {
+            unsigned char buff[MAXSOLMSG + 1];
+            int n = outsols (buff, &sol, 0, &opt_);
+            ::fwrite (buff, 1, n, s.text);
+         }
+      }
+   }
+
+   void close_all () {
+      typedef std::map <std::string, stream>::value_type stream_pair;
+      BOOST_FOREACH (stream_pair &p, streams_) {
+         stream &s = p.second;
+         if (s.bin) {
+            ::fclose (s.bin);
+         }
+         if (s.text) {
+            ::fclose (s.text);
+            if (kml_) {
+               gtime_t t0 = {0, 0};
+               double offset[3] = {0, 0, 0};
+               if (convkml (s.text_file.c_str (), "", t0, t0, 0.0, 0,
+                            offset, 1, 5, 0, 0) < 0)
+               {
+                  BOOST_LOG_SEV (lg_, warning)
+                     << "KML conversion failed for " << s.text_file;
+               }
+            }
+         }
+      }
+      streams_.clear ();
+   }
+
+   const output_format format_;
+   const bool kml_;
+   solopt_t opt_;
+
+   boost::mutex mutex_;
+   boost::condition_variable cond_;
+   std::deque <item> queue_;
+   bool stopping_;
+   size_t dropped_;
+
+   std::map <std::string, stream> streams_;
+   boost::thread thread_;
+   logger lg_;
+};
+
+solution_writer::solution_writer (output_format format,
+                                  bool kml,
+                                  bool orthometric)
+    : impl_ (new impl (format, kml, orthometric))
+{
+    impl_->thread_ = boost::thread (boost::bind (&impl::run, impl_.get ()));
+}
+
+solution_writer::~solution_writer () {
+    stop ();
+}
+
+void solution_writer::handle_solution (const std::string &name,
+                                       const solution_record &sol)
+{
+    {
+        impl::scoped_lock guard (impl_->mutex_);
+        if (impl_->stopping_) {
+            return;
+        }
+        if (impl_->queue_.size () >= impl::MAX_QUEUE) {
+            impl_->dropped_++;
+            return;
+        }
+        impl_->queue_.push_back (std::make_pair (name, sol));
+    }
+    impl_->cond_.notify_one ();
+}
+
+void solution_writer::stop () {
+    {
+        impl::scoped_lock guard (impl_->mutex_);
+        impl_->stopping_ = true;
+    }
+    impl_->cond_.notify_one ();
+    if (impl_->thread_.joinable ()) {
+        impl_->thread_.join ();
+    }
+}
+
+}
@@ -0,0 +1,81 @@
+/*!
+ * \file solution_writer.hpp
+ * \brief Interface for writing solution streams to disk.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_SOLUTION_WRITER_HPP
+#define GENESIS_SOLUTION_WRITER_HPP
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "solution_handler.hpp"
+#include <string>
+
+namespace genesis {
+
+/*!
+ * \brief Writes solutions to an append-only binary stream per rover,
+ * on a background thread. Optionally, each solution is also converted
+ * to text (RTKLIB position or NMEA) and, when the writer stops, to KML.
+ * Text positions have heights above the geoid if orthometric is set.
+ */
+class solution_writer : public solution_handler, boost::noncopyable {
+public:
+   enum output_format {
+      FORMAT_NONE = 0,
+      FORMAT_POS = 1,
+      FORMAT_NMEA = 2
+   };
+
+   explicit solution_writer (output_format format = FORMAT_NONE,
+                             bool kml = false,
+                             bool orthometric = false);
+   ~solution_writer ();
+
+   // Queue a solution for writing. Never blocks on IO; if the
+   // queue is full the solution is dropped.
+   virtual void handle_solution (const std::string &name,
+                                 const solution_record &sol);
+
+   // Flush all queued solutions, close the streams and stop the thread.
+   void stop ();
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+/*!
+ * \brief Parse an output format name ("", "pos" or "nmea").
+ * \returns false if the name is not recognised.
+ */
+bool parse_output_format (const std::string &name,
+                          solution_writer::output_format &format);
+
+}
+
+#endif // GENESIS_SOLUTION_WRITER_HPP
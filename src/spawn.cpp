@@ -0,0 +1,210 @@
+/*!
+ * \file spawn.cpp
+ * \brief An interface for starting child processes.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "spawn.hpp"
+#include "spawn_handler.hpp"
+#include "metrics.hpp"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// posix_spawn can change directory and close our descriptors from
+// glibc 2.34; before that, use vfork.
+#if defined (__GLIBC__) && __GLIBC_PREREQ (2, 34)
+#define GENESIS_POSIX_SPAWN 1
+#endif
+
+namespace genesis {
+
+namespace detail {
+
+#ifdef GENESIS_POSIX_SPAWN
+
+static int start (const boost::filesystem::path &dir,
+                  const boost::filesystem::path &cmd,
+                  char **argv,
+                  int out,
+                  int passed,
+                  pid_t &pid)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init (&actions);
+    posix_spawn_file_actions_adddup2 (&actions, out, STDOUT_FILENO);
+#ifndef GENESIS_DEBUG
+    posix_spawn_file_actions_adddup2 (&actions, out, STDERR_FILENO);
+#endif
+    int first = STDERR_FILENO + 1;
+    if (passed >= 0) {
+        posix_spawn_file_actions_adddup2 (&actions, passed, SPAWN_PASSED_FD);
+        first = SPAWN_PASSED_FD + 1;
+    }
+    // Sockets and pipes of ours stay behind
+    posix_spawn_file_actions_addclosefrom_np (&actions, first);
+    posix_spawn_file_actions_addchdir_np (&actions, dir.c_str ());
+
+    // Don't pass on signals blocked by whichever thread is starting it
+    posix_spawnattr_t attr;
+    posix_spawnattr_init (&attr);
+    sigset_t mask;
+    sigemptyset (&mask);
+    posix_spawnattr_setsigmask (&attr, &mask);
+    posix_spawnattr_setflags (&attr, POSIX_SPAWN_SETSIGMASK);
+
+    int rv = posix_spawnp (&pid, cmd.c_str (), &actions, &attr,
+                           argv, environ);
+
+    posix_spawnattr_destroy (&attr);
+    posix_spawn_file_actions_destroy (&actions);
+    return rv;
+}
+
+#else
+
+// One past the highest descriptor we might have open. Not inlined, so
+// none of its variables are live across vfork.
+__attribute__ ((noinline)) static long fd_limit () {
+    enum { MARGIN = 64 }; // for those opened by other threads meanwhile
+
+    long limit = -1;
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it ("/proc/self/fd", ec), end;
+    for (; !ec && it != end; it.increment (ec)) {
+        long fd = std::atol (it->path ().filename ().c_str ());
+        limit = std::max (limit, fd + 1 + MARGIN);
+    }
+    return limit < 0 ? ::sysconf (_SC_OPEN_MAX) : limit;
+}
+
+static int start (const boost::filesystem::path &dir,
+                  const boost::filesystem::path &cmd,
+                  char **argv,
+                  int out,
+                  int passed,
+                  pid_t &pid)
+{
+    long max_fd = fd_limit ();
+    long first = passed >= 0 ? SPAWN_PASSED_FD + 1 : STDERR_FILENO + 1;
+    sigset_t mask, old;
+    sigfillset (&mask);
+    pthread_sigmask (SIG_SETMASK, &mask, &old);
+
+    // The child shares our memory until it execs, so it may only
+    // make system calls
+    pid = ::vfork ();
+    if (pid == 0) {
+        while ((dup2 (out, STDOUT_FILENO) == -1) && (errno == EINTR)) {}
+#ifndef GENESIS_DEBUG
+        while ((dup2 (out, STDERR_FILENO) == -1) && (errno == EINTR)) {}
+#endif
+        if (passed >= 0) {
+            while ((dup2 (passed, SPAWN_PASSED_FD) == -1) &&
+                   (errno == EINTR)) {}
+        }
+        for (long fd = first; fd < max_fd; fd++) {
+            ::close (fd);
+        }
+        if (::chdir (dir.c_str ()) == 0) {
+            sigset_t none;
+            sigemptyset (&none);
+            pthread_sigmask (SIG_SETMASK, &none, 0);
+            execvp (cmd.c_str (), argv);
+        }
+        _exit (127);
+    }
+    int rv = pid < 0 ? errno : 0;
+    pthread_sigmask (SIG_SETMASK, &old, 0);
+    return rv;
+}
+
+#endif
+
+} // namespace detail
+
+int spawn (spawn_handler *handler,
+           const boost::filesystem::path &dir,
+           const boost::filesystem::path &cmd,
+           const std::vector <std::string> &args,
+           int *child,
+           int passed)
+{
+    scoped_timer timer ("spawn_ms");
+
+    // Neither end is inherited by later children
+    int p[2];
+    if (::pipe2 (p, O_CLOEXEC)) {
+        return -1;
+    }
+
+    std::vector <char *> argv;
+    for (size_t i = 0; i < args.size (); i++) {
+        argv.push_back (const_cast<char *> (args[i].c_str ()));
+    }
+    argv.push_back (0);
+
+    // dup2 onto itself would leave it to be closed on exec
+    int copy = -1;
+    if (passed == SPAWN_PASSED_FD) {
+        copy = ::fcntl (passed, F_DUPFD_CLOEXEC, SPAWN_PASSED_FD + 1);
+        if (copy < 0) {
+            int e = errno;
+            close (p[0]);
+            close (p[1]);
+            errno = e;
+            return -1;
+        }
+        passed = copy;
+    }
+
+    pid_t pid = -1;
+    int rv = detail::start (dir, cmd, &argv[0], p[1], passed, pid);
+    close (p[1]);
+    if (copy >= 0) {
+        close (copy);
+    }
+    if (rv) {
+        close (p[0]);
+        errno = rv;
+        return -1;
+    }
+
+    handler->child_spawned (pid);
+    if (child) {
+        *child = pid;
+    }
+    return p[0];
+}
+
+}
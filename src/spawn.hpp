@@ -0,0 +1,69 @@
+/*!
+ * \file spawn.hpp
+ * \brief An interface for starting child processes.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_SPAWN_HPP
+#define GENESIS_SPAWN_HPP
+
+#include <vector>
+#include <string>
+
+namespace boost {
+namespace filesystem {
+class path;
+}
+}
+
+namespace genesis {
+
+class spawn_handler;
+
+// The descriptor a passed file has in the child
+enum {
+   SPAWN_PASSED_FD = 3
+};
+
+// Where the child can open a passed file
+inline std::string spawn_passed_path () {
+   return "/dev/fd/3";
+}
+
+// Start cmd in dir. Returns a file handle for a combined stdout/stderr
+// stream, or -1 with errno set if the child couldn't be started.
+// The child's process ID is stored in pid if it's given. If passed is
+// a descriptor, the child gets it as SPAWN_PASSED_FD.
+int spawn (spawn_handler *handler,
+           const boost::filesystem::path &dir,
+           const boost::filesystem::path &cmd,
+           const std::vector <std::string> &args,
+           int *pid = 0,
+           int passed = -1);
+
+}
+
+#endif // GENESIS_SPAWN_HPP
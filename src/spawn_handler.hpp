@@ -1,6 +1,6 @@
 /*!
- * \file fork_handler.hpp
- * \brief An interface for fork handling.
+ * \file spawn_handler.hpp
+ * \brief An interface for keeping track of child processes.
  * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
  *
  * -------------------------------------------------------------------------
@@ -27,26 +27,20 @@
  * -------------------------------------------------------------------------
  */
 #pragma once
-#ifndef GENESIS_FORK_HANDLER_HPP
-#define GENESIS_FORK_HANDLER_HPP
+#ifndef GENESIS_SPAWN_HANDLER_HPP
+#define GENESIS_SPAWN_HANDLER_HPP
 
 namespace genesis {
 
 /*!
- * \brief Interface for a fork handler.
+ * \brief Interface for a spawn handler.
  */
-class fork_handler {
+class spawn_handler {
 public:
-   // Call this before forking
-   virtual void prepare_fork () = 0;
-
-   // Call this after forking, in the child process
-   virtual void child_fork () = 0;
-
-   // Call this after forking, in the parent process
-   virtual void parent_fork (int pid) = 0;
+   // Called in the parent once a child process has started
+   virtual void child_spawned (int pid) = 0;
 };
 
 }
 
-#endif // GENESIS_FORK_HANDLER_HPP
+#endif // GENESIS_SPAWN_HANDLER_HPP
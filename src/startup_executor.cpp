@@ -0,0 +1,204 @@
+/*!
+ * \file startup_executor.cpp
+ * \brief Runs station startups on a bounded pool of threads.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "startup_executor.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "station.hpp"
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+DECLARE_double (max_load_per_cpu);
+DECLARE_int32 (min_free_memory_mb);
+
+namespace genesis {
+
+namespace detail {
+
+// Memory available to new processes (MB), or -1 if it's not known
+static double available_memory () {
+    std::ifstream ifs ("/proc/meminfo");
+    std::string name;
+    double kb;
+    while (ifs >> name >> kb) {
+        if (name == "MemAvailable:") {
+            return kb / 1024;
+        }
+        ifs.ignore (256, '\n');
+    }
+
+    // Older kernels; free memory doesn't count the page cache
+    long pages = ::sysconf (_SC_AVPHYS_PAGES);
+    long page_size = ::sysconf (_SC_PAGESIZE);
+    if (pages < 0 || page_size < 0) {
+        return -1;
+    }
+    return static_cast<double> (pages) * page_size / (1024 * 1024);
+}
+
+// One-minute load average per CPU, or -1 if it's not known
+static double load_per_cpu () {
+    double load;
+    long cpus = ::sysconf (_SC_NPROCESSORS_ONLN);
+    if (::getloadavg (&load, 1) != 1 || cpus <= 0) {
+        return -1;
+    }
+    return load / cpus;
+}
+
+// A station waiting to start
+struct startup {
+    station station_;
+    unsigned long sequence_;
+    double queued_; // monotonic ms
+
+    // Bases first, then first come first served
+    bool operator< (const startup &rhs) const {
+        bool base = station_.get_type () == station::STATION_TYPE_BASE;
+        bool rhs_base =
+           rhs.station_.get_type () == station::STATION_TYPE_BASE;
+        if (base != rhs_base) {
+            return rhs_base;
+        }
+        return sequence_ > rhs.sequence_;
+    }
+};
+
+} // namespace detail
+
+struct startup_executor::impl {
+   typedef boost::mutex::scoped_lock scoped_lock;
+
+   explicit impl (start_function start)
+      : start_ (start),
+        sequence_ (0),
+        stopping_ (false)
+      {
+      }
+
+   // Whether the host has room for another station
+   bool admit () {
+      double load = detail::load_per_cpu ();
+      if (FLAGS_max_load_per_cpu > 0 && load > FLAGS_max_load_per_cpu) {
+         BOOST_LOG_SEV (lg_, warning)
+            << "Load average is " << load << " per CPU.";
+         return false;
+      }
+      double memory = detail::available_memory ();
+      if (FLAGS_min_free_memory_mb > 0 && memory >= 0 &&
+          memory < FLAGS_min_free_memory_mb)
+      {
+         BOOST_LOG_SEV (lg_, warning)
+            << "Only " << memory << " MB of memory is available.";
+         return false;
+      }
+      return true;
+   }
+
+   void run () {
+      for (;;) {
+         detail::startup next;
+         {
+            scoped_lock guard (mutex_);
+            while (queue_.empty () && !stopping_) {
+               cond_.wait (guard);
+            }
+            if (stopping_) {
+               break;
+            }
+            next = queue_.top ();
+            queue_.pop ();
+            record_metric ("startup_queue_length", queue_.size ());
+         }
+
+         record_metric ("startup_wait_ms", monotonic_ms () - next.queued_);
+         scoped_timer timer ("startup_ms");
+         start_ (next.station_);
+      }
+   }
+
+   start_function start_;
+   std::priority_queue <detail::startup> queue_;
+   unsigned long sequence_;
+   bool stopping_;
+   boost::mutex mutex_;
+   boost::condition_variable cond_;
+   logger_mt lg_;
+};
+
+startup_executor::startup_executor (start_function start, int threads)
+   : impl_ (new impl (start))
+{
+   // The threads are detached; a launch can't be interrupted, so each
+   // keeps the queue alive until its current station has started.
+   for (int i = 0; i < std::max (threads, 1); i++) {
+      boost::thread (boost::bind (&impl::run, impl_));
+   }
+}
+
+startup_executor::~startup_executor () {
+   stop ();
+}
+
+bool startup_executor::submit (const station &st) {
+   if (!impl_->admit ()) {
+      count_metric ("stations_refused");
+      return false;
+   }
+
+   impl::scoped_lock guard (impl_->mutex_);
+   if (impl_->stopping_) {
+      return false;
+   }
+   detail::startup s;
+   s.station_ = st;
+   s.sequence_ = impl_->sequence_++;
+   s.queued_ = monotonic_ms ();
+   impl_->queue_.push (s);
+   record_metric ("startup_queue_length", impl_->queue_.size ());
+   impl_->cond_.notify_one ();
+   return true;
+}
+
+void startup_executor::stop () {
+   impl::scoped_lock guard (impl_->mutex_);
+   impl_->stopping_ = true;
+   impl_->cond_.notify_all ();
+}
+
+}
@@ -0,0 +1,81 @@
+/*!
+ * \file startup_executor.hpp
+ * \brief Runs station startups on a bounded pool of threads.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_STARTUP_EXECUTOR_HPP
+#define GENESIS_STARTUP_EXECUTOR_HPP
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace genesis {
+
+class station;
+
+/*!
+ * \brief Starts stations (launching gnss-sdr) on a fixed number of
+ * threads, so a fleet powering up at once doesn't run dozens of
+ * launches together. Base stations are started before
+ * rovers, and otherwise in the order they were submitted. New stations
+ * are refused while the host is over its load or memory budget.
+ *
+ * All members are safe to call from any thread.
+ */
+class startup_executor : boost::noncopyable {
+public:
+   typedef boost::function <void (const station &)> start_function;
+
+   /*!
+    * \brief Create the executor with the given number of threads,
+    * each running start for one station at a time.
+    */
+   startup_executor (start_function start, int threads);
+
+   // Stops taking stations; those being started carry on.
+   ~startup_executor ();
+
+   /*!
+    * \brief Queue a station to be started.
+    * \returns false if the host is too busy to take it.
+    */
+   bool submit (const station &st);
+
+   /*!
+    * \brief Stop starting stations. Queued stations are dropped.
+    */
+   void stop ();
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_STARTUP_EXECUTOR_HPP
@@ -85,6 +85,15 @@ private:
 };
 
 
+/*!
+ * \brief The prefix of the shared memory GNSS-SDR publishes its
+ * navigation data in for a station.
+ */
+inline std::string shared_memory_prefix (const station &st) {
+    return "genesis." + st.get_address ();
+}
+
+
 inline bool operator < (const station &l, const station &r) {
     return l.get_address () < r.get_address ();
 }
@@ -28,6 +28,11 @@
  */
 #include "station_config.hpp"
 #include <fstream>
+#include <sstream>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/thread/mutex.hpp>
+#include <set>
+#include "rtklib_types.hpp"
 
 namespace genesis {
 
@@ -63,4 +68,59 @@ bool save_station_config (const fs::path &file, station_config &config) {
     return true;
 }
 
+/*!
+ * \brief Load base station positions from a file.
+ * \returns true if the file was read.
+ */
+bool load_base_positions (const fs::path &file,
+                          base_position_map &positions)
+{
+    std::ifstream ifs (file.c_str ());
+    if (!ifs) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline (ifs, line)) {
+        std::istringstream is (line);
+        std::string address;
+        double pos[3];
+        if (!(is >> address) || address[0] == '#' ||
+            !(is >> pos[0] >> pos[1] >> pos[2]))
+        {
+            continue;
+        }
+        pos[0] *= D2R;
+        pos[1] *= D2R;
+        pos2ecef (pos, positions[address].c_array ());
+    }
+    return true;
+}
+
+/*!
+ * \brief Get the working directory for the station at the given address.
+ */
+fs::path station_directory (const std::string &address) {
+    return fs::path (boost::algorithm::replace_all_copy (address, ":", "."));
+}
+
+bool make_directory (const fs::path &dir, boost::system::error_code &ec) {
+    static boost::mutex mutex;
+    static std::set <fs::path> made;
+
+    boost::mutex::scoped_lock guard (mutex);
+    ec = boost::system::error_code ();
+    if (made.count (dir)) {
+        return true;
+    }
+
+    // Not an error if it already exists
+    fs::create_directory (dir, ec);
+    if (ec) {
+        return false;
+    }
+    made.insert (dir);
+    return true;
+}
+
 }
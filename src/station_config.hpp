@@ -33,7 +33,12 @@
 
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
+#include <boost/array.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/serialization/version.hpp>
+#include <ctime>
+#include <map>
+#include <string>
 
 namespace genesis {
 
@@ -44,17 +49,23 @@ class station_config {
    friend class boost::serialization::access;
 
    double if_bias_; // The IF bias recorded by front-end-cal
+   std::time_t calibrated_; // When it was recorded, or 0 if not known
 
 
    template<class Archive>
-   void serialize(Archive & ar, const unsigned int) {
+   void serialize(Archive & ar, const unsigned int version) {
        ar & if_bias_;
+       if (version > 0) {
+           ar & calibrated_;
+       }
    }
 
 public:
 
-   inline explicit station_config (double if_bias = 0)
-       : if_bias_ (if_bias)
+   inline explicit station_config (double if_bias = 0,
+                                   std::time_t calibrated = 0)
+       : if_bias_ (if_bias),
+         calibrated_ (calibrated)
       {
       }
 
@@ -65,8 +76,23 @@ public:
    inline void set_if_bias (double bias) {
        if_bias_ = bias;
    }
+
+   inline std::time_t calibrated () const {
+       return calibrated_;
+   }
+
+   inline void set_calibrated (std::time_t calibrated) {
+       calibrated_ = calibrated;
+   }
 };
 
+} // namespace genesis
+
+// Configs saved before calibration times were recorded are version 0
+BOOST_CLASS_VERSION (genesis::station_config, 1)
+
+namespace genesis {
+
 /*!
  * \brief Load a station config from a file.
  * \returns true if the config was loaded.
@@ -82,6 +108,33 @@ bool load_station_config (const boost::filesystem::path &file,
 bool save_station_config (const boost::filesystem::path &file,
                           station_config &config);
 
+/*!
+ * \brief Surveyed positions of base stations (ECEF, m) by address.
+ */
+typedef std::map <std::string, boost::array <double, 3> > base_position_map;
+
+/*!
+ * \brief Load base station positions from a file with a line for each
+ * base: its address, latitude and longitude (degrees) and ellipsoidal
+ * height (m). Blank lines and lines starting with # are skipped.
+ * \returns true if the file was read.
+ */
+bool load_base_positions (const boost::filesystem::path &file,
+                          base_position_map &positions);
+
+/*!
+ * \brief Get the working directory for the station at the given address.
+ */
+boost::filesystem::path station_directory (const std::string &address);
+
+/*!
+ * \brief Create a working directory if it doesn't exist. Each directory
+ * is only made once a run.
+ * \returns false if it couldn't be created.
+ */
+bool make_directory (const boost::filesystem::path &dir,
+                     boost::system::error_code &ec);
+
 } // namespace genesis
 
 #endif //GENESIS_STATION_CONFIG_HPP
@@ -0,0 +1,422 @@
+/*!
+ * \file supervisor.cpp
+ * \brief Restarts gnss-sdr processes that exit, keeping their sessions.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "supervisor.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "session.hpp"
+#include "station.hpp"
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/placeholders.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <gflags/gflags.h>
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <set>
+#include <signal.h>
+
+DECLARE_int32 (max_restarts);
+DECLARE_int32 (restart_delay_ms);
+DECLARE_int32 (max_restart_delay_ms);
+
+namespace genesis {
+
+namespace detail {
+
+enum {
+   PAUSE_TIMEOUT_MS = 5000  // for a paused gnss-sdr to exit, per signal
+};
+
+}
+
+struct supervisor::impl {
+   typedef boost::mutex::scoped_lock scoped_lock;
+
+   // A station's gnss-sdr, over its restarts
+   struct child {
+      child (boost::asio::io_service &service,
+             const session_ptr &sesh,
+             double IF)
+         : session_ (sesh),
+           IF_ (IF),
+           started_ (monotonic_ms ()),
+           failures_ (0),
+           paused_ (false),
+           resumed_ (false),
+           timer_ (service)
+      {
+      }
+
+      const std::string &address () const {
+         return session_->get_station ().get_address ();
+      }
+
+      session_ptr session_;
+      double IF_;
+      double started_;  // monotonic_ms
+      int failures_;    // restarts in a row that didn't stay up
+      bool paused_;     // stopped on purpose, until resumed
+      bool resumed_;    // resumed before it had exited
+      boost::asio::deadline_timer timer_;
+   };
+   typedef boost::shared_ptr <child> child_ptr;
+   typedef std::map <int, child_ptr> child_map;
+
+   impl (boost::asio::io_service &service, restart_function restart)
+      : service_ (service),
+        restart_ (restart),
+        stopped_ (false)
+      {
+      }
+
+   // Note a child's exit, and restart it after its delay or give up.
+   // Called with the mutex held.
+   static void schedule (const boost::shared_ptr <impl> &self,
+                         const child_ptr &c)
+   {
+      double uptime = monotonic_ms () - c->started_;
+      record_metric ("gnss_sdr_uptime_s", uptime / 1000);
+      record_metric ("gnss_sdr_uptime_s." + c->address (), uptime / 1000);
+
+      // It stayed up longer than it would have waited; start over
+      if (uptime > FLAGS_max_restart_delay_ms) {
+         c->failures_ = 0;
+      }
+
+      if (c->failures_ >= FLAGS_max_restarts) {
+         BOOST_LOG_SEV (self->lg_, error)
+            << "Giving up on gnss-sdr for " << c->address ()
+            << " after " << c->failures_ << " restarts.";
+         count_metric ("gnss_sdr_abandoned");
+         return;
+      }
+
+      // Double the delay with each restart in a row
+      double delay = FLAGS_restart_delay_ms;
+      for (int i = 0; i < c->failures_ && delay < FLAGS_max_restart_delay_ms;
+           i++)
+      {
+         delay *= 2;
+      }
+      delay = std::min (delay, double (FLAGS_max_restart_delay_ms));
+      c->failures_++;
+
+      BOOST_LOG_SEV (self->lg_, warning)
+         << "gnss-sdr for " << c->address () << " exited after "
+         << uptime / 1000 << " s; restarting in " << delay / 1000 << " s.";
+
+      start_after (self, c, delay);
+   }
+
+   // Restart a child after delay ms. Called with the mutex held.
+   static void start_after (const boost::shared_ptr <impl> &self,
+                            const child_ptr &c,
+                            double delay)
+   {
+      self->waiting_.insert (c);
+      c->timer_.expires_from_now (
+         boost::posix_time::milliseconds (static_cast<long> (delay)));
+      c->timer_.async_wait (boost::bind (&impl::restart,
+                                         self,
+                                         c,
+                                         boost::asio::placeholders::error));
+   }
+
+   // A child's exit, whether it crashed or was paused. Called with the
+   // mutex held.
+   static void stopped (const boost::shared_ptr <impl> &self,
+                        const child_ptr &c)
+   {
+      if (c->paused_) {
+         self->paused_.insert (c);
+         self->paused_exit_.notify_all ();
+      }
+      else if (c->resumed_) {
+         c->resumed_ = false;
+         start_after (self, c, 0);
+      }
+      else {
+         schedule (self, c);
+      }
+   }
+
+   // Wait for a paused child to exit, signalling it with sig first. Gives
+   // up if it's resumed or removed meanwhile. Called with the mutex held.
+   bool wait_exit (scoped_lock &guard, int pid, const child_ptr &c, int sig) {
+      boost::system_time deadline = boost::get_system_time () +
+         boost::posix_time::milliseconds (long (detail::PAUSE_TIMEOUT_MS));
+      bool signalled = false;
+      for (;;) {
+         child_map::const_iterator it = running_.find (pid);
+         if (!c->paused_ || stopped_ || it == running_.end () ||
+             it->second != c)
+         {
+            break;
+         }
+         if (!signalled) {
+            ::kill (pid, sig);
+            signalled = true;
+         }
+         else if (!paused_exit_.timed_wait (guard, deadline)) {
+            break;
+         }
+      }
+      return paused_.count (c) > 0;
+   }
+
+   // The running child for a station, or running_.end ()
+   child_map::iterator find_running (const station &st) {
+      child_map::iterator it = running_.begin ();
+      for (; it != running_.end (); ++it) {
+         if (it->second->session_->get_station () == st) {
+            break;
+         }
+      }
+      return it;
+   }
+
+   // The child for a station in a set, or null
+   static child_ptr find (const std::set <child_ptr> &children,
+                          const station &st)
+   {
+      BOOST_FOREACH (const child_ptr &c, children) {
+         if (c->session_->get_station () == st) {
+            return c;
+         }
+      }
+      return child_ptr ();
+   }
+
+   static void restart (const boost::shared_ptr <impl> &self,
+                        const child_ptr &c,
+                        const boost::system::error_code &ec)
+   {
+      {
+         scoped_lock guard (self->mutex_);
+         if (ec || self->stopped_ || !self->waiting_.erase (c)) {
+            return;
+         }
+      }
+
+      int pid = self->restart_ (c->session_, c->IF_);
+
+      scoped_lock guard (self->mutex_);
+      if (self->stopped_) {
+         return;
+      }
+      c->started_ = monotonic_ms ();
+      if (pid < 0) {
+         stopped (self, c);
+         return;
+      }
+
+      BOOST_LOG_SEV (self->lg_, info)
+         << "Restarted gnss-sdr for " << c->address () << " (pid "
+         << pid << ").";
+      count_metric ("gnss_sdr_restarts");
+      count_metric ("gnss_sdr_restarts." + c->address ());
+      self->running_[pid] = c;
+   }
+
+   boost::asio::io_service &service_;
+   restart_function restart_;
+   child_map running_;                 // by process ID
+   std::set <child_ptr> waiting_;      // to be restarted
+   std::set <child_ptr> paused_;       // until resumed
+   bool stopped_;
+   boost::mutex mutex_;
+   boost::condition_variable paused_exit_;  // a paused child exited
+   logger_mt lg_;
+};
+
+supervisor::supervisor (boost::asio::io_service &service,
+                        restart_function restart)
+   : impl_ (boost::make_shared<impl> (boost::ref (service), restart))
+{
+}
+
+supervisor::~supervisor () {
+   stop ();
+}
+
+void supervisor::watch (int pid, const session_ptr &sesh, double IF) {
+   impl::child_ptr c = boost::make_shared<impl::child> (
+      boost::ref (impl_->service_), sesh, IF);
+
+   impl::scoped_lock guard (impl_->mutex_);
+   if (impl_->stopped_) {
+      return;
+   }
+
+   // It may have exited and been reaped already
+   if (::kill (pid, 0) && errno == ESRCH) {
+      impl::stopped (impl_, c);
+   }
+   else {
+      impl_->running_[pid] = c;
+   }
+}
+
+bool supervisor::exited (int pid) {
+   impl::child_ptr c;
+   {
+      impl::scoped_lock guard (impl_->mutex_);
+      impl::child_map::iterator it = impl_->running_.find (pid);
+      if (it == impl_->running_.end ()) {
+         return false;
+      }
+      c = it->second;
+      impl_->running_.erase (it);
+      if (!impl_->stopped_) {
+         impl::stopped (impl_, c);
+      }
+   }
+
+   // If it was given up on, its session ends here, outside the lock
+   return true;
+}
+
+bool supervisor::pause (const station &st) {
+   impl::scoped_lock guard (impl_->mutex_);
+   if (impl_->stopped_) {
+      return false;
+   }
+
+   impl::child_map::iterator it = impl_->find_running (st);
+   if (it != impl_->running_.end ()) {
+      // It's moved to paused_ when it exits and is reaped, which may be
+      // a while after it's signalled
+      int pid = it->first;
+      impl::child_ptr c = it->second;
+      c->paused_ = true;
+      c->resumed_ = false;
+      if (impl_->wait_exit (guard, pid, c, SIGTERM)) {
+         return true;
+      }
+      if (impl_->wait_exit (guard, pid, c, SIGKILL)) {
+         return true;
+      }
+      impl::child_map::iterator still = impl_->running_.find (pid);
+      if (!c->paused_ || still == impl_->running_.end () ||
+          still->second != c)
+      {
+         return false;  // resumed, removed or stopped meanwhile
+      }
+
+      // Let it be restarted as usual if it ever exits
+      BOOST_LOG_SEV (impl_->lg_, error)
+         << "gnss-sdr for " << c->address () << " (pid " << pid
+         << ") didn't exit when paused.";
+      c->paused_ = false;
+      return false;
+   }
+
+   impl::child_ptr c = impl::find (impl_->waiting_, st);
+   if (c) {
+      boost::system::error_code ec;
+      c->timer_.cancel (ec);
+      impl_->waiting_.erase (c);
+      c->paused_ = true;
+      impl_->paused_.insert (c);
+      return true;
+   }
+   return false;
+}
+
+void supervisor::resume (const station &st, double IF) {
+   impl::scoped_lock guard (impl_->mutex_);
+   if (impl_->stopped_) {
+      return;
+   }
+
+   impl::child_ptr c = impl::find (impl_->paused_, st);
+   if (c) {
+      impl_->paused_.erase (c);
+      c->paused_ = false;
+      c->IF_ = IF;
+      impl::start_after (impl_, c, 0);
+      return;
+   }
+
+   // Not exited yet; it's restarted when it does
+   impl::child_map::iterator it = impl_->find_running (st);
+   if (it != impl_->running_.end () && it->second->paused_) {
+      it->second->paused_ = false;
+      it->second->resumed_ = true;
+      it->second->IF_ = IF;
+   }
+}
+
+supervisor::session_ptr supervisor::remove (const station &st) {
+   impl::scoped_lock guard (impl_->mutex_);
+   impl::child_ptr c;
+   impl::child_map::iterator it = impl_->find_running (st);
+   if (it != impl_->running_.end ()) {
+      // Its exit is ignored once it's out of running_
+      c = it->second;
+      ::kill (it->first, SIGTERM);
+      impl_->running_.erase (it);
+   }
+   else if ((c = impl::find (impl_->waiting_, st))) {
+      boost::system::error_code ec;
+      c->timer_.cancel (ec);
+      impl_->waiting_.erase (c);
+   }
+   else if ((c = impl::find (impl_->paused_, st))) {
+      impl_->paused_.erase (c);
+   }
+   return c ? c->session_ : session_ptr ();
+}
+
+void supervisor::stop () {
+   impl::child_map running;
+   std::set <impl::child_ptr> waiting;
+   std::set <impl::child_ptr> paused;
+   {
+      impl::scoped_lock guard (impl_->mutex_);
+      impl_->stopped_ = true;
+      running.swap (impl_->running_);
+      waiting.swap (impl_->waiting_);
+      paused.swap (impl_->paused_);
+      impl_->paused_exit_.notify_all ();  // pause () gives up
+   }
+
+   boost::system::error_code ec;
+   BOOST_FOREACH (const impl::child_ptr &c, waiting) {
+      c->timer_.cancel (ec);
+   }
+}
+
+}
@@ -0,0 +1,120 @@
+/*!
+ * \file supervisor.hpp
+ * \brief Restarts gnss-sdr processes that exit, keeping their sessions.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#pragma once
+#ifndef GENESIS_SUPERVISOR_HPP
+#define GENESIS_SUPERVISOR_HPP
+
+#include <boost/asio/io_service.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace genesis {
+
+class session;
+class station;
+
+/*!
+ * \brief Watches each station's gnss-sdr and, when it exits, starts
+ * another for the same session, so the station's position filter and
+ * navigation data carry on. A gnss-sdr that exits soon after starting
+ * waits twice as long as the last before it's restarted again, up to
+ * --max_restart_delay_ms. A station whose gnss-sdr keeps exiting is given
+ * up on after --max_restarts tries.
+ *
+ * All members are safe to call from any thread.
+ */
+class supervisor : boost::noncopyable {
+public:
+   typedef boost::shared_ptr <session> session_ptr;
+
+   /*!
+    * \brief Starts a new gnss-sdr for a session, tuned with the station's
+    * IF (Hz).
+    * \returns its process ID, or -1 if it couldn't be started.
+    */
+   typedef boost::function <int (const session_ptr &, double)>
+      restart_function;
+
+   /*!
+    * \brief Create a supervisor. Restarts are made on the io_service.
+    */
+   supervisor (boost::asio::io_service &service, restart_function restart);
+
+   ~supervisor ();
+
+   /*!
+    * \brief Watch the gnss-sdr with process ID pid, which feeds sesh.
+    * The session is kept until its station is given up on.
+    */
+   void watch (int pid, const session_ptr &sesh, double IF);
+
+   /*!
+    * \brief Tell the supervisor a child has exited.
+    * \returns true if it was watched.
+    */
+   bool exited (int pid);
+
+   /*!
+    * \brief Stop a station's gnss-sdr until it's resumed, freeing its
+    * dongle for something else. Waits until the gnss-sdr has exited and
+    * been reported by exited (), killing it if it doesn't exit when
+    * asked, so it must not be called from the io_service's threads.
+    * \returns false if the station isn't being watched or its gnss-sdr
+    * didn't exit.
+    */
+   bool pause (const station &st);
+
+   /*!
+    * \brief Start a paused station's gnss-sdr again straight away, with
+    * the given IF (Hz).
+    */
+   void resume (const station &st, double IF);
+
+   /*!
+    * \brief Stop watching a station that's gone, terminating its
+    * gnss-sdr.
+    * \returns the station's session, or null if it isn't being watched.
+    */
+   session_ptr remove (const station &st);
+
+   /*!
+    * \brief Stop restarting, and drop every session.
+    */
+   void stop ();
+
+private:
+   struct impl;
+   boost::shared_ptr <impl> impl_;
+};
+
+}
+
+#endif // GENESIS_SUPERVISOR_HPP
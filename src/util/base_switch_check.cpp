@@ -0,0 +1,282 @@
+/*!
+ * \file base_switch_check.cpp
+ * \brief Check that ambiguities moved to another base don't fix wrongly.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "rtklib.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Simulates a rover fixed against one base being switched to another a
+// few km away, with its ambiguities moved by rtkchgbase as Genesis
+// moves them, and fails if any solution after the switch is fixed to
+// the wrong position. Code is as noisy as a cheap receiver's, so the
+// phase-code offsets the ambiguities are moved by are off by several
+// cycles.
+
+enum {
+    TRIALS = 20,
+    GPS_SATS = 30,
+    MAX_EPOCHS_TO_FIX = 600,   // before the switch
+    FIXES_BEFORE_SWITCH = 10,  // in a row
+    EPOCHS_AFTER_SWITCH = 300,
+    SWITCH_HOLD = 10           // epochs, as position.cpp
+};
+
+static const double CODE_STD = 1.5;         // m, per receiver
+static const double PHASE_STD = 0.003;      // m, per receiver
+static const double CODE_SWITCH_STD = 15.0; // cycles, as position.cpp
+static const double MAX_FIX_ERROR = 0.15;   // m, a wrong L1 fix is worse
+static const double INTERVAL = 1.0;         // s between epochs
+
+struct receiver {
+    double rr[3];
+    std::vector<int> amb;  // integer ambiguity of each satellite (cycles)
+};
+
+// Six planes of five satellites
+static void constellation (gtime_t toe, nav_t &nav) {
+    for (int k = 0; k < GPS_SATS; k++) {
+        eph_t &eph = nav.eph[k];
+        eph = eph_t ();
+        eph.sat = satno (SYS_GPS, k + 1);
+        eph.iode = eph.iodc = 1;
+        eph.toe = eph.toc = eph.ttr = toe;
+        eph.toes = time2gpst (toe, &eph.week);
+        eph.A = 26560E3;
+        eph.e = 0.005;
+        eph.i0 = 55.0 * D2R;
+        eph.OMG0 = (k % 6) * 60.0 * D2R;
+        eph.M0 = ((k / 6) * 72.0 + (k % 6) * 13.0) * D2R - PI;
+        eph.omg = 0.3;
+        eph.OMGd = -8E-9;
+        eph.f0 = 1E-5 * ((k % 7) - 3);
+    }
+    for (int i = 0; i < MAXSAT; i++) {
+        for (int f = 0; f < NFREQ; f++) {
+            nav.lam[i][f] = satwavelen (i + 1, f, &nav);
+        }
+    }
+}
+
+// Code and phase of every satellite above the mask, as a receiver
+// without a clock error would measure them
+static void observe (gtime_t time, int rcv, const receiver &r,
+                     const nav_t &nav, std::mt19937 &gen,
+                     std::vector<obsd_t> &obs)
+{
+    std::normal_distribution<double> code (0.0, CODE_STD);
+    std::normal_distribution<double> phase (0.0, PHASE_STD);
+    double pos[3];
+    ecef2pos (r.rr, pos);
+
+    for (int k = 0; k < GPS_SATS; k++) {
+        const eph_t &eph = nav.eph[k];
+        double rs[3], dts, var, e[3], azel[2], range = 0.0;
+        for (int i = 0; i < 3; i++) {
+            eph2pos (timeadd (time, -range / CLIGHT), &eph, rs, &dts, &var);
+            range = geodist (rs, r.rr, e);
+        }
+        if (satazel (pos, e, azel) < 15.0 * D2R) {
+            continue;
+        }
+        double lam = nav.lam[eph.sat - 1][0];
+        obsd_t o = obsd_t ();
+        o.time = time;
+        o.sat = eph.sat;
+        o.rcv = rcv;
+        o.SNR[0] = 45 * 4;
+        o.code[0] = CODE_L1C;
+        o.P[0] = range - CLIGHT * dts + code (gen);
+        o.L[0] = (range - CLIGHT * dts + phase (gen)) / lam + r.amb[k];
+        obs.push_back (o);
+    }
+}
+
+static double error (const double *rr, const receiver &r) {
+    double d[3];
+    for (int i = 0; i < 3; i++) {
+        d[i] = rr[i] - r.rr[i];
+    }
+    return norm (d, 3);
+}
+
+// Phase-code offset of each satellite (cycles)
+static void offsets (const std::vector<obsd_t> &obs, int rcv,
+                     const nav_t &nav, std::vector<double> &off,
+                     std::vector<int> &valid)
+{
+    for (size_t i = 0; i < obs.size (); i++) {
+        const obsd_t &o = obs[i];
+        if (o.rcv == rcv) {
+            off[o.sat - 1] = o.L[0] - o.P[0] / nav.lam[o.sat - 1][0];
+            valid[o.sat - 1] = 1;
+        }
+    }
+}
+
+// Returns the number of wrong fixes after the switch, or -1 if the
+// rover never fixed before it
+static int trial (int seed, const nav_t &nav, gtime_t start,
+                  int &fixes, double &first_fix)
+{
+    std::mt19937 gen (seed);
+    std::uniform_int_distribution<int> amb (-1000000, 1000000);
+    std::uniform_real_distribution<double> u (-1.0, 1.0);
+
+    double pos[3], enu[3];
+    receiver rover, base[2];
+    pos[0] = (-27.47 + 0.1 * u (gen)) * D2R;
+    pos[1] = (153.03 + 0.1 * u (gen)) * D2R;
+    pos[2] = 50.0;
+    pos2ecef (pos, rover.rr);
+    for (int b = 0; b < 2; b++) {
+        enu[0] = b ? 0.0 : 4000.0;
+        enu[1] = b ? 4000.0 : 0.0;
+        enu[2] = 0.0;
+        double d[3];
+        enu2ecef (pos, enu, d);
+        for (int i = 0; i < 3; i++) {
+            base[b].rr[i] = rover.rr[i] + d[i];
+        }
+    }
+    receiver *all[3] = { &rover, &base[0], &base[1] };
+    for (int r = 0; r < 3; r++) {
+        all[r]->amb.resize (GPS_SATS);
+        for (int k = 0; k < GPS_SATS; k++) {
+            all[r]->amb[k] = amb (gen);
+        }
+    }
+
+    prcopt_t opt = prcopt_default;
+    opt.mode = PMODE_KINEMA;
+    opt.nf = 1;
+    opt.navsys = SYS_GPS;
+    opt.ionoopt = IONOOPT_OFF;
+    opt.tropopt = TROPOPT_OFF;
+    opt.eratio[0] = CODE_STD / PHASE_STD;
+    for (int i = 0; i < 3; i++) {
+        opt.rb[i] = base[0].rr[i];
+    }
+    rtk_t rtk;
+    rtkinit (&rtk, &opt);
+
+    // Fix against the first base
+    gtime_t time = timeadd (start, 3600.0 * u (gen));
+    std::vector<obsd_t> obs;
+    int n = 0, fixed = 0;
+    for (; n < MAX_EPOCHS_TO_FIX && fixed < FIXES_BEFORE_SWITCH; n++) {
+        time = timeadd (time, INTERVAL);
+        obs.clear ();
+        observe (time, 1, rover, nav, gen, obs);
+        observe (time, 2, base[0], nav, gen, obs);
+        rtkpos (&rtk, &obs[0], obs.size (), &nav);
+        fixed = rtk.sol.stat == SOLQ_FIX ? fixed + 1 : 0;
+    }
+    if (fixed < FIXES_BEFORE_SWITCH) {
+        rtkfree (&rtk);
+        return -1;
+    }
+
+    // Move to the second base, by its offsets in the next epoch
+    std::vector<double> from (MAXSAT, 0.0), to (MAXSAT, 0.0);
+    std::vector<double> shift (MAXSAT, 0.0);
+    std::vector<int> had (MAXSAT, 0), has (MAXSAT, 0);
+    offsets (obs, 2, nav, from, had);
+    int wrong = 0;
+    fixes = 0;
+    first_fix = 0.0;
+    for (int k = 0; k < EPOCHS_AFTER_SWITCH; k++) {
+        time = timeadd (time, INTERVAL);
+        obs.clear ();
+        observe (time, 1, rover, nav, gen, obs);
+        observe (time, 2, base[1], nav, gen, obs);
+        if (k == 0) {
+            offsets (obs, 2, nav, to, has);
+            for (int i = 0; i < MAXSAT; i++) {
+                has[i] = has[i] && had[i];
+                shift[i] = from[i] - to[i];
+            }
+            rtkchgbase (&rtk, &shift[0], &has[0],
+                        2.0 * CODE_SWITCH_STD * CODE_SWITCH_STD, SWITCH_HOLD);
+            for (int i = 0; i < 3; i++) {
+                rtk.opt.rb[i] = base[1].rr[i];
+            }
+        }
+        rtkpos (&rtk, &obs[0], obs.size (), &nav);
+        if (rtk.sol.stat != SOLQ_FIX) {
+            continue;
+        }
+        if (!fixes++) {
+            first_fix = (k + 1) * INTERVAL;
+        }
+        if (error (rtk.sol.rr, rover) > MAX_FIX_ERROR) {
+            wrong++;
+        }
+    }
+    rtkfree (&rtk);
+    return wrong;
+}
+
+int main () {
+    double ep0[6] = {2015, 6, 1, 12, 0, 0};
+    gtime_t toe = epoch2time (ep0);
+    nav_t nav = nav_t ();
+    nav.eph = static_cast<eph_t *> (calloc (GPS_SATS, sizeof (eph_t)));
+    nav.n = nav.nmax = GPS_SATS;
+    constellation (toe, nav);
+
+    int wrong = 0, unfixed = 0;
+    for (int t = 0; t < TRIALS; t++) {
+        int fixes = 0;
+        double first = 0.0;
+        int w = trial (40 + t, nav, timeadd (toe, -1800.0), fixes, first);
+        if (w < 0) {
+            std::cout << "trial " << t << ": no fix before the switch"
+                      << std::endl;
+            unfixed++;
+            continue;
+        }
+        std::cout << "trial " << t << ": " << fixes << " of "
+                  << EPOCHS_AFTER_SWITCH << " epochs fixed after the switch, "
+                  << "first after " << first << " s, " << w << " wrong"
+                  << std::endl;
+        wrong += w;
+    }
+    freenavidx (&nav);
+    free (nav.eph);
+
+    bool ok = !wrong && unfixed < TRIALS;
+    if (!ok) {
+        std::cerr << (wrong ? "wrong fixes after a base switch" :
+                      "the rover never fixed") << std::endl;
+    }
+    return ok ? 0 : 1;
+}
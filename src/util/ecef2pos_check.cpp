@@ -0,0 +1,126 @@
+/*!
+ * \file ecef2pos_check.cpp
+ * \brief Check closed-form geodetic conversion against the iterative one.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "rtklib.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Converts random ECEF positions, including the poles, the equator and
+// heights up to beyond geostationary orbit, with ecef2pos_cf and with
+// ecef2pos_itr, and fails if they are more than a micron apart. Also
+// checks that ecef2posn matches and that the closed form round-trips
+// through pos2ecef.
+
+enum {
+    POSITIONS = 100000
+};
+
+static const double MAX_DIFF = 1E-6;        // m
+static const double MIN_HEIGHT = -3E3;      // m
+static const double MAX_HEIGHT = 3E7;       // m
+
+// Distance (m) between two geodetic positions near ecef r
+static double distance (const double *r, const double *a, const double *b) {
+    double rr = std::sqrt (r[0] * r[0] + r[1] * r[1] + r[2] * r[2]);
+    double dlon = a[1] - b[1];
+    if (dlon > PI) {
+        dlon -= 2.0 * PI;
+    }
+    else if (dlon < -PI) {
+        dlon += 2.0 * PI;
+    }
+    double n = (a[0] - b[0]) * rr, e = dlon * std::cos (a[0]) * rr;
+    double u = a[2] - b[2];
+    return std::sqrt (n * n + e * e + u * u);
+}
+
+static void random_position (std::mt19937 &gen, int k, double *r) {
+    std::uniform_real_distribution<double> lat (-PI / 2.0, PI / 2.0);
+    std::uniform_real_distribution<double> lon (-PI, PI);
+    std::uniform_real_distribution<double> u (0.0, 1.0);
+    double pos[3];
+
+    // Heights spread evenly in log over the range
+    pos[2] = MIN_HEIGHT + (MAX_HEIGHT - MIN_HEIGHT) *
+       (std::pow (10.0, 4.0 * u (gen)) - 1.0) / 9999.0;
+    pos[1] = lon (gen);
+    switch (k % 5) {
+    case 0: pos[0] = PI / 2.0; break;         // north pole
+    case 1: pos[0] = -PI / 2.0; break;        // south pole
+    case 2: pos[0] = 1E-9 * lat (gen); break; // equator
+    default: pos[0] = lat (gen); break;
+    }
+    pos2ecef (pos, r);
+    if (k % 5 < 2 && k % 2) {
+        r[0] = r[1] = 0.0;                    // exactly on the axis
+    }
+}
+
+int main () {
+    std::mt19937 gen (36);
+    std::vector<double> r (3 * POSITIONS), pos (3 * POSITIONS);
+
+    for (int k = 0; k < POSITIONS; k++) {
+        random_position (gen, k, &r[k * 3]);
+    }
+    ecef2posn (POSITIONS, &r[0], &pos[0]);
+
+    double itr = 0.0, round = 0.0;
+    int failures = 0;
+    for (int k = 0; k < POSITIONS; k++) {
+        const double *rk = &r[k * 3];
+        double cf[3], ref[3], back[3];
+        if (!ecef2pos_cf (rk, cf)) {
+            failures++;
+            continue;
+        }
+        ecef2pos_itr (rk, ref);
+        pos2ecef (cf, back);
+        if (!std::equal (cf, cf + 3, &pos[k * 3])) {
+            failures++;
+        }
+        itr = std::max (itr, distance (rk, cf, ref));
+        for (int i = 0; i < 3; i++) {
+            round = std::max (round, std::fabs (back[i] - rk[i]));
+        }
+    }
+
+    std::cout << POSITIONS << " positions: closed form within " << itr
+              << " m of iteration, round trip within " << round << " m"
+              << std::endl;
+
+    bool ok = !failures && itr <= MAX_DIFF && round <= MAX_DIFF;
+    if (!ok) {
+        std::cerr << "ecef2pos_cf disagrees with ecef2pos_itr" << std::endl;
+    }
+    return ok ? 0 : 1;
+}
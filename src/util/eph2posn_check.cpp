@@ -0,0 +1,128 @@
+/*!
+ * \file eph2posn_check.cpp
+ * \brief Check batched orbit propagation against eph2pos.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "rtklib.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Propagates random broadcast ephemerides with eph2posn and, one at a
+// time, with eph2pos, and fails if they disagree. Velocities and clock
+// drifts are checked against a 1 ms difference of eph2pos, as satpos
+// computed them before eph2posn.
+
+enum {
+    EPHEMERIDES = 5000,
+    GPS_SATS = 32,
+    GAL_SATS = 30
+};
+
+static const double MAX_POSITION_DIFF = 1E-3;  // m
+static const double MAX_CLOCK_DIFF = 1E-3;     // m
+static const double MAX_VELOCITY_DIFF = 1E-3;  // m/s, the difference's error
+static const double MAX_DRIFT_DIFF = 1E-12;    // s/s
+static const double DIFF_STEP = 1E-3;          // s
+
+static void random_eph (std::mt19937 &gen, int k, gtime_t toe, eph_t &eph) {
+    std::uniform_real_distribution<double> u (-1.0, 1.0);
+    bool gal = k % 3 == 2;
+
+    eph = eph_t ();
+    eph.sat = gal ? satno (SYS_GAL, k % GAL_SATS + 1) :
+       satno (SYS_GPS, k % GPS_SATS + 1);
+    eph.toe = eph.toc = toe;
+    eph.toes = time2gpst (toe, &eph.week);
+    eph.A = (gal ? 29600E3 : 26560E3) + 1E3 * u (gen);
+    eph.e = 0.01 + 0.01 * u (gen);
+    eph.i0 = (gal ? 56.0 : 55.0) * D2R + 0.02 * u (gen);
+    eph.OMG0 = PI * u (gen);
+    eph.omg = PI * u (gen);
+    eph.M0 = PI * u (gen);
+    eph.deln = 5E-9 * u (gen);
+    eph.OMGd = -8E-9 + 1E-9 * u (gen);
+    eph.idot = 1E-10 * u (gen);
+    eph.crc = 300.0 * u (gen);
+    eph.crs = 100.0 * u (gen);
+    eph.cuc = 5E-6 * u (gen);
+    eph.cus = 1E-5 * u (gen);
+    eph.cic = 2E-7 * u (gen);
+    eph.cis = 2E-7 * u (gen);
+    eph.f0 = 5E-4 * u (gen);
+    eph.f1 = 1E-11 * u (gen);
+    eph.f2 = 1E-19 * u (gen);
+}
+
+int main () {
+    double ep0[6] = {2015, 6, 1, 12, 0, 0};
+    gtime_t toe = epoch2time (ep0);
+    std::mt19937 gen (33);
+    std::uniform_real_distribution<double> age (-7200.0, 7200.0);
+
+    std::vector<eph_t> ephs (EPHEMERIDES);
+    std::vector<const eph_t *> eph (EPHEMERIDES);
+    std::vector<gtime_t> time (EPHEMERIDES);
+    for (int k = 0; k < EPHEMERIDES; k++) {
+        random_eph (gen, k, toe, ephs[k]);
+        eph[k] = &ephs[k];
+        time[k] = timeadd (toe, age (gen));
+    }
+
+    std::vector<double> rs (6 * EPHEMERIDES), dts (2 * EPHEMERIDES);
+    std::vector<double> var (EPHEMERIDES);
+    eph2posn (EPHEMERIDES, &time[0], &eph[0], &rs[0], &dts[0], &var[0]);
+
+    double pos = 0.0, clk = 0.0, vel = 0.0, drift = 0.0;
+    for (int k = 0; k < EPHEMERIDES; k++) {
+        double r0[6], r1[6], c0, c1, v;
+        eph2pos (time[k], eph[k], r0, &c0, &v);
+        eph2pos (timeadd (time[k], DIFF_STEP), eph[k], r1, &c1, &v);
+        for (int i = 0; i < 3; i++) {
+            pos = std::max (pos, std::fabs (rs[i + k * 6] - r0[i]));
+            vel = std::max (vel, std::fabs (rs[i + 3 + k * 6] -
+                                            (r1[i] - r0[i]) / DIFF_STEP));
+        }
+        clk = std::max (clk, CLIGHT * std::fabs (dts[k * 2] - c0));
+        drift = std::max (drift, std::fabs (dts[1 + k * 2] -
+                                            (c1 - c0) / DIFF_STEP));
+    }
+
+    std::cout << EPHEMERIDES << " ephemerides: positions within " << pos
+              << " m, clocks within " << clk << " m, velocities within "
+              << vel << " m/s, clock drifts within " << drift << " s/s"
+              << std::endl;
+
+    bool ok = pos <= MAX_POSITION_DIFF && clk <= MAX_CLOCK_DIFF &&
+       vel <= MAX_VELOCITY_DIFF && drift <= MAX_DRIFT_DIFF;
+    if (!ok) {
+        std::cerr << "eph2posn disagrees with eph2pos" << std::endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -30,35 +30,46 @@
 #include "packet.hpp"
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
 #include <cstring>
 #include <iostream>
+#include <unistd.h>
 
 enum {
     GENESIS_PORT = 9255,
     RTL_TCP_PORT = 1234,
-    DATA_SIZE = genesis::packet::FIXED_DATA_SIZE
+    DATA_SIZE = genesis::packet::FIXED_DATA_SIZE,
+    HEARTBEAT_SIZE = genesis::packet::HEARTBEAT_DATA_SIZE,
+    HEARTBEAT_INTERVAL_MS = 1000
 };
 
 using namespace boost::asio::ip;
 
 int main (int argc, char *argv[]) {
     try {
-        if (argc < 2 || argc > 3) {
-            std::cerr << "Usage: ping <address> [r|b]" << std::endl
-                      << "r is rover (default) and b is base" << std::endl;
+        if (argc < 2 || argc > 4) {
+            std::cerr << "Usage: ping <address> [r|b] [id]" << std::endl
+                      << "r is rover (default) and b is base" << std::endl
+                      << "With a station ID, send heartbeats every second "
+                      << "until killed" << std::endl;
             return 1;
         }
         bool base = false;
-        if (argc == 3) {
+        if (argc >= 3) {
             base = std::string ("b") == argv[2];
         }
+        bool heartbeat = argc == 4;
+        unsigned id = 0;
+        if (heartbeat) {
+            id = boost::lexical_cast<unsigned> (argv[3]);
+        }
 
         boost::asio::io_service service;
         address addr = address::from_string (argv[1]);
         udp::endpoint ep (addr, GENESIS_PORT);
         udp::socket socket (service, ep.protocol ());
 
-        char data[DATA_SIZE];
+        char data[HEARTBEAT_SIZE];
         ::memset (data, 0, sizeof (data));
 
         unsigned short *port = reinterpret_cast <unsigned short *>(&data[0]);
@@ -72,12 +83,36 @@ int main (int argc, char *argv[]) {
            genesis::station::STATION_TYPE_ROVER;
         *type = boost::asio::detail::socket_ops::host_to_network_long (*type);
 
+        if (!heartbeat) {
+            std::cout << "Sending "
+                      << (base ? "base" : "rover")
+                      << " ping to Genesis at " << addr
+                      << std::endl;
+
+            socket.send_to (boost::asio::buffer (data, DATA_SIZE), ep);
+            return 0;
+        }
+
+        data[genesis::packet::VERSION_OFFSET] =
+           genesis::packet::HEARTBEAT_VERSION;
+        unsigned *station_id = reinterpret_cast <unsigned *>(
+            &data[genesis::packet::ID_OFFSET]);
+        *station_id = boost::asio::detail::socket_ops::host_to_network_long (id);
+        unsigned *sequence = reinterpret_cast <unsigned *>(
+            &data[genesis::packet::SEQUENCE_OFFSET]);
+
         std::cout << "Sending "
                   << (base ? "base" : "rover")
-                  << " ping to Genesis at " << addr
+                  << " heartbeats as station " << id
+                  << " to Genesis at " << addr
                   << std::endl;
 
-        socket.send_to (boost::asio::buffer (data, DATA_SIZE), ep);
+        for (unsigned seq = 0;; seq++) {
+            *sequence =
+               boost::asio::detail::socket_ops::host_to_network_long (seq);
+            socket.send_to (boost::asio::buffer (data, HEARTBEAT_SIZE), ep);
+            ::usleep (HEARTBEAT_INTERVAL_MS * 1000);
+        }
     }
     catch (std::exception &e) {
         std::cerr << "Exception: " << e.what () << std::endl;
@@ -0,0 +1,160 @@
+/*!
+ * \file geoid_bench.cpp
+ * \brief Benchmark concurrent geoid lookups from a memory-mapped model.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "rtklib.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Writes a synthetic EGM96 15' grid, then times random geoidh lookups on
+// one thread and on several at once. Fails if a thread's heights differ
+// from the same lookups made alone, or the grid isn't read back exactly.
+// Usage: geoid_bench [threads] [lookups per thread]
+
+enum {
+    NLON = 1440,          // egm96 15' grid, from 0 east
+    NLAT = 721            // from 90 north
+};
+
+static const int DEFAULT_LOOKUPS = 500000;
+
+static const char *const GRID_FILE = "geoid_bench.dac";
+
+// Synthetic geoid height (cm) at a grid point
+static short grid_height (int i, int j) {
+    double lon = i * 0.25 * D2R, lat = (90.0 - j * 0.25) * D2R;
+    return static_cast<short> (
+       5000.0 * std::sin (2.0 * lat) * std::cos (3.0 * lon) +
+       3000.0 * std::cos (lat) * std::sin (7.0 * lon));
+}
+
+static bool write_grid (const char *file) {
+    FILE *fp = std::fopen (file, "wb");
+    if (!fp) {
+        return false;
+    }
+    for (int j = 0; j < NLAT; j++) {
+        for (int i = 0; i < NLON; i++) {
+            unsigned short h = static_cast<unsigned short> (grid_height (i, j));
+            unsigned char b[2] = {
+                static_cast<unsigned char> (h >> 8),
+                static_cast<unsigned char> (h & 0xff)  // big-endian
+            };
+            std::fwrite (b, 1, 2, fp);
+        }
+    }
+    return std::fclose (fp) == 0;
+}
+
+// Heights at random positions, the same for the same seed
+static void lookups (unsigned seed, int n, std::vector<double> &h) {
+    std::mt19937 gen (seed);
+    std::uniform_real_distribution<double> lat (-PI / 2.0, PI / 2.0);
+    std::uniform_real_distribution<double> lon (-PI, PI);
+    h.resize (n);
+    for (int k = 0; k < n; k++) {
+        double pos[3] = {lat (gen), lon (gen), 0.0};
+        h[k] = geoidh (pos);
+    }
+}
+
+// Lookups per second over threads running at once
+static double run (int threads, int n,
+                   std::vector<std::vector<double> > &heights)
+{
+    heights.assign (threads, std::vector<double> ());
+    std::vector<std::thread> workers;
+    std::chrono::steady_clock::time_point start =
+       std::chrono::steady_clock::now ();
+    for (int t = 0; t < threads; t++) {
+        workers.push_back (std::thread (lookups, t + 1, n,
+                                        std::ref (heights[t])));
+    }
+    for (size_t t = 0; t < workers.size (); t++) {
+        workers[t].join ();
+    }
+    std::chrono::duration<double> took =
+       std::chrono::steady_clock::now () - start;
+    return threads * n / took.count ();
+}
+
+int main (int argc, char *argv[]) {
+    int threads = argc > 1 ? std::atoi (argv[1]) :
+       static_cast<int> (std::thread::hardware_concurrency ());
+    int n = argc > 2 ? std::atoi (argv[2]) : DEFAULT_LOOKUPS;
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    if (!write_grid (GRID_FILE) || !opengeoid (GEOID_EGM96_M150, GRID_FILE)) {
+        std::cerr << "Failed to write and open " << GRID_FILE << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+
+    // Grid points are read back exactly
+    for (int j = 1; j < NLAT - 1; j += 37) {
+        for (int i = 0; i < NLON; i += 53) {
+            double pos[3] = {(90.0 - j * 0.25) * D2R, i * 0.25 * D2R, 0.0};
+            if (std::fabs (geoidh (pos) - grid_height (i, j) * 0.01) > 1E-9) {
+                failures++;
+            }
+        }
+    }
+
+    // Each thread alone, then all at once
+    std::vector<std::vector<double> > alone (threads), together;
+    std::vector<std::vector<double> > one;
+    double single = run (1, n, one);
+    for (int t = 0; t < threads; t++) {
+        lookups (t + 1, n, alone[t]);
+    }
+    double concurrent = run (threads, n, together);
+    for (int t = 0; t < threads; t++) {
+        if (together[t] != alone[t]) {
+            failures++;
+        }
+    }
+    closegeoid ();
+    std::remove (GRID_FILE);
+
+    std::cout << "1 thread: " << single / 1E6 << "M lookups/s" << std::endl
+              << threads << " threads: " << concurrent / 1E6
+              << "M lookups/s" << std::endl;
+    if (failures) {
+        std::cerr << failures << " lookups differed" << std::endl;
+    }
+    return failures ? 1 : 0;
+}
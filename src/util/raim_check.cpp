@@ -0,0 +1,274 @@
+/*!
+ * \file raim_check.cpp
+ * \brief Check RAIM FDE makes the same exclusions as the exhaustive search.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include "rtklib.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Replays synthetic epochs through raim_fde and the exhaustive search it
+// replaced, and fails if they exclude different satellites or reach
+// different solutions.
+
+enum {
+    EPOCHS = 500,      // of each kind
+    GPS_SATS = 32,
+    GAL_SATS = 30
+};
+
+static const double GPS_RADIUS = 26560E3;       // orbit radius (m)
+static const double GAL_RADIUS = 29600E3;
+static const double CODE_NOISE = 0.3;           // pseudorange noise std (m)
+static const double CLOCK_BIAS = 1E4;           // receiver clock (m)
+static const double GAL_OFFSET = 5.0;           // gal-gps time offset (m)
+static const double MAX_SOLUTION_DIFF = 1E-3;   // between the two (m)
+
+enum epoch_kind {
+    CLEAN,                // no faults
+    FAULT,                // one gps satellite faulted
+    TWO_FAULTS,           // two gps satellites faulted
+    LONE_GALILEO,         // one galileo satellite, a gps satellite faulted
+    LONE_GALILEO_FAULT,   // one galileo satellite, faulted itself
+    GALILEO_FAULT,        // several galileo satellites, one faulted
+    EPOCH_KINDS
+};
+
+static const char *const KIND_NAMES[EPOCH_KINDS] = {
+    "clean",
+    "fault",
+    "two faults",
+    "lone galileo",
+    "lone galileo faulted",
+    "galileo faulted"
+};
+
+struct epoch {
+    std::vector<obsd_t> obs;
+    std::vector<double> rs, dts, vare;
+    std::vector<int> svh;
+};
+
+static nav_t nav;
+
+// Add a satellite in view of the receiver at rr, with a pseudorange error
+static void add_sat (std::mt19937 &gen, gtime_t time, const double *rr,
+                     int sat, double radius, double offset, double error,
+                     const prcopt_t &opt, epoch &ep)
+{
+    std::uniform_real_distribution<double> az (0.0, 2.0 * PI);
+    std::uniform_real_distribution<double> el (opt.elmin + 2.0 * D2R,
+                                               88.0 * D2R);
+    std::uniform_real_distribution<double> clock (-1E-4, 1E-4);
+
+    double pos[3], E[9], enu[3], e[3], rs[6] = {0}, azel[2];
+    double a = az (gen), b = el (gen);
+    ecef2pos (rr, pos);
+    xyz2enu (pos, E);
+    enu[0] = std::sin (a) * std::cos (b);
+    enu[1] = std::cos (a) * std::cos (b);
+    enu[2] = std::sin (b);
+    matmul ("TN", 3, 1, 3, 1.0, E, enu, 0.0, e);
+
+    // Along the line of sight to the orbit
+    double d = dot (rr, e, 3);
+    double t = -d + std::sqrt (d * d - dot (rr, rr, 3) + radius * radius);
+    for (int i = 0; i < 3; i++) {
+        rs[i] = rr[i] + t * e[i];
+    }
+    double dts = clock (gen);
+
+    double r = geodist (rs, rr, e), dion, vion, dtrp, vtrp;
+    satazel (pos, e, azel);
+    ionocorr (time, &nav, sat, pos, azel, IONOOPT_BRDC, &dion, &vion);
+    tropcorr (time, &nav, pos, azel, TROPOPT_SAAS, &dtrp, &vtrp);
+
+    obsd_t o;
+    std::memset (&o, 0, sizeof (o));
+    o.time = time;
+    o.sat = sat;
+    o.rcv = 1;
+    o.code[0] = CODE_L1C;
+    o.SNR[0] = 45 * 4;
+    o.P[0] = r + CLOCK_BIAS + offset - CLIGHT * dts + dion + dtrp + error;
+
+    ep.obs.push_back (o);
+    ep.rs.insert (ep.rs.end (), rs, rs + 6);
+    ep.dts.push_back (dts);
+    ep.dts.push_back (0.0);
+    ep.vare.push_back (0.0);
+    ep.svh.push_back (0);
+}
+
+static void make_epoch (std::mt19937 &gen, epoch_kind kind, gtime_t time,
+                        const double *rr, const prcopt_t &opt, epoch &ep)
+{
+    std::uniform_int_distribution<int> ngps (kind == TWO_FAULTS ? 8 : 6, 11);
+    std::uniform_int_distribution<int> ngal (3, 6);
+    std::normal_distribution<double> noise (0.0, CODE_NOISE);
+    std::uniform_real_distribution<double> size (10.0, 300.0);
+    std::uniform_int_distribution<int> sign (0, 1);
+
+    int gps = ngps (gen);
+    int gal = kind == LONE_GALILEO || kind == LONE_GALILEO_FAULT ? 1 :
+       kind == GALILEO_FAULT ? ngal (gen) : 0;
+
+    // Which satellites are faulted: gps first, then galileo
+    std::vector<int> faulted;
+    if (kind == FAULT || kind == TWO_FAULTS || kind == LONE_GALILEO) {
+        faulted.push_back (std::uniform_int_distribution<int> (
+                              0, gps - 1) (gen));
+    }
+    if (kind == TWO_FAULTS) {
+        int second;
+        do {
+            second = std::uniform_int_distribution<int> (0, gps - 1) (gen);
+        } while (second == faulted[0]);
+        faulted.push_back (second);
+    }
+    if (kind == LONE_GALILEO_FAULT || kind == GALILEO_FAULT) {
+        faulted.push_back (gps + std::uniform_int_distribution<int> (
+                              0, gal - 1) (gen));
+    }
+
+    std::vector<int> prns (GPS_SATS);
+    for (int i = 0; i < GPS_SATS; i++) {
+        prns[i] = i + 1;
+    }
+    std::shuffle (prns.begin (), prns.end (), gen);
+
+    for (int i = 0; i < gps + gal; i++) {
+        double error = noise (gen);
+        for (size_t f = 0; f < faulted.size (); f++) {
+            if (faulted[f] == i) {
+                error += (sign (gen) ? 1.0 : -1.0) * size (gen);
+            }
+        }
+        if (i < gps) {
+            add_sat (gen, time, rr, satno (SYS_GPS, prns[i]), GPS_RADIUS,
+                     0.0, error, opt, ep);
+        }
+        else {
+            add_sat (gen, time, rr, satno (SYS_GAL, (i - gps) % GAL_SATS + 1),
+                     GAL_RADIUS, GAL_OFFSET, error, opt, ep);
+        }
+    }
+}
+
+// The satellite excluded, or 0
+static int excluded (const epoch &ep, const int *vsat, int stat) {
+    if (!stat) {
+        return 0;
+    }
+    for (size_t i = 0; i < ep.obs.size (); i++) {
+        if (!vsat[i]) {
+            return ep.obs[i].sat;
+        }
+    }
+    return 0;
+}
+
+int main () {
+    prcopt_t opt = prcopt_default;
+    opt.navsys = SYS_GPS | SYS_GAL;
+    opt.ionoopt = IONOOPT_BRDC;
+    opt.tropopt = TROPOPT_SAAS;
+
+    for (int i = 0; i < MAXSAT; i++) {
+        for (int j = 0; j < NFREQ; j++) {
+            nav.lam[i][j] = lam_carr[j];
+        }
+    }
+
+    double pos[3] = {-27.5 * D2R, 153.0 * D2R, 50.0}, rr[3];
+    pos2ecef (pos, rr);
+
+    double ep0[6] = {2015, 6, 1, 0, 0, 0};
+    gtime_t time = epoch2time (ep0);
+    std::mt19937 gen (31);
+    int failures = 0;
+
+    for (int kind = 0; kind < EPOCH_KINDS; kind++) {
+        int exclusions = 0, mismatches = 0;
+        for (int k = 0; k < EPOCHS; k++) {
+            epoch ep;
+            make_epoch (gen, epoch_kind (kind), timeadd (time, k), rr, opt,
+                        ep);
+            int n = static_cast<int> (ep.obs.size ());
+
+            sol_t sol[2];
+            std::vector<double> azel (2 * n * 2), resp (n * 2);
+            std::vector<int> vsat (n * 2, 1);
+            int stat[2];
+            char msg[2][128];
+            for (int exh = 0; exh < 2; exh++) {
+                std::memset (&sol[exh], 0, sizeof (sol[exh]));
+                stat[exh] = raimfde (&ep.obs[0], n, &ep.rs[0], &ep.dts[0],
+                                     &ep.vare[0], &ep.svh[0], &nav, &opt,
+                                     exh, &sol[exh], &azel[exh * 2 * n],
+                                     &vsat[exh * n], &resp[exh * n],
+                                     msg[exh]);
+            }
+
+            int sat[2] = {excluded (ep, &vsat[0], stat[0]),
+                          excluded (ep, &vsat[n], stat[1])};
+            double diff = 0.0;
+            if (stat[0] && stat[1]) {
+                for (int i = 0; i < 3; i++) {
+                    double d = sol[0].rr[i] - sol[1].rr[i];
+                    diff += d * d;
+                }
+                diff = std::sqrt (diff);
+            }
+            if (stat[0] != stat[1] || sat[0] != sat[1] ||
+                diff > MAX_SOLUTION_DIFF)
+            {
+                char id[2][8];
+                satno2id (sat[0], id[0]);
+                satno2id (sat[1], id[1]);
+                std::cerr << KIND_NAMES[kind] << " epoch " << k
+                          << ": closed form stat=" << stat[0]
+                          << " sat=" << id[0]
+                          << ", exhaustive stat=" << stat[1]
+                          << " sat=" << id[1]
+                          << ", solutions " << diff << " m apart"
+                          << std::endl;
+                mismatches++;
+            }
+            exclusions += stat[1];
+        }
+        std::cout << KIND_NAMES[kind] << ": " << EPOCHS << " epochs, "
+                  << exclusions << " exclusions, " << mismatches
+                  << " mismatches" << std::endl;
+        failures += mismatches;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,177 @@
+/*!
+ * \file spawn_bench.cpp
+ * \brief Benchmark the ways of starting a child process.
+ * \author Anthony Arnold, 2015. anthony.arnold(at)uqconnect.edu.au
+ *
+ *
+ * -------------------------------------------------------------------------
+ *
+ * Copyright (C) Anthony Arnold 2015
+ *
+ * Genesis is a realtime multi-station GNSS receiver.
+ *
+ * This file is part of Genesis.
+ *
+ * Genesis is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Genesis is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Genesis. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * -------------------------------------------------------------------------
+ */
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+// Times starting a child with fork, posix_spawn and vfork from a parent
+// of a given size, each set up as genesis::spawn sets up gnss-sdr: output
+// to a pipe, other descriptors closed, run in a directory. Fails if any
+// child can't be started or doesn't exit cleanly.
+// Usage: spawn_bench [launches] [parent MB]
+
+#if defined (__GLIBC__) && __GLIBC_PREREQ (2, 34)
+#define BENCH_POSIX_SPAWN 1
+#endif
+
+enum {
+    CLOSE_FDS = 1024        // descriptors the fork and vfork children close
+};
+
+static const int DEFAULT_LAUNCHES = 100;
+static const long DEFAULT_PARENT_MB = 64;
+
+static const char *const CHILD = "/bin/true";
+static const char *const CHILD_DIR = "/";
+
+// Only system calls, so the same child serves fork and vfork
+static void child (int out, char **argv) {
+    while ((dup2 (out, STDOUT_FILENO) == -1) && (errno == EINTR)) {}
+    while ((dup2 (out, STDERR_FILENO) == -1) && (errno == EINTR)) {}
+    for (int fd = STDERR_FILENO + 1; fd < CLOSE_FDS; fd++) {
+        ::close (fd);
+    }
+    if (::chdir (CHILD_DIR) == 0) {
+        execv (CHILD, argv);
+    }
+    _exit (127);
+}
+
+static pid_t start_fork (int out, char **argv) {
+    pid_t pid = ::fork ();
+    if (pid == 0) {
+        child (out, argv);
+    }
+    return pid;
+}
+
+static pid_t start_vfork (int out, char **argv) {
+    pid_t pid = ::vfork ();
+    if (pid == 0) {
+        child (out, argv);
+    }
+    return pid;
+}
+
+#ifdef BENCH_POSIX_SPAWN
+static pid_t start_posix_spawn (int out, char **argv) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init (&actions);
+    posix_spawn_file_actions_adddup2 (&actions, out, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2 (&actions, out, STDERR_FILENO);
+    posix_spawn_file_actions_addclosefrom_np (&actions, STDERR_FILENO + 1);
+    posix_spawn_file_actions_addchdir_np (&actions, CHILD_DIR);
+
+    pid_t pid = -1;
+    int rv = posix_spawn (&pid, CHILD, &actions, 0, argv, environ);
+    posix_spawn_file_actions_destroy (&actions);
+    if (rv) {
+        errno = rv;
+        return -1;
+    }
+    return pid;
+}
+#endif
+
+// Mean milliseconds to start a child, or -1 if one failed
+static double time_starts (pid_t (*start) (int, char **), int launches) {
+    char *argv[] = {const_cast<char *> (CHILD), 0};
+    std::chrono::duration<double, std::milli> total (0.0);
+
+    for (int i = 0; i < launches; i++) {
+        int p[2];
+        if (::pipe2 (p, O_CLOEXEC)) {
+            return -1.0;
+        }
+        std::chrono::steady_clock::time_point before =
+           std::chrono::steady_clock::now ();
+        pid_t pid = start (p[1], argv);
+        total += std::chrono::steady_clock::now () - before;
+        close (p[1]);
+        close (p[0]);
+
+        int status = 0;
+        if (pid < 0 || ::waitpid (pid, &status, 0) != pid ||
+            !WIFEXITED (status) || WEXITSTATUS (status) != 0) {
+            return -1.0;
+        }
+    }
+    return total.count () / launches;
+}
+
+int main (int argc, char *argv[]) {
+    int launches = argc > 1 ? std::atoi (argv[1]) : DEFAULT_LAUNCHES;
+    long mb = argc > 2 ? std::atol (argv[2]) : DEFAULT_PARENT_MB;
+    if (launches < 1) {
+        launches = 1;
+    }
+
+    // Touched, so fork has the page tables to copy
+    std::vector<char> parent (mb << 20);
+    std::memset (&parent[0], 1, parent.size ());
+
+    struct method {
+        const char *name;
+        pid_t (*start) (int, char **);
+    } methods[] = {
+        {"fork", start_fork},
+#ifdef BENCH_POSIX_SPAWN
+        {"posix_spawn", start_posix_spawn},
+#endif
+        {"vfork", start_vfork}
+    };
+
+    int failures = 0;
+    std::cout << "Mean time to start " << CHILD << " over " << launches
+              << " launches, parent " << mb << " MB" << std::endl;
+    for (size_t m = 0; m < sizeof (methods) / sizeof (methods[0]); m++) {
+        double ms = time_starts (methods[m].start, launches);
+        std::cout << "  " << methods[m].name << ": ";
+        if (ms < 0.0) {
+            std::cout << "failed: " << std::strerror (errno) << std::endl;
+            failures++;
+        }
+        else {
+            std::cout << ms << " ms" << std::endl;
+        }
+    }
+    return failures ? 1 : 0;
+}